@@ -1,8 +1,10 @@
-#include <map>
+#include <mutex>
 #include <vector>
 #include <iostream>
 #include <algorithm>
 #include <cstring>
+#include <cctype>
+#include <string>
 
 #include "AIL.h"
 #include "AIL_internal.h"
@@ -13,15 +15,33 @@
 #include "tga.h"
 #include "tiff.h"
 #include "hdr.h"
-
-#ifdef HAVE_EXR
-#include <half.h>
-#endif
-
-std::map<int32_t, AImg::ImageLoaderBase*> loaders;
+#include "OutputStream.h"
+#include "Orientation.h"
+#include "ThreadPool.h"
+
+// Indexed by AImgFileFormat, NULL for formats that weren't compiled in. Only AImgInitialise and AImgCleanUp write to it,
+// under initMutex, so everything else can read it without locking.
+static const int32_t NUM_FILE_FORMATS = AImgFileFormat::HDR_IMAGE_FORMAT + 1;
+static AImg::ImageLoaderBase* loaders[NUM_FILE_FORMATS] = {};
+static bool initialised = false;
+static std::mutex initMutex;
+
+static void destroyLoaders()
+{
+    for (int32_t i = 0; i < NUM_FILE_FORMATS; i++)
+    {
+        delete loaders[i];
+        loaders[i] = NULL;
+    }
+}
 
 int32_t AImgInitialise()
 {
+    std::lock_guard<std::mutex> lock(initMutex);
+
+    if (initialised)
+        return AImgErrorCode::AIMG_SUCCESS;
+
 #ifdef HAVE_EXR
     loaders[AImgFileFormat::EXR_IMAGE_FORMAT] = new AImg::ExrImageLoader();
 #endif
@@ -46,497 +66,770 @@ int32_t AImgInitialise()
     loaders[AImgFileFormat::HDR_IMAGE_FORMAT] = new AImg::HDRImageLoader();
 #endif
 
-    for (auto it = loaders.begin(); it != loaders.end(); ++it)
+    for (int32_t i = 0; i < NUM_FILE_FORMATS; i++)
     {
-        int32_t err = it->second->initialise();
+        if (loaders[i] == NULL)
+            continue;
+
+        int32_t err = loaders[i]->initialise();
         if (err != AImgErrorCode::AIMG_SUCCESS)
+        {
+            destroyLoaders();
             return err;
+        }
     }
 
+    initialised = true;
+
     return AImgErrorCode::AIMG_SUCCESS;
 }
 
 void AImgCleanUp()
 {
-    for (auto it = loaders.begin(); it != loaders.end(); ++it)
-        delete it->second;
+    std::lock_guard<std::mutex> lock(initMutex);
 
-    loaders.clear();
+    destroyLoaders();
+    AImg::shutdownThreadPool();
+    initialised = false;
 }
 
 namespace AImg
 {
     AImgBase::~AImgBase() {} // go away c++
     ImageLoaderBase::~ImageLoaderBase() {}
-}
 
-int32_t AImgOpen(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat)
-{
-    *imgH = (AImgHandle*)NULL;
+    int32_t AImgBase::decode(void* destBuffer, size_t rowPitchBytes, int32_t forceImageFormat)
+    {
+        int32_t width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+        int32_t err = getImageInfo(&width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-    int32_t startPos = tellCallback(callbackData);
+        return decode(0, 0, width, height, destBuffer, rowPitchBytes, forceImageFormat);
+    }
 
-    uint8_t testByte;
-    if (readCallback(callbackData, &testByte, 1) != 1)
-        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
+    int32_t AImgBase::decode(int32_t x, int32_t y, int32_t width, int32_t height, void* destBuffer, size_t rowPitchBytes, int32_t forceImageFormat)
+    {
+        int32_t imageWidth, imageHeight, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+        int32_t err = getImageInfo(&imageWidth, &imageHeight, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-    seekCallback(callbackData, startPos);
+        if (x < 0 || y < 0 || width <= 0 || height <= 0 || width > imageWidth - x || height > imageHeight - y)
+        {
+            mErrorDetails = "[AImg::AImgBase::decode] region is empty or not inside the image";
+            return AImgErrorCode::AIMG_INVALID_REGION;
+        }
 
-    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
-    int32_t retval = AIMG_UNSUPPORTED_FILETYPE;
+        if (forceImageFormat != AImgFormat::INVALID_FORMAT)
+            AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-    for (const auto loader : loaders)
-    {
-        if (loader.second->canLoadImage(readCallback, tellCallback, seekCallback, callbackData))
+        size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
+
+        if (rowPitchBytes == 0)
+            rowPitchBytes = rowSize;
+
+        if (rowPitchBytes < rowSize)
         {
-            fileFormat = loader.second->getAImgFileFormatValue();
+            mErrorDetails = "[AImg::AImgBase::decode] rowPitchBytes is smaller than a row of the decoded image";
+            return AImgErrorCode::AIMG_INVALID_ROW_PITCH;
+        }
 
-            AImg::AImgBase* img = loader.second->getAImg();
-            *imgH = img;
+        // Bottom up is just the rows written from the end of destBuffer backwards. Every codec writes its rows through the
+        // pitch, so they land flipped as they're decoded.
+        uint8_t* dest = (uint8_t*)destBuffer;
+        ptrdiff_t destRowPitch = (ptrdiff_t)rowPitchBytes;
 
-            retval = img->openImage(readCallback, tellCallback, seekCallback, callbackData);
-            break;
+        if (mDecodeFlags & AImgDecodeFlags::AIMG_DECODE_BOTTOM_UP)
+        {
+            dest += (height - 1) * destRowPitch;
+            destRowPitch = -destRowPitch;
         }
+
+        return decodeRegion(x, y, width, height, dest, destRowPitch, forceImageFormat);
     }
 
-    if (detectedFileFormat != NULL)
-        *detectedFileFormat = fileFormat;
+    int32_t AImgBase::beginDecode(int32_t forceImageFormat)
+    {
+        if (mRowDecodeActive)
+        {
+            mErrorDetails = "[AImg::AImgBase::beginDecode] decoding has already begun";
+            return AImgErrorCode::AIMG_INVALID_DECODE_STATE;
+        }
 
-    return retval;
-}
+        int32_t width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat;
+        int32_t err = getImageInfo(&width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &decodedImgFormat, NULL);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-void AImgClose(AImgHandle imgH)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    delete img;
-}
+        if (forceImageFormat != AImgFormat::INVALID_FORMAT)
+            AIGetFormatDetails(forceImageFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-EXPORT_FUNC const char* AImgGetErrorDetails(AImgHandle imgH)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->getErrorDetails();
-}
+        mRowDecodeRowSize = (size_t)width * numChannels * bytesPerChannel;
+        mRowDecodeHeight = height;
+        mRowDecodeForceFormat = forceImageFormat;
+        mNextRow = 0;
 
-int32_t AImgGetColourProfile(AImgHandle imgH, char *profileName, uint8_t *colourProfile, uint32_t *colourProfileLen)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->getColourProfile(profileName, colourProfile, colourProfileLen);
-}
+        if (canDecodeRows())
+        {
+            err = startRowDecode(forceImageFormat);
+        }
+        else
+        {
+            mBufferedRows.reset(new ScratchBuffer(mRowDecodeRowSize * height));
+            err = decodeRegion(0, 0, width, height, mBufferedRows->data(), mRowDecodeRowSize, forceImageFormat);
+        }
 
-int32_t AImgGetInfo(AImgHandle imgH, int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->getImageInfo(width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat, colourProfileLen);
-}
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+        {
+            mBufferedRows.reset();
+            return err;
+        }
 
-int32_t AImgDecodeImage(AImgHandle imgH, void* destBuffer, int32_t forceImageFormat)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
-    return img->decodeImage(destBuffer, forceImageFormat);
-}
+        mRowDecodeActive = true;
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
 
-AImgHandle AImgGetAImg(int32_t fileFormat)
-{
-    return loaders[fileFormat]->getAImg();
-}
+    int32_t AImgBase::readRows(void* destBuffer, size_t rowPitchBytes, int32_t rowCount)
+    {
+        if (!mRowDecodeActive)
+        {
+            mErrorDetails = "[AImg::AImgBase::readRows] decoding hasn't begun";
+            return AImgErrorCode::AIMG_INVALID_DECODE_STATE;
+        }
 
-int32_t AImgWriteImage(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-    WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions)
-{
-    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+        if (rowCount < 0 || rowCount > mRowDecodeHeight - mNextRow)
+        {
+            mErrorDetails = "[AImg::AImgBase::readRows] rowCount is more than the number of rows left to read";
+            return AImgErrorCode::AIMG_INVALID_DECODE_STATE;
+        }
 
-    int32_t err = img->verifyEncodeOptions(encodingOptions);
-    if (err != AImgErrorCode::AIMG_SUCCESS)
-        return err;
+        if (rowPitchBytes == 0)
+            rowPitchBytes = mRowDecodeRowSize;
 
-    return img->writeImage(data, width, height, inputFormat, outputFormat, profileName, colourProfile, colourProfileLen,
-        writeCallback, tellCallback, seekCallback, callbackData, encodingOptions);
-}
+        if (rowPitchBytes < mRowDecodeRowSize)
+        {
+            mErrorDetails = "[AImg::AImgBase::readRows] rowPitchBytes is smaller than a row of the decoded image";
+            return AImgErrorCode::AIMG_INVALID_ROW_PITCH;
+        }
 
-void convertToRGBA32F(void* src, std::vector<float>& dest, size_t i, int32_t inFormat)
-{
-    switch (inFormat)
-    {
-    case AImgFormat::R8U:
-    {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 1);
+        if (rowCount == 0)
+            return AImgErrorCode::AIMG_SUCCESS;
 
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[0]) / 255.0f;
-        dest[2] = ((float)srcF[0]) / 255.0f;
-        dest[3] = 1;
+        if (mBufferedRows)
+        {
+            for (int32_t row = 0; row < rowCount; row++)
+                memcpy((uint8_t*)destBuffer + row * rowPitchBytes, mBufferedRows->data() + (mNextRow + row) * mRowDecodeRowSize, mRowDecodeRowSize);
+        }
+        else
+        {
+            int32_t err = decodeRows(mNextRow, rowCount, destBuffer, rowPitchBytes, mRowDecodeForceFormat);
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+                return err;
+        }
 
-        break;
+        mNextRow += rowCount;
+        return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    case AImgFormat::RG8U:
+    int32_t AImgBase::endDecode()
     {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 2);
+        if (!mRowDecodeActive)
+        {
+            mErrorDetails = "[AImg::AImgBase::endDecode] decoding hasn't begun";
+            return AImgErrorCode::AIMG_INVALID_DECODE_STATE;
+        }
 
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[1]) / 255.0f;
-        dest[2] = 0;
-        dest[3] = 1;
+        if (mBufferedRows)
+            mBufferedRows.reset();
+        else
+            finishRowDecode();
 
-        break;
+        mRowDecodeActive = false;
+        return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    case AImgFormat::RGB8U:
+    int32_t AImgBase::write(const AImgWriteSource& source, int32_t width, int32_t height, int32_t outputFormat,
+        const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+        OutputStream* stream, void* encodingOptions)
     {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 3);
+        int32_t err = verifyEncodeOptions(encodingOptions);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[1]) / 255.0f;
-        dest[2] = ((float)srcF[2]) / 255.0f;
-        dest[3] = 1;
+        AImgWriteSource normalised;
+        err = normaliseWriteSource(source, width, normalised, mErrorDetails);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-        break;
-    }
+        if (!canWriteRows())
+            return writeImage(normalised, width, height, outputFormat, profileName, colourProfile, colourProfileLen, stream, encodingOptions);
 
-    case AImgFormat::RGBA8U:
-    {
-        uint8_t* srcF = ((uint8_t*)src) + (i * 4);
+        err = startWriteRows(width, height, normalised.format, outputFormat, profileName, colourProfile, colourProfileLen, stream, encodingOptions);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-        dest[0] = ((float)srcF[0]) / 255.0f;
-        dest[1] = ((float)srcF[1]) / 255.0f;
-        dest[2] = ((float)srcF[2]) / 255.0f;
-        dest[3] = ((float)srcF[3]) / 255.0f;
+        err = writeRowBand(normalised, height);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+        {
+            abortWriteRows();
+            return err;
+        }
 
-        break;
+        return finishWriteRows();
     }
 
-#ifdef HAVE_EXR
-    case AImgFormat::R16F:
+    int32_t AImgBase::writeBegin(int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+        const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+        OutputStream* stream, void* encodingOptions)
     {
-        half* srcF = ((half*)src) + (i * 1);
+        std::unique_ptr<OutputStream> ownedStream(stream);
 
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[0];
-        dest[2] = (float)srcF[0];
-        dest[3] = 1;
+        if (mWriteActive)
+        {
+            mErrorDetails = "[AImg::AImgBase::writeBegin] writing has already begun";
+            return AImgErrorCode::AIMG_INVALID_WRITE_STATE;
+        }
 
-        break;
-    }
+        int32_t err = verifyEncodeOptions(encodingOptions);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-    case AImgFormat::RG16F:
-    {
-        half* srcF = ((half*)src) + (i * 2);
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(inputFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[1];
-        dest[2] = 0;
-        dest[3] = 1;
+        if (numChannels <= 0)
+        {
+            mErrorDetails = "[AImg::AImgBase::writeBegin] invalid input format";
+            return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
+        }
 
-        break;
+        if (canWriteRows())
+        {
+            err = startWriteRows(width, height, inputFormat, outputFormat, profileName, colourProfile, colourProfileLen, ownedStream.get(), encodingOptions);
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+                return err;
+        }
+        else
+        {
+            mBufferedWrite.reset(new ScratchBuffer((size_t)width * height * numChannels * bytesPerChannel));
+
+            // the caller's profile only has to stay valid for this call
+            mHasWriteProfileName = profileName != NULL;
+            mWriteProfileName = profileName != NULL ? profileName : "";
+            mHasWriteColourProfile = colourProfile != NULL;
+            if (colourProfile != NULL)
+                mWriteColourProfile.assign(colourProfile, colourProfile + colourProfileLen);
+        }
+
+        mWriteStream = std::move(ownedStream);
+        mWriteWidth = width;
+        mWriteHeight = height;
+        mWriteInputFormat = inputFormat;
+        mWriteOutputFormat = outputFormat;
+        mRowsWritten = 0;
+        mWriteActive = true;
+
+        return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    case AImgFormat::RGB16F:
+    int32_t AImgBase::writeRows(const AImgWriteSource& source, int32_t rowCount)
     {
-        half* srcF = ((half*)src) + (i * 3);
+        if (!mWriteActive)
+        {
+            mErrorDetails = "[AImg::AImgBase::writeRows] writing hasn't begun";
+            return AImgErrorCode::AIMG_INVALID_WRITE_STATE;
+        }
 
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[1];
-        dest[2] = (float)srcF[2];
-        dest[3] = 1;
+        if (rowCount < 0 || rowCount > mWriteHeight - mRowsWritten)
+        {
+            mErrorDetails = "[AImg::AImgBase::writeRows] rowCount is more than the number of rows left to write";
+            return AImgErrorCode::AIMG_INVALID_WRITE_STATE;
+        }
 
-        break;
-    }
+        if (source.format != mWriteInputFormat)
+        {
+            mErrorDetails = "[AImg::AImgBase::writeRows] source format is not the inputFormat writing began with";
+            return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
+        }
 
-    case AImgFormat::RGBA16F:
-    {
-        half* srcF = ((half*)src) + (i * 4);
+        if (rowCount == 0)
+            return AImgErrorCode::AIMG_SUCCESS;
 
-        dest[0] = (float)srcF[0];
-        dest[1] = (float)srcF[1];
-        dest[2] = (float)srcF[2];
-        dest[3] = (float)srcF[3];
+        AImgWriteSource normalised;
+        int32_t err = normaliseWriteSource(source, mWriteWidth, normalised, mErrorDetails);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-        break;
+        if (mBufferedWrite)
+        {
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(mWriteInputFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+            size_t rowSize = (size_t)mWriteWidth * numChannels * bytesPerChannel;
+
+            WriteSourceRows rows(normalised, mWriteWidth, mWriteInputFormat);
+            for (int32_t y = 0; y < rowCount; y++)
+            {
+                const uint8_t* row;
+                err = rows.getRow(y, &row);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
+
+                memcpy(mBufferedWrite->data() + (mRowsWritten + y) * rowSize, row, rowSize);
+            }
+        }
+        else
+        {
+            err = writeRowBand(normalised, rowCount);
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+            {
+                // the encoder can't carry on after a failure
+                std::string details = mErrorDetails;
+                cancelWrite();
+                mErrorDetails = details;
+                return err;
+            }
+        }
+
+        mRowsWritten += rowCount;
+        return AImgErrorCode::AIMG_SUCCESS;
     }
-#endif
 
-    case AImgFormat::R16U:
+    int32_t AImgBase::writeRows(const void* data, int32_t rowCount)
     {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 1);
-
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[0]) / 65535.0f;
-        dest[2] = ((float)srcF[0]) / 65535.0f;
-        dest[3] = 1;
-
-        break;
+        return writeRows(packedWriteSource((void*)data, mWriteInputFormat), rowCount);
     }
 
-    case AImgFormat::RG16U:
+    int32_t AImgBase::writeEnd()
     {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 2);
+        if (!mWriteActive)
+        {
+            mErrorDetails = "[AImg::AImgBase::writeEnd] writing hasn't begun";
+            return AImgErrorCode::AIMG_INVALID_WRITE_STATE;
+        }
 
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[1]) / 65535.0f;
-        dest[2] = 0;
-        dest[3] = 1;
+        if (mRowsWritten != mWriteHeight)
+        {
+            cancelWrite();
+            mErrorDetails = "[AImg::AImgBase::writeEnd] not every row was written";
+            return AImgErrorCode::AIMG_INVALID_WRITE_STATE;
+        }
 
-        break;
+        int32_t err;
+        if (mBufferedWrite)
+        {
+            AImgWriteSource buffered;
+            err = normaliseWriteSource(packedWriteSource(mBufferedWrite->data(), mWriteInputFormat), mWriteWidth, buffered, mErrorDetails);
+            if (err == AImgErrorCode::AIMG_SUCCESS)
+                err = writeImage(buffered, mWriteWidth, mWriteHeight, mWriteOutputFormat,
+                    mHasWriteProfileName ? mWriteProfileName.c_str() : NULL,
+                    mHasWriteColourProfile ? mWriteColourProfile.data() : NULL, (uint32_t)mWriteColourProfile.size(),
+                    mWriteStream.get(), NULL);
+        }
+        else
+        {
+            err = finishWriteRows();
+        }
+
+        mWriteStream->flush();
+        cancelWrite();
+
+        return err;
     }
 
-    case AImgFormat::RGB16U:
+    void AImgBase::cancelWrite()
     {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 3);
-
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[1]) / 65535.0f;
-        dest[2] = ((float)srcF[2]) / 65535.0f;
-        dest[3] = 1;
+        if (!mBufferedWrite)
+            abortWriteRows();
 
-        break;
+        mBufferedWrite.reset();
+        mWriteColourProfile.clear();
+        mWriteStream.reset();
+        mWriteActive = false;
     }
+}
 
-    case AImgFormat::RGBA16U:
-    {
-        uint16_t* srcF = ((uint16_t*)src) + (i * 4);
+// The order formats are tried in when there's no hint. TGA has no signature, just a heuristic on its header fields, so it must go last.
+static const int32_t detectionOrder[] =
+{
+    AImgFileFormat::EXR_IMAGE_FORMAT,
+    AImgFileFormat::PNG_IMAGE_FORMAT,
+    AImgFileFormat::JPEG_IMAGE_FORMAT,
+    AImgFileFormat::TIFF_IMAGE_FORMAT,
+    AImgFileFormat::HDR_IMAGE_FORMAT,
+    AImgFileFormat::TGA_IMAGE_FORMAT
+};
 
-        dest[0] = ((float)srcF[0]) / 65535.0f;
-        dest[1] = ((float)srcF[1]) / 65535.0f;
-        dest[2] = ((float)srcF[2]) / 65535.0f;
-        dest[3] = ((float)srcF[3]) / 65535.0f;
+static AImg::ImageLoaderBase* getLoader(int32_t fileFormat)
+{
+    if (fileFormat < 0 || fileFormat >= NUM_FILE_FORMATS)
+        return NULL;
 
-        break;
-    }
+    return loaders[fileFormat];
+}
 
-    case AImgFormat::R32F:
+// header is AIMG_DETECT_HEADER_SIZE bytes from the start of the stream
+static AImg::ImageLoaderBase* findLoader(const uint8_t* header, int32_t fileFormatHint)
+{
+    AImg::ImageLoaderBase* loader = getLoader(fileFormatHint);
+    if (loader != NULL && loader->canLoadImage(header, AImg::AIMG_DETECT_HEADER_SIZE))
+        return loader;
+
+    // no hint, or a bad one, so fall back to detecting it
+    for (size_t i = 0; i < sizeof(detectionOrder) / sizeof(detectionOrder[0]); i++)
     {
-        float* srcF = ((float*)src) + (i * 1);
+        loader = getLoader(detectionOrder[i]);
+        if (loader != NULL && loader->canLoadImage(header, AImg::AIMG_DETECT_HEADER_SIZE))
+            return loader;
+    }
 
-        dest[0] = srcF[0];
-        dest[1] = srcF[0];
-        dest[2] = srcF[0];
-        dest[3] = 1;
+    return NULL;
+}
 
-        break;
-    }
+int32_t openFromStream(AImg::InputStream* stream, int32_t fileFormatHint, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    *imgH = (AImgHandle*)NULL;
 
-    case AImgFormat::RG32F:
+    // One peek for everything, each loader only looks at these bytes
+    uint8_t header[AImg::AIMG_DETECT_HEADER_SIZE] = {};
+    if (stream->peek(header, AImg::AIMG_DETECT_HEADER_SIZE) <= 0)
     {
-        float* srcF = ((float*)src) + (i * 2);
+        delete stream;
+        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
+    }
 
-        dest[0] = srcF[0];
-        dest[1] = srcF[1];
-        dest[2] = 0;
-        dest[3] = 1;
+    AImg::ImageLoaderBase* loader = findLoader(header, fileFormatHint);
 
-        break;
-    }
+    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
+    int32_t retval = AIMG_UNSUPPORTED_FILETYPE;
 
-    case AImgFormat::RGB32F:
+    if (loader != NULL)
     {
-        float* srcF = ((float*)src) + (i * 3);
+        fileFormat = loader->getAImgFileFormatValue();
 
-        dest[0] = srcF[0];
-        dest[1] = srcF[1];
-        dest[2] = srcF[2];
-        dest[3] = 1;
+        AImg::AImgBase* img = loader->getAImg();
+        *imgH = img;
 
-        break;
+        retval = img->open(stream);
     }
-
-    case AImgFormat::RGBA32F:
+    else
     {
-        float* srcF = ((float*)src) + (i * 4);
+        // nobody claimed it
+        delete stream;
+    }
 
-        dest[0] = srcF[0];
-        dest[1] = srcF[1];
-        dest[2] = srcF[2];
-        dest[3] = srcF[3];
+    if (detectedFileFormat != NULL)
+        *detectedFileFormat = fileFormat;
 
-        break;
-    }
+    return retval;
+}
 
-    default:
+int32_t probeFromStream(AImg::InputStream* stream, AImgProbeInfo* info)
+{
+    *info = AImgProbeInfo();
+    info->fileFormat = UNKNOWN_IMAGE_FORMAT;
+
+    int64_t startPos = stream->tell();
+
+    uint8_t header[AImg::AIMG_DETECT_HEADER_SIZE] = {};
+    if (stream->peek(header, AImg::AIMG_DETECT_HEADER_SIZE) <= 0)
+        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
+
+    AImg::ImageLoaderBase* loader = findLoader(header, UNKNOWN_IMAGE_FORMAT);
+    if (loader == NULL)
+        return AImgErrorCode::AIMG_UNSUPPORTED_FILETYPE;
+
+    info->fileFormat = loader->getAImgFileFormatValue();
+    int32_t retval = loader->probeImage(stream, info);
+
+    stream->seek(startPos);
+    return retval;
+}
+
+int32_t AImgFileFormatFromExtension(const char* extension)
+{
+    if (extension == NULL)
+        return UNKNOWN_IMAGE_FORMAT;
+
+    if (extension[0] == '.')
+        extension++;
+
+    std::string ext(extension);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+    if (ext == "exr")
+        return AImgFileFormat::EXR_IMAGE_FORMAT;
+    if (ext == "png")
+        return AImgFileFormat::PNG_IMAGE_FORMAT;
+    if (ext == "jpg" || ext == "jpeg" || ext == "jpe" || ext == "jfif")
+        return AImgFileFormat::JPEG_IMAGE_FORMAT;
+    if (ext == "tga")
+        return AImgFileFormat::TGA_IMAGE_FORMAT;
+    if (ext == "tif" || ext == "tiff")
+        return AImgFileFormat::TIFF_IMAGE_FORMAT;
+    if (ext == "hdr")
+        return AImgFileFormat::HDR_IMAGE_FORMAT;
+
+    return UNKNOWN_IMAGE_FORMAT;
+}
+
+int32_t AImgOpen(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    return AImgOpenWithHint(readCallback, tellCallback, seekCallback, callbackData, UNKNOWN_IMAGE_FORMAT, imgH, detectedFileFormat);
+}
+
+int32_t AImgOpenWithHint(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, int32_t fileFormatHint, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    return openFromStream(new AImg::InputStream(readCallback, tellCallback, seekCallback, callbackData), fileFormatHint, imgH, detectedFileFormat);
+}
+
+int32_t AImgOpenMemory(const void* data, size_t size, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    return AImgOpenMemoryWithHint(data, size, UNKNOWN_IMAGE_FORMAT, imgH, detectedFileFormat);
+}
+
+int32_t AImgOpenMemoryWithHint(const void* data, size_t size, int32_t fileFormatHint, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    if (data == NULL || size == 0)
     {
-        break;
-    }
+        *imgH = (AImgHandle*)NULL;
+        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
     }
+
+    return openFromStream(new AImg::InputStream(data, size), fileFormatHint, imgH, detectedFileFormat);
 }
 
-void convertFromRGBA32F(std::vector<float>& src, void* dst, size_t i, int32_t outFormat)
+int32_t AImgOpenStream(const AImgStreamCallbacks* callbacks, AImgHandle* imgH, int32_t* detectedFileFormat)
 {
-    switch (outFormat)
-    {
-    case AImgFormat::R8U:
+    return AImgOpenStreamWithHint(callbacks, UNKNOWN_IMAGE_FORMAT, imgH, detectedFileFormat);
+}
+
+int32_t AImgOpenStreamWithHint(const AImgStreamCallbacks* callbacks, int32_t fileFormatHint, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    if (callbacks == NULL || callbacks->version != AIMG_STREAM_CALLBACKS_VERSION ||
+        callbacks->readCallback == NULL || callbacks->tellCallback == NULL || callbacks->seekCallback == NULL)
     {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 1);
+        *imgH = (AImgHandle*)NULL;
+        return AImgErrorCode::AIMG_INVALID_STREAM_CALLBACKS;
+    }
 
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
+    return openFromStream(new AImg::InputStream(*callbacks), fileFormatHint, imgH, detectedFileFormat);
+}
 
-        break;
-    }
+int32_t AImgOpenFile(const char* path, AImgHandle* imgH, int32_t* detectedFileFormat)
+{
+    *imgH = (AImgHandle*)NULL;
 
-    case AImgFormat::RG8U:
-    {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 2);
+    int32_t err = AImgErrorCode::AIMG_SUCCESS;
+    AImg::InputStream* stream = AImg::InputStream::mapFile(path, &err);
+    if (stream == NULL)
+        return err;
 
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
-        dstF[1] = (uint8_t)(src[1] * 255.0f);
+    const char* extension = strrchr(path, '.');
+    int32_t fileFormatHint = extension != NULL ? AImgFileFormatFromExtension(extension) : UNKNOWN_IMAGE_FORMAT;
 
-        break;
-    }
+    return openFromStream(stream, fileFormatHint, imgH, detectedFileFormat);
+}
 
-    case AImgFormat::RGB8U:
-    {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 3);
+// Probing only reads a few headers, so use a small buffer on the stack rather than the usual heap allocated one
+static const int64_t PROBE_BUFFER_SIZE = 4096;
 
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
-        dstF[1] = (uint8_t)(src[1] * 255.0f);
-        dstF[2] = (uint8_t)(src[2] * 255.0f);
+int32_t AImgProbe(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgProbeInfo* info)
+{
+    CallbackData v1 = {};
+    v1.readCallback = readCallback;
+    v1.tellCallback = tellCallback;
+    v1.seekCallback = seekCallback;
+    v1.callbackData = callbackData;
 
-        break;
-    }
+    AImgStreamCallbacks callbacks;
+    wrapV1Callbacks(&v1, &callbacks);
 
-    case AImgFormat::RGBA8U:
-    {
-        uint8_t* dstF = ((uint8_t*)dst) + (i * 4);
+    return AImgProbeStream(&callbacks, info);
+}
 
-        dstF[0] = (uint8_t)(src[0] * 255.0f);
-        dstF[1] = (uint8_t)(src[1] * 255.0f);
-        dstF[2] = (uint8_t)(src[2] * 255.0f);
-        dstF[3] = (uint8_t)(src[3] * 255.0f);
+int32_t AImgProbeMemory(const void* data, size_t size, AImgProbeInfo* info)
+{
+    if (data == NULL || size == 0)
+        return AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
 
-        break;
-    }
+    AImg::InputStream stream(data, size);
+    return probeFromStream(&stream, info);
+}
 
-#ifdef HAVE_EXR
-    case AImgFormat::R16F:
-    {
-        half* dstF = ((half*)dst) + (i * 1);
+int32_t AImgProbeStream(const AImgStreamCallbacks* callbacks, AImgProbeInfo* info)
+{
+    if (callbacks == NULL || callbacks->version != AIMG_STREAM_CALLBACKS_VERSION ||
+        callbacks->readCallback == NULL || callbacks->tellCallback == NULL || callbacks->seekCallback == NULL)
+        return AImgErrorCode::AIMG_INVALID_STREAM_CALLBACKS;
 
-        dstF[0] = src[0];
+    uint8_t buffer[PROBE_BUFFER_SIZE];
+    AImg::InputStream stream(*callbacks, buffer, PROBE_BUFFER_SIZE);
 
-        break;
-    }
+    int32_t retval = probeFromStream(&stream, info);
 
-    case AImgFormat::RG16F:
-    {
-        half* dstF = ((half*)dst) + (i * 2);
+    // The read-ahead will have moved the callbacks on past where we reported, so put them back where we started
+    callbacks->seekCallback(callbacks->callbackData, stream.tell());
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
+    return retval;
+}
 
-        break;
-    }
+void AImgSetReadBufferSize(int32_t size)
+{
+    AImg::InputStream::setReadBufferSize(size);
+}
 
-    case AImgFormat::RGB16F:
-    {
-        half* dstF = ((half*)dst) + (i * 3);
+void AImgSetWriteBufferSize(int32_t size)
+{
+    AImg::OutputStream::setWriteBufferSize(size);
+}
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
+void AImgClose(AImgHandle imgH)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    delete img;
+}
 
-        break;
-    }
+EXPORT_FUNC const char* AImgGetErrorDetails(AImgHandle imgH)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->getErrorDetails();
+}
 
-    case AImgFormat::RGBA16F:
-    {
-        half* dstF = ((half*)dst) + (i * 4);
+int32_t AImgGetColourProfile(AImgHandle imgH, char *profileName, uint8_t *colourProfile, uint32_t *colourProfileLen)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->getColourProfile(profileName, colourProfile, colourProfileLen);
+}
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
-        dstF[3] = src[3];
+int32_t AImgGetInfo(AImgHandle imgH, int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->getImageInfo(width, height, numChannels, bytesPerChannel, floatOrInt, decodedImgFormat, colourProfileLen);
+}
 
-        break;
-    }
-#endif
+int32_t AImgDecodeImage(AImgHandle imgH, void* destBuffer, int32_t forceImageFormat)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->decode(destBuffer, 0, forceImageFormat);
+}
 
-    case AImgFormat::R16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 1);
+int32_t AImgDecodeImageStrided(AImgHandle imgH, void* destBuffer, size_t rowPitchBytes, int32_t forceImageFormat)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->decode(destBuffer, rowPitchBytes, forceImageFormat);
+}
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
+int32_t AImgDecodeRegion(AImgHandle imgH, int32_t x, int32_t y, int32_t width, int32_t height, void* destBuffer, int32_t forceImageFormat)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->decode(x, y, width, height, destBuffer, 0, forceImageFormat);
+}
 
-        break;
-    }
+void AImgSetDecodeFlags(AImgHandle imgH, int32_t flags)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    img->setDecodeFlags(flags);
+}
 
-    case AImgFormat::RG16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 2);
+int32_t AImgBeginDecode(AImgHandle imgH, int32_t forceImageFormat)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->beginDecode(forceImageFormat);
+}
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
-        dstF[1] = (uint16_t)(src[1] * 65535.0f);
+int32_t AImgReadRows(AImgHandle imgH, void* destBuffer, int32_t rowCount)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->readRows(destBuffer, 0, rowCount);
+}
 
-        break;
-    }
+int32_t AImgEndDecode(AImgHandle imgH)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->endDecode();
+}
 
-    case AImgFormat::RGB16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 3);
+int32_t AImgWriteBegin(AImgHandle imgH, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+    const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen, const AImgStreamCallbacks* callbacks, void* encodingOptions)
+{
+    if (callbacks == NULL || callbacks->version != AIMG_STREAM_CALLBACKS_VERSION ||
+        callbacks->writeCallback == NULL || callbacks->tellCallback == NULL || callbacks->seekCallback == NULL)
+        return AImgErrorCode::AIMG_INVALID_STREAM_CALLBACKS;
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
-        dstF[1] = (uint16_t)(src[1] * 65535.0f);
-        dstF[2] = (uint16_t)(src[2] * 65535.0f);
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->writeBegin(width, height, inputFormat, outputFormat, profileName, colourProfile, colourProfileLen,
+        new AImg::OutputStream(*callbacks), encodingOptions);
+}
 
-        break;
-    }
+int32_t AImgWriteRows(AImgHandle imgH, const void* data, int32_t rowCount)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->writeRows(data, rowCount);
+}
 
-    case AImgFormat::RGBA16U:
-    {
-        uint16_t* dstF = ((uint16_t*)dst) + (i * 4);
+int32_t AImgWriteRowsFromSource(AImgHandle imgH, const AImgWriteSource* source, int32_t rowCount)
+{
+    if (source == NULL)
+        return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
 
-        dstF[0] = (uint16_t)(src[0] * 65535.0f);
-        dstF[1] = (uint16_t)(src[1] * 65535.0f);
-        dstF[2] = (uint16_t)(src[2] * 65535.0f);
-        dstF[3] = (uint16_t)(src[3] * 65535.0f);
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->writeRows(*source, rowCount);
+}
 
-        break;
-    }
+int32_t AImgWriteEnd(AImgHandle imgH)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
+    return img->writeEnd();
+}
 
-    case AImgFormat::R32F:
-    {
-        float* dstF = ((float*)dst) + (i * 1);
+AImgHandle AImgGetAImg(int32_t fileFormat)
+{
+    AImg::ImageLoaderBase* loader = getLoader(fileFormat);
+    if (loader == NULL)
+        return NULL;
 
-        dstF[0] = src[0];
+    return loader->getAImg();
+}
 
-        break;
-    }
+int32_t AImgWriteImage(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+    WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions)
+{
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
 
-    case AImgFormat::RG32F:
-    {
-        float* dstF = ((float*)dst) + (i * 2);
+    AImg::OutputStream stream(writeCallback, tellCallback, seekCallback, callbackData);
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
+    int32_t err = img->write(AImg::packedWriteSource(data, inputFormat), width, height, outputFormat, profileName, colourProfile, colourProfileLen, &stream, encodingOptions);
+    stream.flush();
 
-        break;
-    }
+    return err;
+}
 
-    case AImgFormat::RGB32F:
-    {
-        float* dstF = ((float*)dst) + (i * 3);
+int32_t AImgWriteImageStream(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+    const AImgStreamCallbacks* callbacks, void* encodingOptions)
+{
+    AImgWriteSource source = AImg::packedWriteSource(data, inputFormat);
+    return AImgWriteImageFromSource(imgH, &source, width, height, outputFormat, profileName, colourProfile, colourProfileLen, callbacks, encodingOptions);
+}
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
+int32_t AImgWriteImageFromSource(AImgHandle imgH, const AImgWriteSource* source, int32_t width, int32_t height, int32_t outputFormat,
+    const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen, const AImgStreamCallbacks* callbacks, void* encodingOptions)
+{
+    if (callbacks == NULL || callbacks->version != AIMG_STREAM_CALLBACKS_VERSION ||
+        callbacks->writeCallback == NULL || callbacks->tellCallback == NULL || callbacks->seekCallback == NULL)
+        return AImgErrorCode::AIMG_INVALID_STREAM_CALLBACKS;
 
-        break;
-    }
+    if (source == NULL)
+        return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
 
-    case AImgFormat::RGBA32F:
-    {
-        float* dstF = ((float*)dst) + (i * 4);
+    AImg::AImgBase* img = (AImg::AImgBase*)imgH;
 
-        dstF[0] = src[0];
-        dstF[1] = src[1];
-        dstF[2] = src[2];
-        dstF[3] = src[3];
+    AImg::OutputStream stream(*callbacks);
 
-        break;
-    }
+    int32_t err = img->write(*source, width, height, outputFormat, profileName, colourProfile, colourProfileLen, &stream, encodingOptions);
+    stream.flush();
 
-    default:
-    {
-        break;
-    }
-    }
+    return err;
 }
 
 int32_t AIGetBitDepth(int32_t format)
@@ -736,41 +1029,79 @@ void AIGetFormatDetails(int32_t format, int32_t* numChannels, int32_t* bytesPerC
     }
 }
 
+// Whole image conversions are split between threads in bands of rows of at least this many bytes, counting both the source and
+// destination, so each thread's share is worth waking it up for
+static const size_t PARALLEL_CONVERT_BAND_BYTES = 1024 * 1024;
+
+// How many rows go in each band, and how many bands there are. There's just the one for small images.
+static int32_t getConvertBands(int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t* bandRows)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t rowBytes = (size_t)width * numChannels * bytesPerChannel;
+    AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    rowBytes += (size_t)width * numChannels * bytesPerChannel;
+
+    *bandRows = (int32_t)std::min((size_t)std::max(height, 1), std::max(PARALLEL_CONVERT_BAND_BYTES / std::max(rowBytes, (size_t)1), (size_t)1));
+    return (height + *bandRows - 1) / *bandRows;
+}
+
 int32_t AImgConvertFormat(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat)
 {
-#ifndef HAVE_EXR
-    if (inFormat == AImgFormat::R16F || inFormat == AImgFormat::RG16F || inFormat == AImgFormat::RGB16F || inFormat == AImgFormat::RGBA16F ||
-        outFormat == AImgFormat::R16F || outFormat == AImgFormat::RG16F || outFormat == AImgFormat::RGB16F || outFormat == AImgFormat::RGBA16F)
-    {
-        AISetLastErrorDetails("Bad format requested, 16 bit float formats not available when compiled without EXR support");
+    return AImgConvertFormatThreaded(src, dest, width, height, inFormat, outFormat, 0);
+}
+
+int32_t AImgConvertFormatThreaded(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t numThreads)
+{
+    AImg::ConvertPixelsFunc convert = AImg::getConvertPixelsFunc(inFormat, outFormat);
+    if (convert == NULL)
         return AImgErrorCode::AIMG_CONVERSION_FAILED_BAD_FORMAT;
-    }
-#endif
 
-    std::vector<float> scratch(4);
+    int32_t bandRows;
+    int32_t bands = getConvertBands(width, height, inFormat, outFormat, &bandRows);
 
-    int32_t _, floatOrInt;
-    AIGetFormatDetails(inFormat, &_, &_, &floatOrInt);
-    bool inIsFloat = floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
-    AIGetFormatDetails(outFormat, &_, &_, &floatOrInt);
-    bool outIsFloat = floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT;
+    if (bands <= 1 || numThreads == 1)
+    {
+        convert(src, dest, (size_t)width * height);
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
 
-    for (int32_t i = 0; i < width*height; i++)
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t srcRowSize = (size_t)width * numChannels * bytesPerChannel;
+    AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t destRowSize = (size_t)width * numChannels * bytesPerChannel;
+
+    return AImg::parallelFor(bands, numThreads, [&](int32_t band)
     {
-        convertToRGBA32F(src, scratch, i, inFormat);
+        int32_t firstRow = band * bandRows;
+        int32_t rows = std::min(bandRows, height - firstRow);
+        convert((const uint8_t*)src + firstRow * srcRowSize, (uint8_t*)dest + firstRow * destRowSize, (size_t)width * rows);
+        return AImgErrorCode::AIMG_SUCCESS;
+    });
+}
 
-        // clamp to 0-1 range
-        if (inIsFloat && !outIsFloat)
-        {
-            scratch[0] = std::min(1.0f, std::max(0.0f, scratch[0]));
-            scratch[1] = std::min(1.0f, std::max(0.0f, scratch[1]));
-            scratch[2] = std::min(1.0f, std::max(0.0f, scratch[2]));
-            scratch[3] = std::min(1.0f, std::max(0.0f, scratch[3]));
-        }
+int32_t convertFormatStrided(const void* src, size_t srcRowPitch, void* dest, ptrdiff_t destRowPitch, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t srcRowSize = (size_t)width * numChannels * bytesPerChannel;
+    AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t destRowSize = (size_t)width * numChannels * bytesPerChannel;
+
+    AImg::ConvertPixelsFunc convert = AImg::getConvertPixelsFunc(inFormat, outFormat);
+    if (convert == NULL)
+        return AImgErrorCode::AIMG_CONVERSION_FAILED_BAD_FORMAT;
 
-        convertFromRGBA32F(scratch, dest, i, outFormat);
+    if (srcRowPitch == srcRowSize && destRowPitch == (ptrdiff_t)destRowSize)
+    {
+        convert(src, dest, (size_t)width * height);
+        return AImgErrorCode::AIMG_SUCCESS;
     }
 
+    for (int32_t y = 0; y < height; y++)
+        convert((const uint8_t*)src + y * srcRowPitch, (uint8_t*)dest + y * destRowPitch, width);
+
     return AImgErrorCode::AIMG_SUCCESS;
 }
 
@@ -782,72 +1113,162 @@ bool IsMachineBigEndian()
 }
 
 int32_t AImgConvertOrientation(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t orientationFlag)
+{
+    return AImgConvertOrientationThreaded(src, dest, width, height, inFormat, outFormat, orientationFlag, 0);
+}
+
+int32_t AImgConvertOrientationThreaded(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t orientationFlag, int32_t numThreads)
 {
 #if defined(HAVE_JPEG) || defined(HAVE_TIFF)
 
-    std::vector<float> scratch(4);
-    int32_t size = width * height;
+    if (AImg::getConvertPixelsFunc(inFormat, outFormat) == NULL)
+        return AImgErrorCode::AIMG_CONVERSION_FAILED_BAD_FORMAT;
 
-    for (int32_t i = 0; i < size; i++)
-    {
-        convertToRGBA32F(src, scratch, i, inFormat);
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t srcRowPitch = (size_t)width * numChannels * bytesPerChannel;
+    AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    bool swapsAxes = orientationFlag >= 5 && orientationFlag <= 8;
+    ptrdiff_t destRowPitch = (ptrdiff_t)(swapsAxes ? height : width) * numChannels * bytesPerChannel;
 
-        int source_x = i % width;
-        int source_y = (int)(i / width);
+    int32_t bandRows;
+    int32_t bands = getConvertBands(width, height, inFormat, outFormat, &bandRows);
 
-        int transform = i;
+    if (bands <= 1 || numThreads == 1)
+        return AImg::convertOrientationRows(src, srcRowPitch, dest, destRowPitch, width, height, inFormat, outFormat, orientationFlag, 0, height);
 
-        int target_x = source_x;
-        int target_y = source_y;
-        int stride = width;
-        switch (orientationFlag)
-        {
-        case 2: // flip horizontal
-            target_x = width - 1 - source_x;
-            break;
-        case 3: // rotate 180
-            target_x = width - 1 - source_x;
-            target_y = height - 1 - source_y;
-            break;
-        case 4: // flip vertical
-            target_y = height - 1 - source_y;
-            break;
-        case 5: // transpose
-            target_x = source_y;
-            target_y = source_x;
-            stride = height;
-            break;
-        case 6: // rotate 270
-            target_x = height - 1 - source_y;
-            target_y = source_x;
-            stride = height;
-            break;
-        case 7: // transverse
-            target_x = height - 1 - source_y;
-            target_y = width - 1 - source_x;
-            stride = height;
-            break;
-        case 8: // rotate 90
-            target_x = source_y;
-            target_y = width - 1 - source_x;
-            stride = height;
-            break;
-        }
-        transform = target_x + target_y * stride;
-        convertFromRGBA32F(scratch, dest, transform, outFormat);
-    }
+    return AImg::parallelFor(bands, numThreads, [&](int32_t band)
+    {
+        int32_t firstRow = band * bandRows;
+        return AImg::convertOrientationRows((uint8_t*)src + firstRow * srcRowPitch, srcRowPitch, dest, destRowPitch, width, height, inFormat, outFormat,
+            orientationFlag, firstRow, std::min(firstRow + bandRows, height));
+    });
+#else
+    AIL_UNUSED_PARAM(numThreads);
 #endif
     return AImgErrorCode::AIMG_SUCCESS;
 }
 
+void orientedRegionToStored(int32_t orientationFlag, int32_t storedWidth, int32_t storedHeight, int32_t x, int32_t y, int32_t width, int32_t height,
+    int32_t* storedX, int32_t* storedY, int32_t* storedRegionWidth, int32_t* storedRegionHeight)
+{
+    // the flags from 5 up swap the axes
+    bool swapsAxes = orientationFlag >= 5 && orientationFlag <= 8;
+    *storedRegionWidth = swapsAxes ? height : width;
+    *storedRegionHeight = swapsAxes ? width : height;
+
+    switch (orientationFlag)
+    {
+    case 2: // flip horizontal
+        *storedX = storedWidth - x - width;
+        *storedY = y;
+        break;
+    case 3: // rotate 180
+        *storedX = storedWidth - x - width;
+        *storedY = storedHeight - y - height;
+        break;
+    case 4: // flip vertical
+        *storedX = x;
+        *storedY = storedHeight - y - height;
+        break;
+    case 5: // transpose
+        *storedX = y;
+        *storedY = x;
+        break;
+    case 6: // rotate 270
+        *storedX = y;
+        *storedY = storedHeight - x - width;
+        break;
+    case 7: // transverse
+        *storedX = storedWidth - y - height;
+        *storedY = storedHeight - x - width;
+        break;
+    case 8: // rotate 90
+        *storedX = storedWidth - y - height;
+        *storedY = x;
+        break;
+    default:
+        *storedX = x;
+        *storedY = y;
+        break;
+    }
+}
+
 bool AImgIsFormatSupported(int32_t fileFormat, int32_t outputFormat)
 {
-    return loaders[fileFormat]->isFormatSupported(outputFormat);
+    AImg::ImageLoaderBase* loader = getLoader(fileFormat);
+    if (loader == NULL)
+        return false;
+
+    return loader->isFormatSupported(outputFormat);
 }
 
 int32_t AImgGetWhatFormatWillBeWrittenForData(int32_t fileFormat, int32_t inputFormat, int32_t outputFormat)
 {
-    return loaders[fileFormat]->getWhatFormatWillBeWrittenForData(inputFormat, outputFormat);
+    AImg::ImageLoaderBase* loader = getLoader(fileFormat);
+    if (loader == NULL)
+        return AImgFormat::INVALID_FORMAT;
+
+    return loader->getWhatFormatWillBeWrittenForData(inputFormat, outputFormat);
+}
+
+int64_t CALLCONV v1ReadThunk(void* callbackData, uint8_t* dest, int64_t count)
+{
+    auto v1 = (CallbackData*)callbackData;
+
+    int64_t total = 0;
+    while (count > 0)
+    {
+        int32_t chunk = (int32_t)std::min(count, (int64_t)INT32_MAX);
+        int32_t bytesRead = v1->readCallback(v1->callbackData, dest + total, chunk);
+        if (bytesRead <= 0)
+            break;
+
+        total += bytesRead;
+        count -= bytesRead;
+
+        if (bytesRead < chunk)
+            break;
+    }
+
+    return total;
+}
+
+void CALLCONV v1WriteThunk(void* callbackData, const uint8_t* src, int64_t count)
+{
+    auto v1 = (CallbackData*)callbackData;
+
+    while (count > 0)
+    {
+        int32_t chunk = (int32_t)std::min(count, (int64_t)INT32_MAX);
+        v1->writeCallback(v1->callbackData, src, chunk);
+
+        src += chunk;
+        count -= chunk;
+    }
+}
+
+int64_t CALLCONV v1TellThunk(void* callbackData)
+{
+    auto v1 = (CallbackData*)callbackData;
+    return v1->tellCallback(v1->callbackData);
+}
+
+void CALLCONV v1SeekThunk(void* callbackData, int64_t pos)
+{
+    auto v1 = (CallbackData*)callbackData;
+    v1->seekCallback(v1->callbackData, (int32_t)pos);
+}
+
+void wrapV1Callbacks(CallbackData* v1, AImgStreamCallbacks* callbacks)
+{
+    callbacks->version = AIMG_STREAM_CALLBACKS_VERSION;
+    callbacks->callbackData = v1;
+    callbacks->readCallback = v1->readCallback ? &v1ReadThunk : NULL;
+    callbacks->writeCallback = v1->writeCallback ? &v1WriteThunk : NULL;
+    callbacks->tellCallback = &v1TellThunk;
+    callbacks->seekCallback = &v1SeekThunk;
+    callbacks->sizeCallback = NULL;
 }
 
 struct SimpleMemoryCallbackData
@@ -21,6 +21,7 @@
 #define ARTOMATIX_AIL_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -48,6 +49,17 @@ extern "C"
     typedef int32_t(CALLCONV *TellCallback)    (void* callbackData);
     typedef void    (CALLCONV *SeekCallback)    (void* callbackData, int32_t pos);
 
+    // 64 bit versions of the above, used through AImgStreamCallbacks for streams over 2GB
+    typedef int64_t(CALLCONV *ReadCallback64)  (void* callbackData, uint8_t* dest, int64_t count);
+    typedef void    (CALLCONV *WriteCallback64) (void* callbackData, const uint8_t* src, int64_t count);
+    typedef int64_t(CALLCONV *TellCallback64)  (void* callbackData);
+    typedef void    (CALLCONV *SeekCallback64)  (void* callbackData, int64_t pos);
+    typedef int64_t(CALLCONV *SizeCallback64)  (void* callbackData); // total length of the stream in bytes, or -1 if not known
+
+    // Allocator callbacks, see AImgSetAllocator
+    typedef void*   (CALLCONV *AImgMallocCallback) (void* user, size_t size);
+    typedef void    (CALLCONV *AImgFreeCallback)   (void* user, void* ptr);
+
     ////////////////
     // Core enums //
     ////////////////
@@ -105,7 +117,30 @@ extern "C"
         AIMG_WRITE_NOT_SUPPORTED_FOR_FORMAT = -10,
         AIMG_EXIF_DATA_NOT_SUPPORTED = -11,
         AIMG_EXIF_DATA_NOT_FOUND = -12,
-        AIMG_EXIF_INVALID_DATA = -13
+        AIMG_EXIF_INVALID_DATA = -13,
+        AIMG_OPEN_FAILED_CANNOT_OPEN_FILE = -14,
+        AIMG_INVALID_STREAM_CALLBACKS = -15,
+        AIMG_INVALID_ROW_PITCH = -16,
+        AIMG_INVALID_WRITE_SOURCE = -17,
+        AIMG_INVALID_REGION = -18,
+        AIMG_INVALID_DECODE_STATE = -19,
+        AIMG_INVALID_WRITE_STATE = -20
+    };
+
+    // Instruction sets format conversions can use, see AImgSetMaxSimdLevel
+    enum AImgSimdLevel
+    {
+        AIMG_SIMD_NONE = 0,
+        AIMG_SIMD_SSE2 = 1,
+        AIMG_SIMD_SSE41 = 2,
+        AIMG_SIMD_AVX2 = 3 // and F16C
+    };
+
+    // Flags for AImgSetDecodeFlags
+    enum AImgDecodeFlags
+    {
+        AIMG_DECODE_DEFAULT = 0,
+        AIMG_DECODE_BOTTOM_UP = 1 << 0 // the bottom row comes first in destBuffer, as OpenGL expects of textures
     };
 
     enum AImgFileFormat
@@ -155,6 +190,61 @@ extern "C"
         int32_t filter; // Used with png_set_filter(), set to some combination of AIL_PNG_ flag defines from above.
     };
 
+    ////////////////////////////
+    // Stream callback struct //
+    ////////////////////////////
+
+#define AIMG_STREAM_CALLBACKS_VERSION 2
+
+    struct AImgStreamCallbacks
+    {
+        int32_t version; // must be set to AIMG_STREAM_CALLBACKS_VERSION
+        void* callbackData;
+
+        ReadCallback64 readCallback; // only needed for reading
+        WriteCallback64 writeCallback; // only needed for writing
+        TellCallback64 tellCallback;
+        SeekCallback64 seekCallback;
+        SizeCallback64 sizeCallback; // optional, may be NULL. Lets decoders that need the stream length (eg tiff) avoid seeking around to find it.
+    };
+
+    // Filled in by AImgProbe, with the same values AImgGetInfo would give for the image
+    struct AImgProbeInfo
+    {
+        int32_t fileFormat; // member of AImgFileFormat
+        int32_t width;
+        int32_t height;
+        int32_t numChannels;
+        int32_t bytesPerChannel;
+        int32_t floatOrInt;
+        int32_t decodedImgFormat;
+        uint32_t colourProfileLen;
+    };
+
+    //////////////////////////
+    // Write source struct  //
+    //////////////////////////
+
+    enum AImgChannelOrder
+    {
+        AIMG_CHANNEL_ORDER_RGBA = 0,
+        AIMG_CHANNEL_ORDER_BGRA = 1 // red and blue swapped in memory, ie BGR or BGRA. Only valid for 3 and 4 channel formats.
+    };
+
+    // Describes pixel data for AImgWriteImageFromSource, for when it isn't a packed, interleaved, RGBA ordered buffer,
+    // eg a pitched BGRA framebuffer, or one float plane per channel. Zero it, then fill in what you need.
+    struct AImgWriteSource
+    {
+        int32_t format; // member of AImgFormat, giving the number of channels and their type
+        int32_t channelOrder; // member of AImgChannelOrder, for interleaved data
+
+        void* data; // interleaved pixels, or NULL for planar data
+        void* planes[4]; // planar data, one plane per channel in R, G, B, A order. Only used when data is NULL.
+
+        size_t rowPitchBytes; // distance between the starts of consecutive rows (in every plane). 0 means tightly packed.
+        size_t pixelStrideBytes; // distance between consecutive pixels (samples, for planar data). 0 means tightly packed.
+    };
+
     //////////////////////////
     // Public API functions //
     //////////////////////////
@@ -165,20 +255,102 @@ extern "C"
 
     // detectedFileFormat will be set to a member from AImgFileFormat if non-null, otherwise it is ignored.
     EXPORT_FUNC int32_t AImgOpen(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+    // Opens an image file that is already in memory. The decoders read straight out of data without copying it first, so it must stay valid until AImgClose.
+    EXPORT_FUNC int32_t AImgOpenMemory(const void* data, size_t size, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+    // Same as AImgOpen, but with 64 bit offsets, so images over 2GB can be read.
+    EXPORT_FUNC int32_t AImgOpenStream(const struct AImgStreamCallbacks* callbacks, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+    // Opens an image file from disk. The file is memory mapped and decoded in place, as with AImgOpenMemory.
+    // The file extension is used as a format hint, see below.
+    EXPORT_FUNC int32_t AImgOpenFile(const char* path, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+
+    // Same as AImgOpen/AImgOpenMemory/AImgOpenStream, but fileFormatHint (a member of AImgFileFormat) is checked first, so the other formats don't need to be probed.
+    // If the data doesn't match the hinted format, we fall back to detecting it as normal, so a wrong hint is harmless.
+    EXPORT_FUNC int32_t AImgOpenWithHint(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, int32_t fileFormatHint, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+    EXPORT_FUNC int32_t AImgOpenMemoryWithHint(const void* data, size_t size, int32_t fileFormatHint, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+    EXPORT_FUNC int32_t AImgOpenStreamWithHint(const struct AImgStreamCallbacks* callbacks, int32_t fileFormatHint, AImgHandle* imgPtr, int32_t* detectedFileFormat);
+    // Maps a file extension (with or without the leading '.', case insensitive) to a member of AImgFileFormat, UNKNOWN_IMAGE_FORMAT if we don't recognise it.
+    EXPORT_FUNC int32_t AImgFileFormatFromExtension(const char* extension);
+
     EXPORT_FUNC void AImgClose(AImgHandle img);
 
+    // Reads just the file headers to fill in info, without creating a decoder or allocating image buffers.
+    // Much cheaper than AImgOpen + AImgGetInfo when that's all you need. The stream is left at the position it started at.
+    EXPORT_FUNC int32_t AImgProbe(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, struct AImgProbeInfo* info);
+    EXPORT_FUNC int32_t AImgProbeMemory(const void* data, size_t size, struct AImgProbeInfo* info);
+    EXPORT_FUNC int32_t AImgProbeStream(const struct AImgStreamCallbacks* callbacks, struct AImgProbeInfo* info);
+
+    // Sets the size of the read-ahead buffer that sits between the decoders and the callbacks passed to AImgOpen/AImgOpenStream.
+    // Small reads from the codec libraries are served from this buffer, so they only reach the callbacks once per buffer.
+    // 0 disables buffering. Defaults to 64KB. Only affects images opened after the call.
+    EXPORT_FUNC void AImgSetReadBufferSize(int32_t size);
+
     EXPORT_FUNC int32_t AImgGetInfo(AImgHandle img, int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen);
     EXPORT_FUNC int32_t AImgGetColourProfile(AImgHandle img, char* profileName, uint8_t* colourProfile, uint32_t *colourProfileLen);
     EXPORT_FUNC int32_t AImgDecodeImage(AImgHandle img, void* destBuffer, int32_t forceImageFormat);
+
+    // Same as AImgDecodeImage, but rows in destBuffer start rowPitchBytes apart, so you can decode straight into a pitched
+    // upload buffer or a region of a larger image. rowPitchBytes must be at least width * the size of a pixel in the decoded
+    // format (forceImageFormat, if set), and 0 means tightly packed. Bytes between the end of a row and the start of the next are left untouched.
+    EXPORT_FUNC int32_t AImgDecodeImageStrided(AImgHandle img, void* destBuffer, size_t rowPitchBytes, int32_t forceImageFormat);
+
+    // Decodes just the width x height rectangle with its top left corner at (x, y) into destBuffer, tightly packed.
+    // The rectangle must lie inside the image. Where the codec allows it, the rest of the file isn't decoded: rows after the
+    // rectangle are never read, png and jpeg rows above it are skipped, jpeg (with libjpeg-turbo) and exr columns are cropped during decoding, and only
+    // the tiff strips it overlaps are read. Interlaced pngs, tga and hdr are decoded in full and then cropped.
+    EXPORT_FUNC int32_t AImgDecodeRegion(AImgHandle img, int32_t x, int32_t y, int32_t width, int32_t height, void* destBuffer, int32_t forceImageFormat);
+
+    // Sets AImgDecodeFlags for the AImgDecodeImage, AImgDecodeImageStrided and AImgDecodeRegion calls on this image.
+    // With AIMG_DECODE_BOTTOM_UP, each row is written straight to its flipped place as it's decoded, so it costs nothing
+    // over a normal decode. AImgReadRows always goes top to bottom.
+    EXPORT_FUNC void AImgSetDecodeFlags(AImgHandle img, int32_t flags);
+
+    // Decodes an image a few rows at a time, top to bottom, so it can be processed (hashed, resized, uploaded...) as it's decoded
+    // without holding all of it in memory. Call AImgBeginDecode once, then AImgReadRows as many times as needed, each call decoding
+    // the next rowCount rows into destBuffer, tightly packed, in the decoded format (or forceImageFormat, if set). AImgEndDecode
+    // finishes up, and may be called before every row has been read. Like AImgDecodeImage, a handle can only be decoded once.
+    // Calls out of order, or asking for more rows than are left, fail with AIMG_INVALID_DECODE_STATE.
+    // Non-interlaced png, jpeg, tiff and exr only hold on to a strip's worth of the image at most. Interlaced png, jpegs and tiffs
+    // that need reorienting, tga and hdr can't be decoded in pieces, so AImgBeginDecode decodes the whole image into a buffer for them.
+    EXPORT_FUNC int32_t AImgBeginDecode(AImgHandle img, int32_t forceImageFormat);
+    EXPORT_FUNC int32_t AImgReadRows(AImgHandle img, void* destBuffer, int32_t rowCount);
+    EXPORT_FUNC int32_t AImgEndDecode(AImgHandle img);
+
+    // Threading: AImgInitialise is idempotent and safe to call from several threads at once. Once it has returned,
+    // every other function may be called concurrently from any number of threads, as long as each AImgHandle is only
+    // used by one thread at a time. AImgCleanUp must not run concurrently with anything else.
     EXPORT_FUNC int32_t AImgInitialise();
     EXPORT_FUNC void AImgCleanUp();
 
+    // Routes AIL's buffers through the given allocator: the decode/encode temporaries, stream buffers, stb's output,
+    // and libpng's and libjpeg's internal allocations. libtiff and OpenEXR don't support custom allocators, so their
+    // internals still use the system heap. Pass NULLs to go back to malloc/free.
+    // Must be called before AImgInitialise (or while no images are open), and not concurrently with anything else.
+    EXPORT_FUNC void AImgSetAllocator(AImgMallocCallback mallocFn, AImgFreeCallback freeFn, void* user);
+
+    // Decodes and encodes that need a whole-image temporary (eg to convert to a forced format) take it from a per-thread
+    // pool of uninitialised blocks, which are kept for reuse after the call. This caps how much each thread's pool keeps
+    // cached, in bytes. 0 disables pooling. Defaults to 128MB.
+    EXPORT_FUNC void AImgSetScratchPoolLimit(int64_t bytes);
+
+    // Format conversions (AImgConvertFormat, and decoding to a forced format) use vectorised kernels for the widest
+    // AImgSimdLevel the CPU supports, up to this limit, which defaults to AIMG_SIMD_AVX2. Every level gives exactly the same
+    // results, so this is only useful for testing and benchmarking. AImgGetSimdLevel returns the level in use.
+    EXPORT_FUNC void AImgSetMaxSimdLevel(int32_t level);
+    EXPORT_FUNC int32_t AImgGetSimdLevel();
+
     EXPORT_FUNC int32_t AIGetBitDepth(int32_t format);
     EXPORT_FUNC int32_t AIChangeBitDepth(int32_t format, int32_t newBitDepth);
     EXPORT_FUNC void AIGetFormatDetails(int32_t format, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt);
     EXPORT_FUNC int32_t AImgConvertFormat(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat);
     EXPORT_FUNC int32_t AImgConvertOrientation(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t orientationFlag);
 
+    // Like AImgConvertFormat and AImgConvertOrientation, but with the image split into bands of rows that are converted on up to
+    // numThreads threads: the caller's, and an internal pool's (which AImgCleanUp stops). 0 means one per hardware thread, and
+    // 1 converts on the calling thread. Larger counts are used as given, up to 64, even on machines with fewer hardware threads.
+    // Small images are always converted on the calling thread. The plain versions pass 0.
+    EXPORT_FUNC int32_t AImgConvertFormatThreaded(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t numThreads);
+    EXPORT_FUNC int32_t AImgConvertOrientationThreaded(void* src, void* dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t orientationFlag, int32_t numThreads);
+
     EXPORT_FUNC bool AImgIsFormatSupported(int32_t fileFormat, int32_t outputFormat);
 
     EXPORT_FUNC int32_t AImgGetWhatFormatWillBeWrittenForData(int32_t fileFormat, int32_t inputFormat, int32_t outputFormat);
@@ -188,6 +360,35 @@ extern "C"
     // encodingOptions should be one of the encoding option structs detailed in the section above. It shoudl be the struct that corresponds to the image format being written.
     EXPORT_FUNC int32_t AImgWriteImage(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
         WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions);
+    // Same as AImgWriteImage, but with 64 bit offsets, so images over 2GB can be written.
+    EXPORT_FUNC int32_t AImgWriteImageStream(AImgHandle imgH, void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+        const struct AImgStreamCallbacks* callbacks, void* encodingOptions);
+
+    // Same as AImgWriteImageStream, but the pixels are described by source, so pitched, BGR(A) or planar data can be written
+    // without packing it first. The encoders read rows straight out of source, only copying a row at a time when it
+    // needs converting or reordering (and tga, which has to have the whole image packed).
+    EXPORT_FUNC int32_t AImgWriteImageFromSource(AImgHandle imgH, const struct AImgWriteSource* source, int32_t width, int32_t height, int32_t outputFormat,
+        const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen, const struct AImgStreamCallbacks* callbacks, void* encodingOptions);
+
+    // Writes an image a band of rows at a time, top to bottom, so the whole image never has to be in memory at once.
+    // AImgWriteBegin takes the same arguments as AImgWriteImageStream apart from the data, and the callbacks have to keep
+    // working until AImgWriteEnd. Each AImgWriteRows call then converts and encodes the next rowCount rows, packed and
+    // RGBA ordered in inputFormat (or laid out as described by source, for AImgWriteRowsFromSource, which must be in
+    // inputFormat). Each AImgWriteRowsFromSource call can lay its rows out differently, eg. BGRA for one band and planar for the next.
+    // AImgWriteEnd finishes the file and flushes the stream, and fails if not every row has been written.
+    // Calls out of order, or more rows than the image has, fail with AIMG_INVALID_WRITE_STATE.
+    // png, jpeg, tiff and exr are encoded as the rows come in. tga and hdr can only be written in one go, so their rows are
+    // collected in a buffer and written by AImgWriteEnd.
+    EXPORT_FUNC int32_t AImgWriteBegin(AImgHandle imgH, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+        const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen, const struct AImgStreamCallbacks* callbacks, void* encodingOptions);
+    EXPORT_FUNC int32_t AImgWriteRows(AImgHandle imgH, const void* data, int32_t rowCount);
+    EXPORT_FUNC int32_t AImgWriteRowsFromSource(AImgHandle imgH, const struct AImgWriteSource* source, int32_t rowCount);
+    EXPORT_FUNC int32_t AImgWriteEnd(AImgHandle imgH);
+
+    // Sets the size of the buffer that AImgWriteImage/AImgWriteImageStream collect encoder output in before passing it to the write callback.
+    // Position is tracked locally, so the tell callback is only called once per image, and the seek callback only when an encoder moves backwards.
+    // 0 disables buffering. Defaults to 64KB.
+    EXPORT_FUNC void AImgSetWriteBufferSize(int32_t size);
 
     EXPORT_FUNC void AIGetSimpleMemoryBufferCallbacks(ReadCallback* readCallback, WriteCallback* writeCallback, TellCallback* tellCallback, SeekCallback* seekCallback, void** callbackData, void* buffer, int32_t size);
     EXPORT_FUNC void AIDestroySimpleMemoryBufferCallbacks(ReadCallback readCallback, WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData);
@@ -23,6 +23,11 @@
 #define ARTOMATIX_AIL_INTERNAL_H
 
 #include "AIL.h"
+#include "Allocator.h"
+#include "ScratchBuffer.h"
+#include "WriteSource.h"
+#include "ConvertBand.h"
+#include "FormatConversion.h"
 
 #include <stdlib.h> // Required for _byteswap_ushort
 #ifdef _MSC_VER
@@ -36,6 +41,37 @@
 #define AIL_UNUSED_PARAM(name) (void)(name)
 bool IsMachineBigEndian();
 
+// Unaligned reads of file header fields with a given byte order, used when parsing headers ourselves (eg AImgProbe)
+inline uint16_t readUInt16(const uint8_t* p, bool littleEndian)
+{
+    return littleEndian ? (uint16_t)(p[0] | (p[1] << 8)) : (uint16_t)((p[0] << 8) | p[1]);
+}
+
+inline uint32_t readUInt32(const uint8_t* p, bool littleEndian)
+{
+    return littleEndian ?
+        ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24)) :
+        (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
+}
+
+inline uint64_t readUInt64(const uint8_t* p, bool littleEndian)
+{
+    uint64_t lo = readUInt32(p + (littleEndian ? 0 : 4), littleEndian);
+    uint64_t hi = readUInt32(p + (littleEndian ? 4 : 0), littleEndian);
+    return (hi << 32) | lo;
+}
+
+// Like AImgConvertFormat, but the rows of src and dest start srcRowPitch and destRowPitch bytes apart. destRowPitch is
+// negative when writing rows bottom up.
+// If inFormat == outFormat the rows are just copied.
+int32_t convertFormatStrided(const void* src, size_t srcRowPitch, void* dest, ptrdiff_t destRowPitch, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat);
+
+// Maps a rectangle of an image as it's shown after applying an EXIF/TIFF orientation flag (as in AImgConvertOrientation) back
+// to the rectangle of the stored image it comes from. storedWidth and storedHeight are the image's dimensions before reorienting.
+// Reorienting the stored rectangle on its own gives the requested one.
+void orientedRegionToStored(int32_t orientationFlag, int32_t storedWidth, int32_t storedHeight, int32_t x, int32_t y, int32_t width, int32_t height,
+    int32_t* storedX, int32_t* storedY, int32_t* storedRegionWidth, int32_t* storedRegionHeight);
+
 typedef struct CallbackData
 {
     ReadCallback readCallback;
@@ -45,4 +81,8 @@ typedef struct CallbackData
     void * callbackData;
 } CallbackData;
 
+// Fills in callbacks with thunks that forward to the 32 bit callbacks in v1, splitting up any read or write over 2GB.
+// v1 must outlive callbacks, as it is used as their callbackData.
+void wrapV1Callbacks(CallbackData* v1, AImgStreamCallbacks* callbacks);
+
 #endif // ARTOMATIX_AIL_INTERNAL_H
@@ -0,0 +1,81 @@
+#include "Allocator.h"
+#include "ScratchBuffer.h"
+#include "AIL.h"
+
+#include <stdlib.h>
+#include <cstring>
+#include <algorithm>
+
+namespace AImg
+{
+    static void* CALLCONV defaultMalloc(void* user, size_t size)
+    {
+        (void)user;
+        return malloc(size);
+    }
+
+    static void CALLCONV defaultFree(void* user, void* ptr)
+    {
+        (void)user;
+        free(ptr);
+    }
+
+    static AImgMallocCallback mallocCallback = defaultMalloc;
+    static AImgFreeCallback freeCallback = defaultFree;
+    static void* allocatorUserData = NULL;
+
+    AllocatorCallbacks getAllocator()
+    {
+        AllocatorCallbacks callbacks;
+        callbacks.mallocFn = mallocCallback;
+        callbacks.freeFn = freeCallback;
+        callbacks.user = allocatorUserData;
+        return callbacks;
+    }
+
+    void* aimgMalloc(size_t size)
+    {
+        return mallocCallback(allocatorUserData, size);
+    }
+
+    void aimgFree(void* ptr)
+    {
+        if (ptr != NULL)
+            freeCallback(allocatorUserData, ptr);
+    }
+
+    void* aimgReallocSized(void* ptr, size_t oldSize, size_t newSize)
+    {
+        void* newPtr = aimgMalloc(newSize);
+        if (newPtr == NULL)
+            return NULL;
+
+        if (ptr != NULL)
+        {
+            memcpy(newPtr, ptr, std::min(oldSize, newSize));
+            aimgFree(ptr);
+        }
+
+        return newPtr;
+    }
+}
+
+void AImgSetAllocator(AImgMallocCallback mallocFn, AImgFreeCallback freeFn, void* user)
+{
+    // scratch blocks remember their own allocator, so this isn't needed for correctness, but it means the outgoing
+    // allocator sees everything it handed out (on this thread at least) come back
+    AImg::trimScratchPool();
+
+    if (mallocFn == NULL || freeFn == NULL)
+    {
+        AImg::mallocCallback = AImg::defaultMalloc;
+        AImg::freeCallback = AImg::defaultFree;
+        AImg::allocatorUserData = NULL;
+    }
+    else
+    {
+        AImg::mallocCallback = mallocFn;
+        AImg::freeCallback = freeFn;
+        AImg::allocatorUserData = user;
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_ALLOCATOR_H
+#define ARTOMATIX_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+
+#include "AIL.h"
+
+namespace AImg
+{
+    struct AllocatorCallbacks
+    {
+        AImgMallocCallback mallocFn;
+        AImgFreeCallback freeFn;
+        void* user;
+    };
+
+    // The allocator AImgSetAllocator last installed
+    AllocatorCallbacks getAllocator();
+
+    // All of AIL's own buffers (and the codec libraries' where they let us) come from these, which forward to whatever
+    // was passed to AImgSetAllocator, or malloc/free if nothing was.
+    void* aimgMalloc(size_t size);
+    void aimgFree(void* ptr);
+    // stb needs a realloc, we don't require one from the user so this is malloc + copy + free
+    void* aimgReallocSized(void* ptr, size_t oldSize, size_t newSize);
+
+    template <typename T>
+    struct Allocator
+    {
+        typedef T value_type;
+
+        Allocator() {}
+        template <typename U> Allocator(const Allocator<U>&) {}
+
+        T* allocate(size_t n)
+        {
+            T* ptr = (T*)aimgMalloc(n * sizeof(T));
+            if (ptr == NULL && n != 0)
+                throw std::bad_alloc();
+            return ptr;
+        }
+
+        void deallocate(T* ptr, size_t)
+        {
+            aimgFree(ptr);
+        }
+    };
+
+    template <typename T, typename U> bool operator==(const Allocator<T>&, const Allocator<U>&) { return true; }
+    template <typename T, typename U> bool operator!=(const Allocator<T>&, const Allocator<U>&) { return false; }
+
+    template <typename T>
+    using Vector = std::vector<T, Allocator<T>>;
+}
+
+#endif // ARTOMATIX_ALLOCATOR_H
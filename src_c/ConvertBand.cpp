@@ -0,0 +1,83 @@
+#include "ConvertBand.h"
+#include "AIL_internal.h"
+#include "Orientation.h"
+
+#include <algorithm>
+
+namespace AImg
+{
+    void ConvertBand::init(int32_t decodedWidth, int32_t x, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, void* dest, ptrdiff_t rowPitchBytes,
+        int32_t orientationFlag)
+    {
+        mOrientationFlag = orientationFlag >= 2 && orientationFlag <= 8 ? orientationFlag : 1;
+        mDirect = x == 0 && width == decodedWidth && inFormat == outFormat && mOrientationFlag == 1;
+        mX = x;
+        mWidth = width;
+        mInFormat = inFormat;
+        mOutFormat = outFormat;
+        mDest = (uint8_t*)dest;
+        mRowPitchBytes = rowPitchBytes;
+        mHeight = height;
+        mRowsLeft = height;
+        mRowsInBand = 0;
+
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        mPixelSize = (size_t)numChannels * bytesPerChannel;
+        mBandRowPitch = (size_t)decodedWidth * mPixelSize;
+
+        if (mDirect)
+            return;
+
+        AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        size_t destRowSize = (size_t)width * numChannels * bytesPerChannel;
+
+        mBandRows = (int32_t)std::min((size_t)std::max(height, 1), std::max(AIMG_CONVERT_BAND_BYTES / (mBandRowPitch + destRowSize), (size_t)1));
+
+        // Transposes go through the band in tiles, so it should be at least a tile high
+        if (mOrientationFlag >= 5)
+            mBandRows = std::min(std::max(mBandRows, AIMG_ORIENT_TILE_ROWS), std::max(height, 1));
+
+        mBand.resize(mBandRowPitch * mBandRows);
+    }
+
+    int32_t ConvertBand::rowsFree() const
+    {
+        if (mDirect)
+            return mRowsLeft;
+
+        return std::min(mBandRows - mRowsInBand, mRowsLeft);
+    }
+
+    int32_t ConvertBand::rowsDecoded(int32_t rowCount)
+    {
+        mRowsLeft -= rowCount;
+
+        if (mDirect)
+        {
+            mDest += rowCount * mRowPitchBytes;
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        mRowsInBand += rowCount;
+        if (mRowsInBand < mBandRows && mRowsLeft > 0)
+            return AImgErrorCode::AIMG_SUCCESS;
+
+        if (mOrientationFlag != 1)
+        {
+            int32_t firstRow = mHeight - mRowsLeft - mRowsInBand;
+            int32_t err = convertOrientationRows(mBand.data() + mX * mPixelSize, mBandRowPitch, mDest, mRowPitchBytes, mWidth, mHeight,
+                mInFormat, mOutFormat, mOrientationFlag, firstRow, firstRow + mRowsInBand);
+
+            mRowsInBand = 0;
+            return err;
+        }
+
+        int32_t err = convertFormatStrided(mBand.data() + mX * mPixelSize, mBandRowPitch, mDest, mRowPitchBytes, mWidth, mRowsInBand, mInFormat, mOutFormat);
+
+        mDest += mRowsInBand * mRowPitchBytes;
+        mRowsInBand = 0;
+
+        return err;
+    }
+}
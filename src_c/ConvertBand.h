@@ -0,0 +1,80 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_CONVERT_BAND_H
+#define ARTOMATIX_CONVERT_BAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ScratchBuffer.h"
+
+namespace AImg
+{
+    // How much of a band of decoded rows and their converted copy we try to keep in L2 at once
+    const size_t AIMG_CONVERT_BAND_BYTES = 256 * 1024;
+
+    // Decoders that need to crop or convert what the codec gives them decode a band of a few rows at a time into this, rather
+    // than the whole image into a temporary that's converted afterwards. Each band is converted out to the caller's buffer as
+    // soon as it fills, while it's still in cache. Rows that need neither go straight into the caller's buffer.
+    class ConvertBand
+    {
+    public:
+        ConvertBand() {}
+
+        // height rows will come in as decodedWidth pixels of inFormat, and the width pixels from column x of each are
+        // converted to outFormat and written to dest, rowPitchBytes apart (negative for bottom up). With an orientationFlag from 2 to 8, dest is the
+        // width x height image reoriented (see AImgConvertOrientation), and each band is written straight to where it ends up.
+        void init(int32_t decodedWidth, int32_t x, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, void* dest, ptrdiff_t rowPitchBytes,
+            int32_t orientationFlag = 1);
+
+        // Where the codec should put the next row, and the ones after it rowPitch() apart, up to rowsFree() of them.
+        // Rows that aren't wanted (eg above a region) can be decoded here too, as long as rowsDecoded isn't called for them.
+        uint8_t* nextRow() { return mDirect ? mDest : mBand.data() + mRowsInBand * mBandRowPitch; }
+        ptrdiff_t rowPitch() const { return mDirect ? mRowPitchBytes : (ptrdiff_t)mBandRowPitch; }
+        int32_t rowsFree() const;
+
+        // Call once rowCount (at most rowsFree()) rows have been decoded from nextRow() on. Converts the band out when it's full,
+        // or when the last row has come in.
+        int32_t rowsDecoded(int32_t rowCount);
+
+    private:
+        ConvertBand(const ConvertBand&) = delete;
+        ConvertBand& operator=(const ConvertBand&) = delete;
+
+        bool mDirect = true;
+        int32_t mX = 0;
+        int32_t mWidth = 0;
+        int32_t mInFormat = 0;
+        int32_t mOutFormat = 0;
+        int32_t mOrientationFlag = 1;
+        int32_t mHeight = 0;
+        size_t mPixelSize = 0;
+        uint8_t* mDest = nullptr;
+        ptrdiff_t mRowPitchBytes = 0;
+        int32_t mRowsLeft = 0;
+
+        ScratchBuffer mBand;
+        size_t mBandRowPitch = 0;
+        int32_t mBandRows = 0;
+        int32_t mRowsInBand = 0;
+    };
+}
+
+#endif // ARTOMATIX_CONVERT_BAND_H
@@ -0,0 +1,287 @@
+#include "FormatConversion.h"
+#include "AIL.h"
+#include "Half.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+namespace AImg
+{
+    namespace
+    {
+        // How each channel type maps to and from the 0-1 float range AImgConvertFormat works in
+        template <typename T> struct ChannelTraits;
+
+        template <> struct ChannelTraits<uint8_t>
+        {
+            static const bool isFloat = false;
+            static float toFloat(uint8_t v) { return ((float)v) / 255.0f; }
+            static uint8_t fromFloat(float v) { return (uint8_t)(v * 255.0f); }
+        };
+
+        template <> struct ChannelTraits<uint16_t>
+        {
+            static const bool isFloat = false;
+            static float toFloat(uint16_t v) { return ((float)v) / 65535.0f; }
+            static uint16_t fromFloat(float v) { return (uint16_t)(v * 65535.0f); }
+        };
+
+        // The bits of a half float, see Half.h
+        struct Half
+        {
+            uint16_t bits;
+        };
+
+        template <> struct ChannelTraits<Half>
+        {
+            static const bool isFloat = true;
+            static float toFloat(Half v) { return halfToFloat(v.bits); }
+            static Half fromFloat(float v) { Half h = { floatToHalf(v) }; return h; }
+        };
+
+        template <> struct ChannelTraits<float>
+        {
+            static const bool isFloat = true;
+            static float toFloat(float v) { return v; }
+            static float fromFloat(float v) { return v; }
+        };
+
+        // Converts one channel value through float, clamping when going from float to normalised integers
+        template <typename In, typename Out> struct ChannelConverter
+        {
+            static Out convert(In v)
+            {
+                float f = ChannelTraits<In>::toFloat(v);
+
+                if (ChannelTraits<In>::isFloat && !ChannelTraits<Out>::isFloat)
+                    f = std::min(1.0f, std::max(0.0f, f));
+
+                return ChannelTraits<Out>::fromFloat(f);
+            }
+        };
+
+        // Integer shortcuts for the pairs where going through float is exact. These have been checked against the float path
+        // for every input value.
+        template <> struct ChannelConverter<uint8_t, uint8_t>
+        {
+            static uint8_t convert(uint8_t v) { return v; }
+        };
+
+        template <> struct ChannelConverter<uint16_t, uint16_t>
+        {
+            static uint16_t convert(uint16_t v) { return v; }
+        };
+
+        template <> struct ChannelConverter<uint8_t, uint16_t>
+        {
+            static uint16_t convert(uint8_t v) { return (uint16_t)(v * 257); }
+        };
+
+        template <> struct ChannelConverter<uint16_t, uint8_t>
+        {
+            static uint8_t convert(uint16_t v) { return (uint8_t)(v / 257); }
+        };
+
+        template <> struct ChannelConverter<float, float>
+        {
+            static float convert(float v) { return v; }
+        };
+
+        // Going through float would give the same bits, apart from quietening signalling NaNs
+        template <> struct ChannelConverter<Half, Half>
+        {
+            static Half convert(Half v) { return v; }
+        };
+
+        // There are few enough halves to look every one up
+        template <> struct ChannelConverter<Half, uint8_t>
+        {
+            static uint8_t convert(Half v) { return halfTables.toUnorm8[v.bits]; }
+        };
+
+        // The kernel for one pair of formats. Channels are expanded to RGBA the same way AImgConvertFormat always has (grey
+        // is copied to RGB, a missing blue is 0, a missing alpha is 1), then the first OutChannels are kept.
+        template <typename In, int InChannels, typename Out, int OutChannels>
+        void convertPixels(const void* src, void* dest, size_t count)
+        {
+            if (std::is_same<In, Out>::value && InChannels == OutChannels)
+            {
+                memcpy(dest, src, count * InChannels * sizeof(In));
+                return;
+            }
+
+            typedef ChannelConverter<In, Out> Converter;
+
+            const In* srcPixel = (const In*)src;
+            Out* destPixel = (Out*)dest;
+
+            const Out zero = ChannelTraits<Out>::fromFloat(0.0f);
+            const Out one = ChannelTraits<Out>::fromFloat(1.0f);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                Out rgba[4];
+                rgba[0] = Converter::convert(srcPixel[0]);
+                rgba[1] = InChannels == 1 ? rgba[0] : Converter::convert(srcPixel[1]);
+                rgba[2] = InChannels == 1 ? rgba[0] : InChannels == 2 ? zero : Converter::convert(srcPixel[2]);
+                rgba[3] = InChannels == 4 ? Converter::convert(srcPixel[3]) : one;
+
+                for (int c = 0; c < OutChannels; c++)
+                    destPixel[c] = rgba[c];
+
+                srcPixel += InChannels;
+                destPixel += OutChannels;
+            }
+        }
+
+        // Formats are indexed by channel count, then by channel type in this order
+        enum ChannelTypeIndex
+        {
+            CHANNELS_8U = 0,
+            CHANNELS_16U = 1,
+            CHANNELS_16F = 2,
+            CHANNELS_32F = 3,
+            NUM_CHANNEL_TYPES = 4
+        };
+
+        const int32_t NUM_FORMATS = NUM_CHANNEL_TYPES * 4;
+
+        int32_t formatIndex(int32_t format)
+        {
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+            int32_t channelType;
+            if (bytesPerChannel == 1)
+                channelType = CHANNELS_8U;
+            else if (bytesPerChannel == 2)
+                channelType = floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT ? CHANNELS_16F : CHANNELS_16U;
+            else if (bytesPerChannel == 4)
+                channelType = CHANNELS_32F;
+            else
+                return -1;
+
+            return channelType * 4 + numChannels - 1;
+        }
+
+        template <typename In, int InChannels, typename Out>
+        void fillOutputs(ConvertPixelsFunc* funcs)
+        {
+            funcs[0] = &convertPixels<In, InChannels, Out, 1>;
+            funcs[1] = &convertPixels<In, InChannels, Out, 2>;
+            funcs[2] = &convertPixels<In, InChannels, Out, 3>;
+            funcs[3] = &convertPixels<In, InChannels, Out, 4>;
+        }
+
+        template <typename In, int InChannels>
+        void fillRow(ConvertPixelsFunc* funcs)
+        {
+            fillOutputs<In, InChannels, uint8_t>(funcs + CHANNELS_8U * 4);
+            fillOutputs<In, InChannels, uint16_t>(funcs + CHANNELS_16U * 4);
+            fillOutputs<In, InChannels, Half>(funcs + CHANNELS_16F * 4);
+            fillOutputs<In, InChannels, float>(funcs + CHANNELS_32F * 4);
+        }
+
+        template <typename In>
+        void fillRows(ConvertPixelsFunc (*rows)[NUM_FORMATS])
+        {
+            fillRow<In, 1>(rows[0]);
+            fillRow<In, 2>(rows[1]);
+            fillRow<In, 3>(rows[2]);
+            fillRow<In, 4>(rows[3]);
+        }
+
+        // The scalar kernels
+        struct ConvertTable
+        {
+            ConvertPixelsFunc funcs[NUM_FORMATS][NUM_FORMATS];
+
+            ConvertTable()
+            {
+                memset(funcs, 0, sizeof(funcs));
+
+                fillRows<uint8_t>(funcs + CHANNELS_8U * 4);
+                fillRows<uint16_t>(funcs + CHANNELS_16U * 4);
+                fillRows<Half>(funcs + CHANNELS_16F * 4);
+                fillRows<float>(funcs + CHANNELS_32F * 4);
+            }
+        };
+
+        const int32_t NUM_SIMD_LEVELS = AImgSimdLevel::AIMG_SIMD_AVX2 + 1;
+
+        // One table per AImgSimdLevel, each level starting from the one below and swapping in its own kernels, up to what
+        // the CPU supports. Levels above that are the same as the highest supported one.
+        struct SimdConvertTables
+        {
+            int32_t supportedLevel;
+            ConvertPixelsFunc funcs[NUM_SIMD_LEVELS][NUM_FORMATS][NUM_FORMATS];
+
+            SimdConvertTables()
+            {
+                supportedLevel = detectSimdLevel();
+
+                static const int32_t formats[NUM_FORMATS] =
+                {
+                    AImgFormat::R8U, AImgFormat::RG8U, AImgFormat::RGB8U, AImgFormat::RGBA8U,
+                    AImgFormat::R16U, AImgFormat::RG16U, AImgFormat::RGB16U, AImgFormat::RGBA16U,
+                    AImgFormat::R16F, AImgFormat::RG16F, AImgFormat::RGB16F, AImgFormat::RGBA16F,
+                    AImgFormat::R32F, AImgFormat::RG32F, AImgFormat::RGB32F, AImgFormat::RGBA32F
+                };
+
+                ConvertTable scalar;
+                memcpy(funcs[AImgSimdLevel::AIMG_SIMD_NONE], scalar.funcs, sizeof(scalar.funcs));
+
+                for (int32_t level = 1; level < NUM_SIMD_LEVELS; level++)
+                {
+                    for (int32_t in = 0; in < NUM_FORMATS; in++)
+                    {
+                        for (int32_t out = 0; out < NUM_FORMATS; out++)
+                        {
+                            ConvertPixelsFunc func = NULL;
+                            if (level <= supportedLevel && funcs[level - 1][in][out] != NULL)
+                                func = getSimdConvertPixelsFunc(level, formats[in], formats[out]);
+
+                            funcs[level][in][out] = func != NULL ? func : funcs[level - 1][in][out];
+                        }
+                    }
+                }
+            }
+        };
+
+        const SimdConvertTables& getTables()
+        {
+            static const SimdConvertTables tables;
+            return tables;
+        }
+
+        std::atomic<int32_t> maxSimdLevel(AImgSimdLevel::AIMG_SIMD_AVX2);
+
+        int32_t currentSimdLevel()
+        {
+            return std::min((int32_t)maxSimdLevel, getTables().supportedLevel);
+        }
+    }
+
+    ConvertPixelsFunc getConvertPixelsFunc(int32_t inFormat, int32_t outFormat)
+    {
+        int32_t in = formatIndex(inFormat);
+        int32_t out = formatIndex(outFormat);
+
+        if (in < 0 || out < 0)
+            return NULL;
+
+        return getTables().funcs[currentSimdLevel()][in][out];
+    }
+}
+
+void AImgSetMaxSimdLevel(int32_t level)
+{
+    AImg::maxSimdLevel = std::min(std::max(level, (int32_t)AImgSimdLevel::AIMG_SIMD_NONE), (int32_t)AImgSimdLevel::AIMG_SIMD_AVX2);
+}
+
+int32_t AImgGetSimdLevel()
+{
+    return AImg::currentSimdLevel();
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_FORMAT_CONVERSION_H
+#define ARTOMATIX_FORMAT_CONVERSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace AImg
+{
+    // Converts count packed pixels from one AImgFormat to another, giving exactly what going through RGBA32F would (see
+    // AImgConvertFormat). src and dest must not overlap.
+    typedef void (*ConvertPixelsFunc)(const void* src, void* dest, size_t count);
+
+    // The kernel for a pair of formats, looked up in a table that's built once. NULL if either format isn't one we know.
+    ConvertPixelsFunc getConvertPixelsFunc(int32_t inFormat, int32_t outFormat);
+
+    // The widest AImgSimdLevel this CPU (and OS) supports
+    int32_t detectSimdLevel();
+
+    // The vectorised kernel for a pair of formats that uses exactly level's instructions, or NULL if there isn't one. The
+    // table falls back to lower levels' kernels, then to the scalar ones, which are the reference these must match bit for bit.
+    ConvertPixelsFunc getSimdConvertPixelsFunc(int32_t level, int32_t inFormat, int32_t outFormat);
+}
+
+#endif // ARTOMATIX_FORMAT_CONVERSION_H
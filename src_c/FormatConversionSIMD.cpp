@@ -0,0 +1,527 @@
+#include "FormatConversion.h"
+#include "AIL.h"
+#include "Half.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AIL_X86_SIMD 1
+#endif
+
+#ifdef AIL_X86_SIMD
+
+#include <algorithm>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AIL_TARGET(isa)
+#else
+#include <cpuid.h>
+#define AIL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace AImg
+{
+    namespace
+    {
+        void cpuid(int32_t leaf, int32_t subleaf, uint32_t regs[4])
+        {
+#ifdef _MSC_VER
+            int r[4];
+            __cpuidex(r, leaf, subleaf);
+            for (int i = 0; i < 4; i++)
+                regs[i] = (uint32_t)r[i];
+#else
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        }
+
+        // Which of the AVX register state the OS saves on context switches
+        uint64_t osSavedState()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            uint32_t lo, hi;
+            __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            return ((uint64_t)hi << 32) | lo;
+#endif
+        }
+
+        // The tails of each loop, and the bodies of the ones we don't vectorise, do exactly what the scalar kernels do
+        inline float unorm8ToFloat(uint8_t v) { return ((float)v) / 255.0f; }
+        inline float unorm16ToFloat(uint16_t v) { return ((float)v) / 65535.0f; }
+        inline float clamp01(float v) { return std::min(1.0f, std::max(0.0f, v)); }
+        inline uint8_t floatToUnorm8(float v) { return (uint8_t)(clamp01(v) * 255.0f); }
+        inline uint16_t floatToUnorm16(float v) { return (uint16_t)(clamp01(v) * 65535.0f); }
+
+        // Clamps to 0-1 as clamp01 does: maxps returns its second operand when either is NaN, so NaN becomes 0
+        #define AIL_CLAMP01_PS(v) _mm_min_ps(_mm_max_ps((v), _mm_setzero_ps()), _mm_set1_ps(1.0f))
+        #define AIL_CLAMP01_PS256(v) _mm256_min_ps(_mm256_max_ps((v), _mm256_setzero_ps()), _mm256_set1_ps(1.0f))
+
+        ///////////////////
+        // SSE2 kernels  //
+        ///////////////////
+
+        // Element-wise kernels work on count * Channels values, as the channel count doesn't change
+
+        template <int Channels>
+        AIL_TARGET("sse2") void unorm8ToFloatSSE2(const void* src, void* dest, size_t count)
+        {
+            const uint8_t* s = (const uint8_t*)src;
+            float* d = (float*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m128i zero = _mm_setzero_si128();
+            const __m128 scale = _mm_set1_ps(255.0f);
+
+            for (; i + 16 <= n; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+                _mm_storeu_ps(d + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+                _mm_storeu_ps(d + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+                _mm_storeu_ps(d + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+                _mm_storeu_ps(d + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+            }
+
+            for (; i < n; i++)
+                d[i] = unorm8ToFloat(s[i]);
+        }
+
+        template <int Channels>
+        AIL_TARGET("sse2") void unorm16ToFloatSSE2(const void* src, void* dest, size_t count)
+        {
+            const uint16_t* s = (const uint16_t*)src;
+            float* d = (float*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m128i zero = _mm_setzero_si128();
+            const __m128 scale = _mm_set1_ps(65535.0f);
+
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+
+                _mm_storeu_ps(d + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+                _mm_storeu_ps(d + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+            }
+
+            for (; i < n; i++)
+                d[i] = unorm16ToFloat(s[i]);
+        }
+
+        // Like the scalar kernels these truncate, so eg 0.999 * 255 gives 254
+        template <int Channels>
+        AIL_TARGET("sse2") void floatToUnorm8SSE2(const void* src, void* dest, size_t count)
+        {
+            const float* s = (const float*)src;
+            uint8_t* d = (uint8_t*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m128 scale = _mm_set1_ps(255.0f);
+
+            for (; i + 16 <= n; i += 16)
+            {
+                __m128i a = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i)), scale));
+                __m128i b = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i + 4)), scale));
+                __m128i c = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i + 8)), scale));
+                __m128i e = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i + 12)), scale));
+
+                _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, e)));
+            }
+
+            for (; i < n; i++)
+                d[i] = floatToUnorm8(s[i]);
+        }
+
+        template <int Channels>
+        AIL_TARGET("sse2") void floatToUnorm16SSE2(const void* src, void* dest, size_t count)
+        {
+            const float* s = (const float*)src;
+            uint16_t* d = (uint16_t*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m128 scale = _mm_set1_ps(65535.0f);
+            // There's no unsigned saturating 32 -> 16 bit pack before SSE4.1, so shift into signed range and back
+            const __m128i bias32 = _mm_set1_epi32(32768);
+            const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i a = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i)), scale));
+                __m128i b = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i + 4)), scale));
+
+                __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32));
+                _mm_storeu_si128((__m128i*)(d + i), _mm_xor_si128(packed, bias16));
+            }
+
+            for (; i < n; i++)
+                d[i] = floatToUnorm16(s[i]);
+        }
+
+        // R8U -> RGBA8U, copying grey to RGB with an opaque alpha
+        AIL_TARGET("sse2") void greyToRGBA8SSE2(const void* src, void* dest, size_t count)
+        {
+            const uint8_t* s = (const uint8_t*)src;
+            uint8_t* d = (uint8_t*)dest;
+            size_t i = 0;
+
+            const __m128i opaque = _mm_set1_epi8((char)0xff);
+
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+                __m128i rgLo = _mm_unpacklo_epi8(v, v);
+                __m128i rgHi = _mm_unpackhi_epi8(v, v);
+                __m128i baLo = _mm_unpacklo_epi8(v, opaque);
+                __m128i baHi = _mm_unpackhi_epi8(v, opaque);
+
+                _mm_storeu_si128((__m128i*)(d + i * 4), _mm_unpacklo_epi16(rgLo, baLo));
+                _mm_storeu_si128((__m128i*)(d + i * 4 + 16), _mm_unpackhi_epi16(rgLo, baLo));
+                _mm_storeu_si128((__m128i*)(d + i * 4 + 32), _mm_unpacklo_epi16(rgHi, baHi));
+                _mm_storeu_si128((__m128i*)(d + i * 4 + 48), _mm_unpackhi_epi16(rgHi, baHi));
+            }
+
+            for (; i < count; i++)
+            {
+                d[i * 4 + 0] = d[i * 4 + 1] = d[i * 4 + 2] = s[i];
+                d[i * 4 + 3] = 255;
+            }
+        }
+
+        ////////////////////
+        // SSE4.1 kernels //
+        ////////////////////
+
+        // These also use SSSE3's pshufb, which every SSE4.1 CPU has
+
+        template <int Channels>
+        AIL_TARGET("sse4.1") void unorm16ToFloatSSE41(const void* src, void* dest, size_t count)
+        {
+            const uint16_t* s = (const uint16_t*)src;
+            float* d = (float*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m128 scale = _mm_set1_ps(65535.0f);
+
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+
+                _mm_storeu_ps(d + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(v)), scale));
+                _mm_storeu_ps(d + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8))), scale));
+            }
+
+            for (; i < n; i++)
+                d[i] = unorm16ToFloat(s[i]);
+        }
+
+        template <int Channels>
+        AIL_TARGET("sse4.1") void floatToUnorm16SSE41(const void* src, void* dest, size_t count)
+        {
+            const float* s = (const float*)src;
+            uint16_t* d = (uint16_t*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m128 scale = _mm_set1_ps(65535.0f);
+
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i a = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i)), scale));
+                __m128i b = _mm_cvttps_epi32(_mm_mul_ps(AIL_CLAMP01_PS(_mm_loadu_ps(s + i + 4)), scale));
+
+                _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi32(a, b));
+            }
+
+            for (; i < n; i++)
+                d[i] = floatToUnorm16(s[i]);
+        }
+
+        // RGB8U -> RGBA8U. Each step loads 16 bytes for 4 pixels, so stops while there are still 6 pixels left to stay inside src.
+        AIL_TARGET("sse4.1") void rgbToRGBA8SSE41(const void* src, void* dest, size_t count)
+        {
+            const uint8_t* s = (const uint8_t*)src;
+            uint8_t* d = (uint8_t*)dest;
+            size_t i = 0;
+
+            const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+
+            for (; i + 6 <= count; i += 4)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s + i * 3));
+                _mm_storeu_si128((__m128i*)(d + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), opaque));
+            }
+
+            for (; i < count; i++)
+            {
+                d[i * 4 + 0] = s[i * 3 + 0];
+                d[i * 4 + 1] = s[i * 3 + 1];
+                d[i * 4 + 2] = s[i * 3 + 2];
+                d[i * 4 + 3] = 255;
+            }
+        }
+
+        // RGBA8U -> RGB8U. Each step stores 16 bytes for 4 pixels, the last 4 of which the next step overwrites, so this stops
+        // while there are still 6 pixels left to stay inside dest.
+        AIL_TARGET("sse4.1") void rgbaToRGB8SSE41(const void* src, void* dest, size_t count)
+        {
+            const uint8_t* s = (const uint8_t*)src;
+            uint8_t* d = (uint8_t*)dest;
+            size_t i = 0;
+
+            const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+            for (; i + 6 <= count; i += 4)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s + i * 4));
+                _mm_storeu_si128((__m128i*)(d + i * 3), _mm_shuffle_epi8(v, shuffle));
+            }
+
+            for (; i < count; i++)
+            {
+                d[i * 3 + 0] = s[i * 4 + 0];
+                d[i * 3 + 1] = s[i * 4 + 1];
+                d[i * 3 + 2] = s[i * 4 + 2];
+            }
+        }
+
+        //////////////////
+        // AVX2 kernels //
+        //////////////////
+
+        template <int Channels>
+        AIL_TARGET("avx2") void unorm8ToFloatAVX2(const void* src, void* dest, size_t count)
+        {
+            const uint8_t* s = (const uint8_t*)src;
+            float* d = (float*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m256 scale = _mm256_set1_ps(255.0f);
+
+            for (; i + 16 <= n; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+
+                _mm256_storeu_ps(d + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), scale));
+                _mm256_storeu_ps(d + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+            }
+
+            for (; i < n; i++)
+                d[i] = unorm8ToFloat(s[i]);
+        }
+
+        template <int Channels>
+        AIL_TARGET("avx2") void unorm16ToFloatAVX2(const void* src, void* dest, size_t count)
+        {
+            const uint16_t* s = (const uint16_t*)src;
+            float* d = (float*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m256 scale = _mm256_set1_ps(65535.0f);
+
+            for (; i + 16 <= n; i += 16)
+            {
+                __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+
+                _mm256_storeu_ps(d + i, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v))), scale));
+                _mm256_storeu_ps(d + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1))), scale));
+            }
+
+            for (; i < n; i++)
+                d[i] = unorm16ToFloat(s[i]);
+        }
+
+        template <int Channels>
+        AIL_TARGET("avx2") void floatToUnorm8AVX2(const void* src, void* dest, size_t count)
+        {
+            const float* s = (const float*)src;
+            uint8_t* d = (uint8_t*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m256 scale = _mm256_set1_ps(255.0f);
+
+            for (; i + 16 <= n; i += 16)
+            {
+                __m256i a = _mm256_cvttps_epi32(_mm256_mul_ps(AIL_CLAMP01_PS256(_mm256_loadu_ps(s + i)), scale));
+                __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(AIL_CLAMP01_PS256(_mm256_loadu_ps(s + i + 8)), scale));
+
+                // The packs work within each 128 bit lane, so put the 64 bit blocks back in order before the last one
+                __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+                _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1)));
+            }
+
+            for (; i < n; i++)
+                d[i] = floatToUnorm8(s[i]);
+        }
+
+        template <int Channels>
+        AIL_TARGET("avx2") void floatToUnorm16AVX2(const void* src, void* dest, size_t count)
+        {
+            const float* s = (const float*)src;
+            uint16_t* d = (uint16_t*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            const __m256 scale = _mm256_set1_ps(65535.0f);
+
+            for (; i + 16 <= n; i += 16)
+            {
+                __m256i a = _mm256_cvttps_epi32(_mm256_mul_ps(AIL_CLAMP01_PS256(_mm256_loadu_ps(s + i)), scale));
+                __m256i b = _mm256_cvttps_epi32(_mm256_mul_ps(AIL_CLAMP01_PS256(_mm256_loadu_ps(s + i + 8)), scale));
+
+                _mm256_storeu_si256((__m256i*)(d + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8));
+            }
+
+            for (; i < n; i++)
+                d[i] = floatToUnorm16(s[i]);
+        }
+
+        // Every AVX2 CPU has F16C too, so the AVX2 level requires both. Like halfToFloat and floatToHalf, these round to
+        // nearest even and quieten NaNs.
+        template <int Channels>
+        AIL_TARGET("avx2,f16c") void halfToFloatF16C(const void* src, void* dest, size_t count)
+        {
+            const uint16_t* s = (const uint16_t*)src;
+            float* d = (float*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(d + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(s + i))));
+
+            for (; i < n; i++)
+                d[i] = halfToFloat(s[i]);
+        }
+
+        template <int Channels>
+        AIL_TARGET("avx2,f16c") void floatToHalfF16C(const void* src, void* dest, size_t count)
+        {
+            const float* s = (const float*)src;
+            uint16_t* d = (uint16_t*)dest;
+            size_t n = count * Channels;
+            size_t i = 0;
+
+            for (; i + 8 <= n; i += 8)
+                _mm_storeu_si128((__m128i*)(d + i), _mm256_cvtps_ph(_mm256_loadu_ps(s + i), _MM_FROUND_TO_NEAREST_INT));
+
+            for (; i < n; i++)
+                d[i] = floatToHalf(s[i]);
+        }
+    }
+
+    // Picks the instantiation of one of the kernels above for numChannels (1-4)
+    #define AIL_BY_CHANNELS(kernel, numChannels) \
+        ((numChannels) == 1 ? &kernel<1> : (numChannels) == 2 ? &kernel<2> : (numChannels) == 3 ? &kernel<3> : &kernel<4>)
+
+    int32_t detectSimdLevel()
+    {
+        uint32_t regs[4];
+        cpuid(0, 0, regs);
+        uint32_t maxLeaf = regs[0];
+
+        cpuid(1, 0, regs);
+        bool sse2 = (regs[3] & (1u << 26)) != 0;
+        bool ssse3 = (regs[2] & (1u << 9)) != 0;
+        bool sse41 = (regs[2] & (1u << 19)) != 0;
+        bool osxsave = (regs[2] & (1u << 27)) != 0;
+        bool avx = (regs[2] & (1u << 28)) != 0;
+        bool f16c = (regs[2] & (1u << 29)) != 0;
+
+        if (!sse2)
+            return AImgSimdLevel::AIMG_SIMD_NONE;
+        if (!ssse3 || !sse41)
+            return AImgSimdLevel::AIMG_SIMD_SSE2;
+
+        // AVX2 also needs the OS to save the YMM registers, and F16C for the half float kernels
+        bool avx2 = false;
+        if (maxLeaf >= 7 && avx && f16c && osxsave && (osSavedState() & 0x6) == 0x6)
+        {
+            cpuid(7, 0, regs);
+            avx2 = (regs[1] & (1u << 5)) != 0;
+        }
+
+        return avx2 ? AImgSimdLevel::AIMG_SIMD_AVX2 : AImgSimdLevel::AIMG_SIMD_SSE41;
+    }
+
+    ConvertPixelsFunc getSimdConvertPixelsFunc(int32_t level, int32_t inFormat, int32_t outFormat)
+    {
+        int32_t inChannels, inBytes, inFloatOrInt;
+        AIGetFormatDetails(inFormat, &inChannels, &inBytes, &inFloatOrInt);
+        int32_t outChannels, outBytes, outFloatOrInt;
+        AIGetFormatDetails(outFormat, &outChannels, &outBytes, &outFloatOrInt);
+
+        bool inIsInt = inFloatOrInt == AImgFloatOrIntType::FITYPE_INT;
+        bool outIsInt = outFloatOrInt == AImgFloatOrIntType::FITYPE_INT;
+
+        if (inChannels == outChannels)
+        {
+            bool inIsHalf = inBytes == 2 && !inIsInt;
+            bool outIsHalf = outBytes == 2 && !outIsInt;
+
+            if (level == AImgSimdLevel::AIMG_SIMD_AVX2 && inIsHalf && outBytes == 4)
+                return AIL_BY_CHANNELS(halfToFloatF16C, inChannels);
+            if (level == AImgSimdLevel::AIMG_SIMD_AVX2 && inBytes == 4 && outIsHalf)
+                return AIL_BY_CHANNELS(floatToHalfF16C, inChannels);
+
+            if (inIsInt && outBytes == 4)
+            {
+                if (level == AImgSimdLevel::AIMG_SIMD_SSE2)
+                    return inBytes == 1 ? AIL_BY_CHANNELS(unorm8ToFloatSSE2, inChannels) : AIL_BY_CHANNELS(unorm16ToFloatSSE2, inChannels);
+                if (level == AImgSimdLevel::AIMG_SIMD_SSE41 && inBytes == 2)
+                    return AIL_BY_CHANNELS(unorm16ToFloatSSE41, inChannels);
+                if (level == AImgSimdLevel::AIMG_SIMD_AVX2)
+                    return inBytes == 1 ? AIL_BY_CHANNELS(unorm8ToFloatAVX2, inChannels) : AIL_BY_CHANNELS(unorm16ToFloatAVX2, inChannels);
+            }
+
+            if (inBytes == 4 && outIsInt)
+            {
+                if (level == AImgSimdLevel::AIMG_SIMD_SSE2)
+                    return outBytes == 1 ? AIL_BY_CHANNELS(floatToUnorm8SSE2, inChannels) : AIL_BY_CHANNELS(floatToUnorm16SSE2, inChannels);
+                if (level == AImgSimdLevel::AIMG_SIMD_SSE41 && outBytes == 2)
+                    return AIL_BY_CHANNELS(floatToUnorm16SSE41, inChannels);
+                if (level == AImgSimdLevel::AIMG_SIMD_AVX2)
+                    return outBytes == 1 ? AIL_BY_CHANNELS(floatToUnorm8AVX2, inChannels) : AIL_BY_CHANNELS(floatToUnorm16AVX2, inChannels);
+            }
+
+            return NULL;
+        }
+
+        if (level == AImgSimdLevel::AIMG_SIMD_SSE2 && inFormat == AImgFormat::R8U && outFormat == AImgFormat::RGBA8U)
+            return &greyToRGBA8SSE2;
+        if (level == AImgSimdLevel::AIMG_SIMD_SSE41 && inFormat == AImgFormat::RGB8U && outFormat == AImgFormat::RGBA8U)
+            return &rgbToRGBA8SSE41;
+        if (level == AImgSimdLevel::AIMG_SIMD_SSE41 && inFormat == AImgFormat::RGBA8U && outFormat == AImgFormat::RGB8U)
+            return &rgbaToRGB8SSE41;
+
+        return NULL;
+    }
+}
+
+#else // AIL_X86_SIMD
+
+namespace AImg
+{
+    int32_t detectSimdLevel()
+    {
+        return AImgSimdLevel::AIMG_SIMD_NONE;
+    }
+
+    ConvertPixelsFunc getSimdConvertPixelsFunc(int32_t /*level*/, int32_t /*inFormat*/, int32_t /*outFormat*/)
+    {
+        return NULL;
+    }
+}
+
+#endif // AIL_X86_SIMD
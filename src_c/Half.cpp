@@ -0,0 +1,66 @@
+#include "Half.h"
+
+#include <algorithm>
+
+namespace AImg
+{
+    HalfTables::HalfTables()
+    {
+        // subnormals are normalised into a float exponent
+        mantissa[0] = 0;
+        for (uint32_t i = 1; i < 1024; i++)
+        {
+            uint32_t m = i << 13;
+            uint32_t e = 0;
+            while ((m & 0x00800000) == 0)
+            {
+                e -= 0x00800000;
+                m <<= 1;
+            }
+
+            mantissa[i] = (m & ~0x00800000u) | (e + 0x38800000);
+        }
+
+        // normals just need the exponent rebiased, which is split between here and exponent[]
+        for (uint32_t i = 1024; i < 2048; i++)
+            mantissa[i] = 0x38000000 + ((i - 1024) << 13);
+
+        // infinity and NaN, with NaNs quietened
+        mantissa[2048] = 0;
+        for (uint32_t i = 2049; i < 3072; i++)
+            mantissa[i] = 0x00400000 | ((i - 2048) << 13);
+
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            uint32_t e = i & 31;
+            uint32_t sign = i < 32 ? 0 : 0x80000000;
+
+            if (e == 0)
+            {
+                exponent[i] = sign;
+                offset[i] = 0;
+            }
+            else if (e == 31)
+            {
+                exponent[i] = sign | 0x7f800000;
+                offset[i] = 2048;
+            }
+            else
+            {
+                exponent[i] = sign + (e << 23);
+                offset[i] = 1024;
+            }
+        }
+
+        for (uint32_t i = 0; i < 65536; i++)
+        {
+            uint32_t bits = mantissa[offset[i >> 10] + (i & 0x3ff)] + exponent[i >> 10];
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+
+            toUnorm8[i] = (uint8_t)(std::min(1.0f, std::max(0.0f, f)) * 255.0f);
+        }
+    }
+
+    const HalfTables halfTables;
+}
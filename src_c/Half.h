@@ -0,0 +1,105 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_HALF_H
+#define ARTOMATIX_HALF_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace AImg
+{
+    // IEEE 754 half precision floats, so the 16 bit float formats can be converted without OpenEXR. Both directions give
+    // exactly what F16C's vcvtph2ps and vcvtps2ph (rounding to nearest even) do, which is also what OpenEXR's half does for
+    // everything but signalling NaNs, which these quiet.
+
+    struct HalfTables
+    {
+        // Half to float bits, indexed as mantissa[offset[h >> 10] + (h & 0x3ff)] + exponent[h >> 10]
+        uint32_t mantissa[3072];
+        uint32_t exponent[64];
+        uint16_t offset[64];
+
+        // Every half converted to 8U, clamping to 0-1 and truncating as AImgConvertFormat does
+        uint8_t toUnorm8[65536];
+
+        HalfTables();
+    };
+
+    extern const HalfTables halfTables;
+
+    inline float halfToFloat(uint16_t h)
+    {
+        uint32_t bits = halfTables.mantissa[halfTables.offset[h >> 10] + (h & 0x3ff)] + halfTables.exponent[h >> 10];
+
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    inline uint16_t floatToHalf(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t absBits = bits & 0x7fffffff;
+
+        // infinity, or NaN with the top of its payload kept and the quiet bit set
+        if (absBits >= 0x7f800000)
+            return (uint16_t)(sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 | ((absBits >> 13) & 0x3ff) : 0));
+
+        // rounds up past the largest half, 65504
+        if (absBits >= 0x477ff000)
+            return (uint16_t)(sign | 0x7c00);
+
+        uint32_t result;
+        uint32_t shift;
+        uint32_t mantissa;
+
+        if (absBits >= 0x38800000)
+        {
+            // normal: rebias the exponent, and drop 13 bits of mantissa
+            result = (absBits - 0x38000000) >> 13;
+            mantissa = absBits;
+            shift = 13;
+        }
+        else
+        {
+            // subnormal, or too small even for that
+            uint32_t exponent = absBits >> 23;
+            if (exponent < 102)
+                return (uint16_t)sign;
+
+            mantissa = (absBits & 0x7fffff) | 0x800000;
+            shift = 126 - exponent;
+            result = mantissa >> shift;
+        }
+
+        // round to nearest, ties to even. Carrying into the exponent gives the right answer too.
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (result & 1)))
+            result++;
+
+        return (uint16_t)(sign | result);
+    }
+}
+
+#endif // ARTOMATIX_HALF_H
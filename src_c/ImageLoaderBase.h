@@ -24,23 +24,133 @@
 
 #include "AIL.h"
 #include "IExifHandler.hpp"
+#include "InputStream.h"
+#include "OutputStream.h"
+#include "ScratchBuffer.h"
 #include <memory>
 
 namespace AImg
 {
+    // How many bytes are peeked from the start of a stream for format detection, enough for every signature we check
+    const size_t AIMG_DETECT_HEADER_SIZE = 32;
+
     class AImgBase
     {
     public:
         virtual ~AImgBase();
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData) = 0;
+        // Takes ownership of stream, which is kept alive until this object is destroyed, so decoders are free to hold on to it
+        int32_t open(InputStream* stream)
+        {
+            mInputStream.reset(stream);
+            return openImage(stream);
+        }
+
+        virtual int32_t openImage(InputStream* stream) = 0;
         virtual int32_t getImageInfo(int32_t* width, int32_t* height, int32_t* numChannels, int32_t* bytesPerChannel, int32_t* floatOrInt, int32_t* decodedImgFormat, uint32_t *colourProfileLen) = 0;
         virtual int32_t getColourProfile(char* profileName, uint8_t* colourProfile, uint32_t *colourProfileLen) = 0;
-        virtual int32_t decodeImage(void* destBuffer, int32_t forceImageFormat) = 0;
+        // Checks rowPitchBytes against the decoded row size (0 meaning tightly packed) and then decodes the whole image
+        int32_t decode(void* destBuffer, size_t rowPitchBytes, int32_t forceImageFormat);
+        // Same, for the width x height rectangle at (x, y), which is checked to be inside the image
+        int32_t decode(int32_t x, int32_t y, int32_t width, int32_t height, void* destBuffer, size_t rowPitchBytes, int32_t forceImageFormat);
+
+        // The region and rowPitchBytes have already been validated, and rowPitchBytes is never 0. It's negative when the rows
+        // are to be written bottom up, with destBuffer pointing at the last row. Decoding the whole image is just the region
+        // (0, 0, width, height).
+        virtual int32_t decodeRegion(int32_t x, int32_t y, int32_t width, int32_t height, void* destBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat) = 0;
+
+        // See AImgSetDecodeFlags
+        void setDecodeFlags(int32_t flags)
+        {
+            mDecodeFlags = flags;
+        }
+
+        // Incremental decoding (see AImgBeginDecode). These keep track of the next row, and check the calls come in order.
+        int32_t beginDecode(int32_t forceImageFormat);
+        int32_t readRows(void* destBuffer, size_t rowPitchBytes, int32_t rowCount);
+        int32_t endDecode();
+
+        // Codecs that can decode a few rows at a time, top to bottom, return true from canDecodeRows and override the three
+        // functions after it. Otherwise beginDecode decodes the whole image into a buffer, and readRows hands it out from there.
+        // canDecodeRows is only called after getImageInfo.
+        virtual bool canDecodeRows()
+        {
+            return false;
+        }
 
-        virtual int32_t writeImage(void* data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+        virtual int32_t startRowDecode(int32_t /*forceImageFormat*/)
+        {
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        // firstRow is always the row after the last call's, rowCount has already been checked against the rows left, and
+        // rowPitchBytes is never 0
+        virtual int32_t decodeRows(int32_t /*firstRow*/, int32_t /*rowCount*/, void* /*destBuffer*/, size_t /*rowPitchBytes*/, int32_t /*forceImageFormat*/)
+        {
+            mErrorDetails = "[AImg::AImgBase::decodeRows] not implemented for this format";
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+        }
+
+        // Called from endDecode, which may be before every row has been read
+        virtual void finishRowDecode() {}
+
+        // Checks the encoding options and source, then writes
+        int32_t write(const AImgWriteSource& source, int32_t width, int32_t height, int32_t outputFormat,
             const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData, void* encodingOptions) = 0;
+            OutputStream* stream, void* encodingOptions);
+
+        // Incremental writing (see AImgWriteBegin). writeBegin takes ownership of stream, which is flushed and destroyed by
+        // writeEnd. These keep track of the next row, and check the calls come in order.
+        int32_t writeBegin(int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+            const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+            OutputStream* stream, void* encodingOptions);
+        int32_t writeRows(const AImgWriteSource& source, int32_t rowCount);
+        // Packed, RGBA ordered rows in the inputFormat passed to writeBegin
+        int32_t writeRows(const void* data, int32_t rowCount);
+        int32_t writeEnd();
+
+        // Encoders that can write a few rows at a time, top to bottom, return true from canWriteRows and override the four
+        // functions after it, and write() goes through them too. Otherwise they override writeImage, and writeBegin collects
+        // the rows in a buffer to pass to it from writeEnd.
+        virtual bool canWriteRows()
+        {
+            return false;
+        }
+
+        // Cleans up after itself if it fails
+        virtual int32_t startWriteRows(int32_t /*width*/, int32_t /*height*/, int32_t /*inputFormat*/, int32_t /*outputFormat*/,
+            const char* /*profileName*/, uint8_t* /*colourProfile*/, uint32_t /*colourProfileLen*/,
+            OutputStream* /*stream*/, void* /*encodingOptions*/)
+        {
+            mErrorDetails = "[AImg::AImgBase::startWriteRows] not implemented for this format";
+            return AImgErrorCode::AIMG_WRITE_FAILED_INTERNAL;
+        }
+
+        // The next rowCount rows, with source's row 0 being the first of them. source has already been validated, has the
+        // inputFormat passed to startWriteRows, and has its pitches filled in (see normaliseWriteSource). Every band after the
+        // first has the same channel order as the first.
+        virtual int32_t writeRowBand(const AImgWriteSource& /*source*/, int32_t /*rowCount*/)
+        {
+            return AImgErrorCode::AIMG_WRITE_FAILED_INTERNAL;
+        }
+
+        // Called once every row has been written
+        virtual int32_t finishWriteRows()
+        {
+            return AImgErrorCode::AIMG_WRITE_FAILED_INTERNAL;
+        }
+
+        // Called instead of finishWriteRows after an error, or if not every row was written
+        virtual void abortWriteRows() {}
+
+        // source has already been validated, and has its pitches filled in (see normaliseWriteSource)
+        virtual int32_t writeImage(const AImgWriteSource& /*source*/, int32_t /*width*/, int32_t /*height*/, int32_t /*outputFormat*/,
+            const char* /*profileName*/, uint8_t* /*colourProfile*/, uint32_t /*colourProfileLen*/,
+            OutputStream* /*stream*/, void* /*encodingOptions*/)
+        {
+            mErrorDetails = "[AImg::AImgBase::writeImage] not implemented for this format";
+            return AImgErrorCode::AIMG_WRITE_FAILED_INTERNAL;
+        }
 
         const char* getErrorDetails()
         {
@@ -63,6 +173,36 @@ namespace AImg
 
     protected:
         std::string mErrorDetails;
+
+    private:
+        // Drops any writing in progress, without finishing the file
+        void cancelWrite();
+
+        std::unique_ptr<InputStream> mInputStream;
+
+        int32_t mDecodeFlags = AImgDecodeFlags::AIMG_DECODE_DEFAULT;
+
+        bool mRowDecodeActive = false;
+        int32_t mRowDecodeForceFormat = AImgFormat::INVALID_FORMAT;
+        int32_t mRowDecodeHeight = 0;
+        int32_t mNextRow = 0;
+        size_t mRowDecodeRowSize = 0;
+        // The whole decoded image, when the codec can't decode a few rows at a time
+        std::unique_ptr<ScratchBuffer> mBufferedRows;
+
+        bool mWriteActive = false;
+        int32_t mWriteWidth = 0;
+        int32_t mWriteHeight = 0;
+        int32_t mWriteInputFormat = AImgFormat::INVALID_FORMAT;
+        int32_t mWriteOutputFormat = AImgFormat::INVALID_FORMAT;
+        int32_t mRowsWritten = 0;
+        std::unique_ptr<OutputStream> mWriteStream;
+        // When the encoder can't write a few rows at a time, the rows so far, and copies of the profile to pass to writeImage
+        std::unique_ptr<ScratchBuffer> mBufferedWrite;
+        std::string mWriteProfileName;
+        Vector<uint8_t> mWriteColourProfile;
+        bool mHasWriteProfileName = false;
+        bool mHasWriteColourProfile = false;
     };
 
     class ImageLoaderBase
@@ -73,7 +213,13 @@ namespace AImg
         virtual AImgBase* getAImg() = 0;
 
         virtual int32_t initialise() = 0;
-        virtual bool canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData) = 0;
+        // header is the start of the file, zero padded up to headerSize (AIMG_DETECT_HEADER_SIZE) if the file is shorter.
+        // Should only check the format's signature, so detection never has to touch the stream.
+        virtual bool canLoadImage(const uint8_t* header, size_t headerSize) = 0;
+
+        // Parses just enough of the headers at the current stream position to fill in info, without creating an AImgBase.
+        // Must give the same answers as openImage + getImageInfo would. info->fileFormat is filled in by the caller.
+        virtual int32_t probeImage(InputStream* stream, AImgProbeInfo* info) = 0;
         virtual std::string getFileExtension() = 0;
         virtual int32_t getAImgFileFormatValue() = 0;
 
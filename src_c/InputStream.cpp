@@ -0,0 +1,305 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "InputStream.h"
+
+namespace AImg
+{
+    namespace
+    {
+        std::atomic<int32_t> readBufferSize(64 * 1024);
+    }
+
+    void InputStream::setReadBufferSize(int32_t size)
+    {
+        readBufferSize = std::max(size, 0);
+    }
+
+    InputStream::InputStream(const void* data, size_t size)
+    {
+        mMemory = (const uint8_t*)data;
+        mMemorySize = size;
+    }
+
+    InputStream::InputStream(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData)
+    {
+        mV1Callbacks.readCallback = readCallback;
+        mV1Callbacks.tellCallback = tellCallback;
+        mV1Callbacks.seekCallback = seekCallback;
+        mV1Callbacks.callbackData = callbackData;
+
+        wrapV1Callbacks(&mV1Callbacks, &mCallbacks);
+        initBuffer();
+    }
+
+    InputStream::InputStream(const AImgStreamCallbacks& callbacks)
+    {
+        mCallbacks = callbacks;
+        initBuffer();
+    }
+
+    InputStream::InputStream(const AImgStreamCallbacks& callbacks, uint8_t* buffer, int64_t bufferSize)
+    {
+        mCallbacks = callbacks;
+        mBuffer = buffer;
+        mBufferSize = bufferSize;
+        mBufferStart = mCallbacks.tellCallback(mCallbacks.callbackData);
+    }
+
+    void InputStream::initBuffer()
+    {
+        int32_t size = readBufferSize;
+        if (size == 0)
+            return;
+
+        mOwnedBuffer.resize(size);
+        mBuffer = mOwnedBuffer.data();
+        mBufferSize = size;
+        mBufferStart = mCallbacks.tellCallback(mCallbacks.callbackData);
+    }
+
+    InputStream::~InputStream()
+    {
+        if (mIsMappedFile)
+        {
+#ifdef WIN32
+            UnmapViewOfFile(mMemory);
+#else
+            munmap((void*)mMemory, mMemorySize);
+#endif
+        }
+    }
+
+    InputStream* InputStream::mapFile(const char* path, int32_t* error)
+    {
+        void* mapped = NULL;
+        size_t size = 0;
+
+#ifdef WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            *error = AImgErrorCode::AIMG_OPEN_FAILED_CANNOT_OPEN_FILE;
+            return NULL;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            *error = AImgErrorCode::AIMG_OPEN_FAILED_CANNOT_OPEN_FILE;
+            return NULL;
+        }
+
+        size = (size_t)fileSize.QuadPart;
+        if (size == 0)
+        {
+            CloseHandle(file);
+            *error = AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
+            return NULL;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+        {
+            mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps the mapping alive
+        }
+        CloseHandle(file);
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            *error = AImgErrorCode::AIMG_OPEN_FAILED_CANNOT_OPEN_FILE;
+            return NULL;
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            *error = AImgErrorCode::AIMG_OPEN_FAILED_CANNOT_OPEN_FILE;
+            return NULL;
+        }
+
+        size = (size_t)fileStat.st_size;
+        if (size == 0)
+        {
+            close(fd);
+            *error = AImgErrorCode::AIMG_OPEN_FAILED_EMPTY_INPUT;
+            return NULL;
+        }
+
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        // we're almost always about to decode the whole thing, so fault it all in up front rather than a page at a time
+        flags |= MAP_POPULATE;
+#endif
+        mapped = mmap(NULL, size, PROT_READ, flags, fd, 0);
+        close(fd); // the mapping holds its own reference to the file
+
+        if (mapped == MAP_FAILED)
+        {
+            mapped = NULL;
+        }
+        else
+        {
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+#endif
+
+        if (mapped == NULL)
+        {
+            *error = AImgErrorCode::AIMG_OPEN_FAILED_CANNOT_OPEN_FILE;
+            return NULL;
+        }
+
+        InputStream* stream = new InputStream();
+        stream->mMemory = (const uint8_t*)mapped;
+        stream->mMemorySize = size;
+        stream->mIsMappedFile = true;
+
+        *error = AImgErrorCode::AIMG_SUCCESS;
+        return stream;
+    }
+
+    int64_t InputStream::read(uint8_t* dest, int64_t count)
+    {
+        if (mMemory)
+        {
+            size_t toRead = std::min((size_t)std::max(count, (int64_t)0), mMemorySize - mMemoryPos);
+            memcpy(dest, mMemory + mMemoryPos, toRead);
+            mMemoryPos += toRead;
+
+            return (int64_t)toRead;
+        }
+
+        if (mBuffer)
+            return readBuffered(dest, count);
+
+        return mCallbacks.readCallback(mCallbacks.callbackData, dest, count);
+    }
+
+    int64_t InputStream::readBuffered(uint8_t* dest, int64_t count)
+    {
+        int64_t total = 0;
+
+        while (count > 0)
+        {
+            int64_t available = mBufferFill - mBufferPos;
+            if (available > 0)
+            {
+                int64_t toCopy = std::min(available, count);
+                memcpy(dest + total, mBuffer + mBufferPos, (size_t)toCopy);
+
+                mBufferPos += toCopy;
+                total += toCopy;
+                count -= toCopy;
+                continue;
+            }
+
+            // Buffer is used up, so the callbacks are sitting exactly where we are
+            mBufferStart += mBufferFill;
+            mBufferFill = 0;
+            mBufferPos = 0;
+
+            // Big reads go straight into dest, no point copying them twice
+            if (count >= mBufferSize)
+            {
+                int64_t bytesRead = mCallbacks.readCallback(mCallbacks.callbackData, dest + total, count);
+                if (bytesRead <= 0)
+                    break;
+
+                mBufferStart += bytesRead;
+                total += bytesRead;
+                count -= bytesRead;
+                continue;
+            }
+
+            mBufferFill = mCallbacks.readCallback(mCallbacks.callbackData, mBuffer, mBufferSize);
+            if (mBufferFill <= 0)
+            {
+                mBufferFill = 0;
+                break;
+            }
+        }
+
+        return total;
+    }
+
+    int64_t InputStream::tell()
+    {
+        if (mMemory)
+            return (int64_t)mMemoryPos;
+
+        if (mBuffer)
+            return mBufferStart + mBufferPos;
+
+        return mCallbacks.tellCallback(mCallbacks.callbackData);
+    }
+
+    void InputStream::seek(int64_t pos)
+    {
+        if (mMemory)
+        {
+            mMemoryPos = std::min((size_t)std::max(pos, (int64_t)0), mMemorySize);
+            return;
+        }
+
+        if (mBuffer)
+        {
+            if (pos >= mBufferStart && pos <= mBufferStart + mBufferFill)
+            {
+                mBufferPos = pos - mBufferStart;
+                return;
+            }
+
+            mCallbacks.seekCallback(mCallbacks.callbackData, pos);
+
+            mBufferStart = pos;
+            mBufferFill = 0;
+            mBufferPos = 0;
+            return;
+        }
+
+        mCallbacks.seekCallback(mCallbacks.callbackData, pos);
+    }
+
+    int64_t InputStream::size()
+    {
+        if (mMemory)
+            return (int64_t)mMemorySize;
+
+        if (mCallbacks.sizeCallback)
+            return mCallbacks.sizeCallback(mCallbacks.callbackData);
+
+        return -1;
+    }
+
+    int64_t InputStream::peek(uint8_t* dest, int64_t count)
+    {
+        if (mMemory)
+        {
+            size_t toRead = std::min((size_t)std::max(count, (int64_t)0), mMemorySize - mMemoryPos);
+            memcpy(dest, mMemory + mMemoryPos, toRead);
+
+            return (int64_t)toRead;
+        }
+
+        int64_t startPos = tell();
+        int64_t bytesRead = read(dest, count);
+        seek(startPos);
+
+        return bytesRead;
+    }
+}
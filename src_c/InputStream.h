@@ -0,0 +1,100 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_INPUT_STREAM_H
+#define ARTOMATIX_INPUT_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "AIL.h"
+#include "AIL_internal.h"
+
+namespace AImg
+{
+    // The source every decoder reads from. It is either backed by a block of memory the caller owns (AImgOpenMemory),
+    // a memory mapped file (AImgOpenFile), or by the user supplied read/tell/seek callbacks (AImgOpen/AImgOpenStream).
+    // Old style 32 bit callbacks are wrapped up as AImgStreamCallbacks, so everything below this works in 64 bit offsets.
+    // Decoders should check getMemory() first, and if it is non-NULL hand the pointer straight to their library's
+    // native memory source instead of pulling the bytes through read().
+    // Callback streams read ahead into a buffer, so the many small reads the codec libraries make (png chunk headers, tiff
+    // directory entries, stb's byte-at-a-time parsing) only reach the user callbacks once per buffer. tell() and seeks
+    // that land inside the buffer are answered without calling back at all.
+    class InputStream
+    {
+    public:
+        InputStream(const void* data, size_t size);
+        InputStream(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData);
+        InputStream(const AImgStreamCallbacks& callbacks);
+        // Reads ahead into a buffer the caller owns, rather than allocating one
+        InputStream(const AImgStreamCallbacks& callbacks, uint8_t* buffer, int64_t bufferSize);
+        ~InputStream();
+
+        InputStream(const InputStream&) = delete;
+        InputStream& operator=(const InputStream&) = delete;
+
+        // Memory maps the file at path, and returns a memory backed stream over it which unmaps the file when destroyed.
+        // Returns NULL and sets error to one of AImgErrorCode if the file can't be opened or is empty.
+        static InputStream* mapFile(const char* path, int32_t* error);
+
+        // Read-ahead buffer size used by callback streams created after this call, see AImgSetReadBufferSize
+        static void setReadBufferSize(int32_t size);
+
+        int64_t read(uint8_t* dest, int64_t count);
+        int64_t tell();
+        void seek(int64_t pos);
+
+        // Total length of the stream, or -1 if the callbacks can't tell us
+        int64_t size();
+
+        // reads up to count bytes, then seeks back to where we started
+        int64_t peek(uint8_t* dest, int64_t count);
+
+        // NULL unless this stream is backed by memory.
+        // Note this is the start of the whole buffer, use tell() to find where the current image data begins.
+        const uint8_t* getMemory() const { return mMemory; }
+        size_t getMemorySize() const { return mMemorySize; }
+
+    private:
+        InputStream() {}
+
+        void initBuffer();
+        int64_t readBuffered(uint8_t* dest, int64_t count);
+
+        const uint8_t* mMemory = NULL;
+        size_t mMemorySize = 0;
+        size_t mMemoryPos = 0;
+        bool mIsMappedFile = false;
+
+        AImgStreamCallbacks mCallbacks = {};
+        CallbackData mV1Callbacks = {}; // only used when we were given 32 bit callbacks, mCallbacks points at this
+
+        // mBuffer holds mBufferFill bytes read from the callbacks, starting at stream position mBufferStart.
+        // The callbacks' own position is always mBufferStart + mBufferFill, and ours is mBufferStart + mBufferPos.
+        uint8_t* mBuffer = NULL;
+        int64_t mBufferSize = 0;
+        Vector<uint8_t> mOwnedBuffer;
+        int64_t mBufferStart = 0;
+        int64_t mBufferFill = 0;
+        int64_t mBufferPos = 0;
+    };
+}
+
+#endif // ARTOMATIX_INPUT_STREAM_H
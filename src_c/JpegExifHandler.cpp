@@ -18,99 +18,73 @@ namespace AImg
 
             return 0;
         }
-        // Adding 6 to this ptr as the EXIF magic is 6 bytes long
-        const uint8_t * tiffHeader = marker->data + 6;
 
-        const auto intelSig = "II";
-        auto littleEndian = memcmp(tiffHeader, intelSig, 2) == 0;
+        return ParseOrientationField(marker->data, marker->data_length, error);
+    }
 
+    uint16_t JpegExifHandler::ParseOrientationField(const uint8_t * exifData, size_t exifDataLength, int16_t * error) noexcept
+    {
         const uint16_t orientationTagId = 0x112;
+        const size_t exifMagicLength = 6;
+        const size_t tagSize = 12;
 
-        uint32_t offset = *((uint32_t*)(tiffHeader + 4));
-
-        if (!littleEndian)
+        if (error != nullptr)
         {
-            offset = SwapBytes32(offset);
+            *error = AIMG_EXIF_DATA_NOT_FOUND;
         }
 
-        const uint8_t * IFD0 = tiffHeader + offset;
-
-        uint16_t tagCount = *((uint16_t*)IFD0);
-
-        if (!littleEndian)
-        {
-            tagCount = SwapBytes16(tagCount);
-        }
+        // Need at least the magic and the 8 byte tiff header
+        if (exifDataLength < exifMagicLength + 8 || memcmp(exifData, "Exif\0\0", exifMagicLength) != 0)
+            return 0;
 
-        TiffTag_t * tags = (TiffTag_t *)(IFD0 + sizeof(uint16_t));
+        // Adding 6 to this ptr as the EXIF magic is 6 bytes long
+        const uint8_t * tiffHeader = exifData + exifMagicLength;
+        size_t tiffLength = exifDataLength - exifMagicLength;
 
-        TiffTag_t orientationTag;
-        bool found = false;
+        const auto intelSig = "II";
+        auto littleEndian = memcmp(tiffHeader, intelSig, 2) == 0;
 
-        for (int tagIndex = 0; tagIndex < tagCount; tagIndex++)
-        {
-            TiffTag_t currentTag = tags[tagIndex];
+        uint32_t offset = readUInt32(tiffHeader + 4, littleEndian);
+        if ((size_t)offset + sizeof(uint16_t) > tiffLength)
+            return 0;
 
-            if (!littleEndian)
-            {
-                currentTag = this->SwapTiffTagBytes(currentTag);
-            }
+        const uint8_t * IFD0 = tiffHeader + offset;
+        uint16_t tagCount = readUInt16(IFD0, littleEndian);
 
-            if (currentTag.Id == orientationTagId)
-            {
-                orientationTag = currentTag;
-                found = true;
-                break;
-            }
-        }
+        const uint8_t * tags = IFD0 + sizeof(uint16_t);
+        size_t tagsAvailable = (tiffLength - offset - sizeof(uint16_t)) / tagSize;
 
-        if (found)
+        for (size_t tagIndex = 0; tagIndex < tagCount && tagIndex < tagsAvailable; tagIndex++)
         {
-            uint16_t orientation = littleEndian
-                ? orientationTag.Offset.Partial.Hi
-                : orientationTag.Offset.Partial.Lo;
+            const uint8_t * tag = tags + tagIndex * tagSize;
 
-            if (orientation <= 8)
+            if (readUInt16(tag, littleEndian) == orientationTagId)
             {
-                if (error != nullptr)
-                {
-                    *error = AIMG_SUCCESS;
-                }
+                // SHORT values are stored left-justified in the 4 byte value field
+                uint16_t orientation = readUInt16(tag + 8, littleEndian);
 
-                return orientation;
-            }
-            else
-            {
-                if (error != nullptr)
+                if (orientation <= 8)
                 {
-                    *error = AIMG_EXIF_INVALID_DATA;
+                    if (error != nullptr)
+                    {
+                        *error = AIMG_SUCCESS;
+                    }
+
+                    return orientation;
                 }
+                else
+                {
+                    if (error != nullptr)
+                    {
+                        *error = AIMG_EXIF_INVALID_DATA;
+                    }
 
-                return 0;
-            }
-        }
-        else
-        {
-            if (error != nullptr)
-            {
-                *error = AIMG_EXIF_DATA_NOT_FOUND;
+                    return 0;
+                }
             }
-
-            return 0;
         }
-    }
-
-    TiffTag_t JpegExifHandler::SwapTiffTagBytes(TiffTag_t tag)
-    {
-        tag.Id = SwapBytes16(tag.Id);
-
-        tag.Type = SwapBytes16(tag.Type);
-
-        tag.Count = SwapBytes32(tag.Count);
-
-        tag.Offset.Full = SwapBytes32(tag.Offset.Full);
 
-        return tag;
+        return 0;
     }
 
     // Returns APP1 marker if found, nullptr otherwise
@@ -9,26 +9,6 @@
 
 namespace AImg
 {
-    // See https://www.exif.org/Exif2-2.PDF page 13
-    typedef struct
-    {
-        uint16_t Id;
-        uint16_t Type;
-        uint32_t Count;
-        union
-        {
-            uint32_t Full;
-
-#pragma pack(push, r1, 2)
-            struct
-            {
-                uint16_t Hi;
-                uint16_t Lo;
-            } Partial;
-#pragma pack( pop, r1 )
-        } Offset;
-    } TiffTag_t;
-
     class JpegExifHandler : public virtual IExifHandler
     {
     private:
@@ -36,7 +16,6 @@ namespace AImg
         j_decompress_ptr cinfo;
 
         jpeg_saved_marker_ptr GetEXIFSegment() const noexcept;
-        static TiffTag_t SwapTiffTagBytes(TiffTag_t tag);
 
     public:
 
@@ -44,6 +23,10 @@ namespace AImg
         JpegExifHandler(j_decompress_ptr cinfo) : cinfo(cinfo) {}
 
         virtual uint16_t GetOrientationField(int16_t * error = nullptr) const noexcept override;
+
+        // Parses the orientation out of an APP1 segment's payload (starting with the "Exif\0\0" magic), without needing a decompress struct.
+        // Shared with the JPEG probe, which reads the segment itself.
+        static uint16_t ParseOrientationField(const uint8_t * exifData, size_t exifDataLength, int16_t * error = nullptr) noexcept;
     };
 }
 #endif
\ No newline at end of file
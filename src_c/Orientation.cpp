@@ -0,0 +1,195 @@
+#include "Orientation.h"
+#include "AIL.h"
+#include "FormatConversion.h"
+#include "ScratchBuffer.h"
+
+#include <algorithm>
+#include <stddef.h>
+
+namespace AImg
+{
+    namespace
+    {
+        template <size_t Size> struct Pixel
+        {
+            uint8_t bytes[Size];
+        };
+
+        // Moves a rows x cols block of pixels, each colStep bytes on in dest from the one before it in its row, and each row
+        // rowStep bytes on from the row before it
+        typedef void (*MoveBlockFunc)(const uint8_t* src, size_t srcRowPitch, int32_t rows, int32_t cols, uint8_t* dest, ptrdiff_t colStep, ptrdiff_t rowStep);
+
+        template <size_t Size>
+        void moveBlock(const uint8_t* src, size_t srcRowPitch, int32_t rows, int32_t cols, uint8_t* dest, ptrdiff_t colStep, ptrdiff_t rowStep)
+        {
+            if (rowStep == (ptrdiff_t)Size || rowStep == -(ptrdiff_t)Size)
+            {
+                // Transposing: going down a source column writes along a dest row
+                for (int32_t x = 0; x < cols; x++)
+                {
+                    const uint8_t* srcPixel = src + x * Size;
+                    uint8_t* destPixel = dest + x * colStep;
+
+                    for (int32_t y = 0; y < rows; y++)
+                    {
+                        *(Pixel<Size>*)destPixel = *(const Pixel<Size>*)srcPixel;
+                        srcPixel += srcRowPitch;
+                        destPixel += rowStep;
+                    }
+                }
+
+                return;
+            }
+
+            for (int32_t y = 0; y < rows; y++)
+            {
+                const Pixel<Size>* srcPixel = (const Pixel<Size>*)(src + y * srcRowPitch);
+                uint8_t* destPixel = dest + y * rowStep;
+
+                for (int32_t x = 0; x < cols; x++)
+                {
+                    *(Pixel<Size>*)destPixel = srcPixel[x];
+                    destPixel += colStep;
+                }
+            }
+        }
+
+        MoveBlockFunc getMoveBlockFunc(size_t pixelSize)
+        {
+            switch (pixelSize)
+            {
+            case 1: return &moveBlock<1>;
+            case 2: return &moveBlock<2>;
+            case 3: return &moveBlock<3>;
+            case 4: return &moveBlock<4>;
+            case 6: return &moveBlock<6>;
+            case 8: return &moveBlock<8>;
+            case 12: return &moveBlock<12>;
+            case 16: return &moveBlock<16>;
+            default: return NULL;
+            }
+        }
+    }
+
+    int32_t convertOrientationRows(const void* srcRows, size_t srcRowPitch, void* dest, ptrdiff_t destRowPitch, int32_t width, int32_t height,
+        int32_t inFormat, int32_t outFormat, int32_t orientationFlag, int32_t firstRow, int32_t endRow)
+    {
+        ConvertPixelsFunc convert = getConvertPixelsFunc(inFormat, outFormat);
+        if (convert == NULL)
+            return AImgErrorCode::AIMG_CONVERSION_FAILED_BAD_FORMAT;
+
+        if (width <= 0 || height <= 0 || firstRow >= endRow)
+            return AImgErrorCode::AIMG_SUCCESS;
+
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        size_t inPixelSize = (size_t)numChannels * bytesPerChannel;
+        AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        size_t outPixelSize = (size_t)numChannels * bytesPerChannel;
+
+        MoveBlockFunc move = getMoveBlockFunc(outPixelSize);
+        bool sameFormat = inFormat == outFormat;
+
+        // Where source pixel (0, 0) goes in dest, and how many bytes on dest moves for each step along and down the source
+        bool swapsAxes = orientationFlag >= 5 && orientationFlag <= 8;
+        ptrdiff_t w = width, h = height;
+        ptrdiff_t p = (ptrdiff_t)outPixelSize, r = destRowPitch;
+        ptrdiff_t origin, colStep, rowStep;
+
+        switch (orientationFlag)
+        {
+        case 2: // flip horizontal
+            origin = (w - 1) * p; colStep = -p; rowStep = r;
+            break;
+        case 3: // rotate 180
+            origin = (w - 1) * p + (h - 1) * r; colStep = -p; rowStep = -r;
+            break;
+        case 4: // flip vertical
+            origin = (h - 1) * r; colStep = p; rowStep = -r;
+            break;
+        case 5: // transpose
+            origin = 0; colStep = r; rowStep = p;
+            break;
+        case 6: // rotate 270
+            origin = (h - 1) * p; colStep = r; rowStep = -p;
+            break;
+        case 7: // transverse
+            origin = (h - 1) * p + (w - 1) * r; colStep = -r; rowStep = -p;
+            break;
+        case 8: // rotate 90
+            origin = (w - 1) * r; colStep = -r; rowStep = p;
+            break;
+        default:
+            origin = 0; colStep = p; rowStep = r;
+            break;
+        }
+
+        uint8_t* destOrigin = (uint8_t*)dest + origin;
+
+        if (!swapsAxes)
+        {
+            // Source rows are still rows in dest, so this can go a whole row at a time. Rows that don't need reversing are just
+            // converted (or copied) straight across.
+            ScratchBuffer rowBuffer;
+            if (colStep < 0 && !sameFormat)
+                rowBuffer.resize((size_t)width * outPixelSize);
+
+            for (int32_t y = firstRow; y < endRow; y++)
+            {
+                const uint8_t* srcRow = (const uint8_t*)srcRows + (y - firstRow) * srcRowPitch;
+                uint8_t* destRow = destOrigin + y * rowStep;
+
+                if (colStep > 0)
+                {
+                    convert(srcRow, destRow, width);
+                }
+                else
+                {
+                    if (!sameFormat)
+                    {
+                        convert(srcRow, rowBuffer.data(), width);
+                        srcRow = rowBuffer.data();
+                    }
+
+                    move(srcRow, 0, 1, width, destRow, colStep, 0);
+                }
+            }
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        // Each tile's source rows and dest rows both stay in L1 while it's moved. Tiles are converted into tileBuffer first
+        // when the formats differ.
+        int32_t tileSize = outPixelSize <= 4 ? AIMG_ORIENT_TILE_ROWS : AIMG_ORIENT_TILE_ROWS / 2;
+
+        ScratchBuffer tileBuffer;
+        if (!sameFormat)
+            tileBuffer.resize((size_t)tileSize * tileSize * outPixelSize);
+
+        for (int32_t tileY = firstRow; tileY < endRow; tileY += tileSize)
+        {
+            int32_t rows = std::min(tileSize, endRow - tileY);
+
+            for (int32_t tileX = 0; tileX < width; tileX += tileSize)
+            {
+                int32_t cols = std::min(tileSize, width - tileX);
+
+                const uint8_t* tile = (const uint8_t*)srcRows + (tileY - firstRow) * srcRowPitch + tileX * inPixelSize;
+                size_t tileRowPitch = srcRowPitch;
+
+                if (!sameFormat)
+                {
+                    for (int32_t y = 0; y < rows; y++)
+                        convert(tile + y * srcRowPitch, tileBuffer.data() + y * cols * outPixelSize, cols);
+
+                    tile = tileBuffer.data();
+                    tileRowPitch = cols * outPixelSize;
+                }
+
+                move(tile, tileRowPitch, rows, cols, destOrigin + tileY * rowStep + tileX * colStep, colStep, rowStep);
+            }
+        }
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_ORIENTATION_H
+#define ARTOMATIX_ORIENTATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace AImg
+{
+    // The height of the tiles convertOrientationRows moves transposed pixels in (half this for pixels over 4 bytes)
+    const int32_t AIMG_ORIENT_TILE_ROWS = 64;
+
+    // Converts source rows firstRow to endRow - 1 of a width x height image from inFormat to outFormat, and writes them where
+    // orientationFlag puts them in dest (see AImgConvertOrientation). srcRows points at row firstRow, with rows srcRowPitch
+    // apart, so the rows can be a band of a bigger buffer. destRowPitch is the distance between rows of the reoriented image, and may be negative.
+    // Pixels are moved as they are when the formats match. Flags that transpose the image go through it in tiles, so the
+    // scattered writes stay in cache. Separate bands of source rows land in separate parts of dest, so bands can be done
+    // on different threads, or as they're decoded.
+    int32_t convertOrientationRows(const void* srcRows, size_t srcRowPitch, void* dest, ptrdiff_t destRowPitch, int32_t width, int32_t height,
+        int32_t inFormat, int32_t outFormat, int32_t orientationFlag, int32_t firstRow, int32_t endRow);
+}
+
+#endif // ARTOMATIX_ORIENTATION_H
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "OutputStream.h"
+
+namespace AImg
+{
+    namespace
+    {
+        std::atomic<int32_t> writeBufferSize(64 * 1024);
+    }
+
+    void OutputStream::setWriteBufferSize(int32_t size)
+    {
+        writeBufferSize = std::max(size, 0);
+    }
+
+    OutputStream::OutputStream(WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData)
+    {
+        mV1Callbacks.writeCallback = writeCallback;
+        mV1Callbacks.tellCallback = tellCallback;
+        mV1Callbacks.seekCallback = seekCallback;
+        mV1Callbacks.callbackData = callbackData;
+
+        wrapV1Callbacks(&mV1Callbacks, &mCallbacks);
+        initBuffer();
+    }
+
+    OutputStream::OutputStream(const AImgStreamCallbacks& callbacks)
+    {
+        mCallbacks = callbacks;
+        initBuffer();
+    }
+
+    OutputStream::~OutputStream()
+    {
+        flush();
+    }
+
+    void OutputStream::initBuffer()
+    {
+        mBuffer.resize(writeBufferSize);
+        mBufferStart = mCallbacks.tellCallback(mCallbacks.callbackData);
+    }
+
+    void OutputStream::write(const uint8_t* src, int64_t count)
+    {
+        if (count <= 0)
+            return;
+
+        if (mBufferFill + count > mBuffer.size())
+            flush();
+
+        // Too big to be worth buffering, so pass it straight through
+        if ((size_t)count >= mBuffer.size())
+        {
+            mCallbacks.writeCallback(mCallbacks.callbackData, src, count);
+            mBufferStart += count;
+            return;
+        }
+
+        memcpy(&mBuffer[mBufferFill], src, (size_t)count);
+        mBufferFill += (size_t)count;
+    }
+
+    int64_t OutputStream::tell()
+    {
+        return mBufferStart + (int64_t)mBufferFill;
+    }
+
+    void OutputStream::seek(int64_t pos)
+    {
+        if (pos == tell())
+            return;
+
+        flush();
+        mCallbacks.seekCallback(mCallbacks.callbackData, pos);
+        mBufferStart = pos;
+    }
+
+    void OutputStream::flush()
+    {
+        if (mBufferFill == 0)
+            return;
+
+        mCallbacks.writeCallback(mCallbacks.callbackData, &mBuffer[0], (int64_t)mBufferFill);
+        mBufferStart += (int64_t)mBufferFill;
+        mBufferFill = 0;
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_OUTPUT_STREAM_H
+#define ARTOMATIX_OUTPUT_STREAM_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "AIL.h"
+#include "AIL_internal.h"
+
+namespace AImg
+{
+    // The sink every encoder writes to, wrapping the user supplied write/tell/seek callbacks (AImgWriteImage/AImgWriteImageStream).
+    // As with InputStream, 32 bit callbacks are wrapped up as AImgStreamCallbacks, so encoders only deal in 64 bit offsets.
+    // Writes are collected in a buffer and handed to the callbacks in large blocks, and the position is tracked locally,
+    // so tell() never calls back, and seek() only does when it actually moves. flush() must be called when the encoder is done.
+    class OutputStream
+    {
+    public:
+        OutputStream(WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData);
+        OutputStream(const AImgStreamCallbacks& callbacks);
+        ~OutputStream();
+
+        OutputStream(const OutputStream&) = delete;
+        OutputStream& operator=(const OutputStream&) = delete;
+
+        void write(const uint8_t* src, int64_t count);
+        int64_t tell();
+        void seek(int64_t pos);
+        void flush();
+
+        // Write buffer size used by streams created after this call, see AImgSetWriteBufferSize
+        static void setWriteBufferSize(int32_t size);
+
+    private:
+        void initBuffer();
+
+        AImgStreamCallbacks mCallbacks = {};
+        CallbackData mV1Callbacks = {}; // only used when we were given 32 bit callbacks, mCallbacks points at this
+
+        // Bytes waiting to be written at mBufferStart, which is also where the callbacks are positioned
+        Vector<uint8_t> mBuffer;
+        size_t mBufferFill = 0;
+        int64_t mBufferStart = 0;
+    };
+}
+
+#endif // ARTOMATIX_OUTPUT_STREAM_H
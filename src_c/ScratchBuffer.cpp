@@ -0,0 +1,146 @@
+#include "ScratchBuffer.h"
+#include "AIL.h"
+
+#include <vector>
+#include <atomic>
+#include <new>
+
+namespace AImg
+{
+    namespace
+    {
+        struct PooledBlock
+        {
+            uint8_t* data;
+            size_t capacity;
+            AllocatorCallbacks allocator; // the allocator it came from, which may not be the current one any more
+        };
+
+        struct ScratchPool
+        {
+            std::vector<PooledBlock> blocks; // oldest first
+            size_t cachedBytes = 0;
+
+            ~ScratchPool()
+            {
+                trim(0);
+            }
+
+            // frees the oldest blocks until at most maxBytes are cached
+            void trim(size_t maxBytes)
+            {
+                size_t evict = 0;
+                while (evict < blocks.size() && cachedBytes > maxBytes)
+                {
+                    blocks[evict].allocator.freeFn(blocks[evict].allocator.user, blocks[evict].data);
+                    cachedBytes -= blocks[evict].capacity;
+                    evict++;
+                }
+
+                blocks.erase(blocks.begin(), blocks.begin() + evict);
+            }
+        };
+
+        thread_local ScratchPool pool;
+
+        std::atomic<size_t> scratchPoolLimit(128 * 1024 * 1024);
+    }
+
+    ScratchBuffer::ScratchBuffer()
+    {
+    }
+
+    ScratchBuffer::ScratchBuffer(size_t size)
+    {
+        resize(size);
+    }
+
+    ScratchBuffer::~ScratchBuffer()
+    {
+        release();
+    }
+
+    void ScratchBuffer::resize(size_t size)
+    {
+        if (size <= mCapacity)
+        {
+            mSize = size;
+            return;
+        }
+
+        release();
+
+        // smallest cached block that's big enough
+        size_t best = pool.blocks.size();
+        for (size_t i = 0; i < pool.blocks.size(); i++)
+        {
+            if (pool.blocks[i].capacity >= size && (best == pool.blocks.size() || pool.blocks[i].capacity < pool.blocks[best].capacity))
+                best = i;
+        }
+
+        if (best != pool.blocks.size())
+        {
+            mData = pool.blocks[best].data;
+            mCapacity = pool.blocks[best].capacity;
+            mAllocator = pool.blocks[best].allocator;
+
+            pool.cachedBytes -= mCapacity;
+            pool.blocks.erase(pool.blocks.begin() + best);
+        }
+        else
+        {
+            mAllocator = getAllocator();
+            mData = (uint8_t*)mAllocator.mallocFn(mAllocator.user, size);
+            if (mData == NULL)
+                throw std::bad_alloc();
+
+            mCapacity = size;
+        }
+
+        mSize = size;
+    }
+
+    void ScratchBuffer::release()
+    {
+        if (mData == NULL)
+            return;
+
+        size_t limit = scratchPoolLimit;
+
+        if (mCapacity > limit)
+        {
+            mAllocator.freeFn(mAllocator.user, mData);
+        }
+        else
+        {
+            pool.trim(limit - mCapacity);
+
+            PooledBlock block;
+            block.data = mData;
+            block.capacity = mCapacity;
+            block.allocator = mAllocator;
+            pool.blocks.push_back(block);
+            pool.cachedBytes += mCapacity;
+        }
+
+        mData = NULL;
+        mSize = 0;
+        mCapacity = 0;
+    }
+
+    void setScratchPoolLimit(size_t bytes)
+    {
+        scratchPoolLimit = bytes;
+        pool.trim(bytes);
+    }
+
+    void trimScratchPool()
+    {
+        pool.trim(0);
+    }
+}
+
+void AImgSetScratchPoolLimit(int64_t bytes)
+{
+    AImg::setScratchPoolLimit(bytes < 0 ? 0 : (size_t)bytes);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_SCRATCH_BUFFER_H
+#define ARTOMATIX_SCRATCH_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Allocator.h"
+
+namespace AImg
+{
+    // Uninitialised temporary memory, for the whole-image conversion buffers and TIFF strips. Blocks are taken from a
+    // per-thread pool and handed back to it on destruction, so repeated decodes on the same thread reuse them instead of
+    // allocating (and page faulting) a fresh image-sized buffer every time. See AImgSetScratchPoolLimit.
+    class ScratchBuffer
+    {
+    public:
+        ScratchBuffer();
+        explicit ScratchBuffer(size_t size);
+        ~ScratchBuffer();
+
+        // The contents are neither preserved nor zeroed
+        void resize(size_t size);
+
+        uint8_t* data() { return mData; }
+        size_t size() const { return mSize; }
+
+    private:
+        ScratchBuffer(const ScratchBuffer&) = delete;
+        ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+        void release();
+
+        uint8_t* mData = nullptr;
+        size_t mSize = 0;
+        size_t mCapacity = 0;
+        AllocatorCallbacks mAllocator;
+    };
+
+    void setScratchPoolLimit(size_t bytes);
+
+    // Frees everything the calling thread's pool is holding on to
+    void trimScratchPool();
+}
+
+#endif // ARTOMATIX_SCRATCH_BUFFER_H
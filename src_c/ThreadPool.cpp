@@ -0,0 +1,216 @@
+#include "ThreadPool.h"
+#include "AIL.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AImg
+{
+    namespace
+    {
+        // the most threads an explicit maxThreads can ask for, however few hardware threads there are
+        const int32_t MAX_REQUESTED_THREADS = 64;
+
+        struct Job
+        {
+            const std::function<int32_t(int32_t)>* body = nullptr;
+            int32_t count = 0;
+            std::atomic<int32_t> next{ 0 };
+            std::atomic<int32_t> finished{ 0 };
+
+            // the first failure, which stops any more indices being started
+            std::atomic<bool> failed{ false };
+            std::mutex errorMutex;
+            int32_t error = AImgErrorCode::AIMG_SUCCESS;
+            std::exception_ptr exception;
+
+            // how many workers should pick this up, and how many have
+            int32_t helpersWanted = 0;
+            int32_t helpersJoined = 0;
+
+            std::mutex finishedMutex;
+            std::condition_variable finishedCondition;
+
+            // Takes indices until there are none left. Only touches body for indices below count, which the caller is still
+            // waiting on, so workers that get here late never use it after parallelFor has returned. Nothing is allowed to
+            // escape, as every index has to be counted as finished for the caller to stop waiting.
+            void run()
+            {
+                for (int32_t i = next++; i < count; i = next++)
+                {
+                    if (!failed)
+                    {
+                        try
+                        {
+                            int32_t err = (*body)(i);
+                            if (err != AImgErrorCode::AIMG_SUCCESS)
+                                fail(err, nullptr);
+                        }
+                        catch (...)
+                        {
+                            fail(AImgErrorCode::AIMG_SUCCESS, std::current_exception());
+                        }
+                    }
+
+                    if (++finished == count)
+                    {
+                        std::lock_guard<std::mutex> lock(finishedMutex);
+                        finishedCondition.notify_all();
+                    }
+                }
+            }
+
+            void fail(int32_t err, std::exception_ptr e)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+
+                if (!failed)
+                {
+                    error = err;
+                    exception = e;
+                    failed = true;
+                }
+            }
+        };
+
+        class ThreadPool
+        {
+        public:
+            int32_t run(int32_t count, int32_t maxThreads, const std::function<int32_t(int32_t)>& body)
+            {
+                std::shared_ptr<Job> job = std::make_shared<Job>();
+                job->body = &body;
+                job->count = count;
+
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+
+                    // an explicit thread count is honoured even above the hardware's, so the pool grows to fit it
+                    int32_t threads = maxThreads > 0 ? std::min(maxThreads, MAX_REQUESTED_THREADS) : getMaxThreads();
+                    while ((int32_t)mWorkers.size() < threads - 1)
+                        mWorkers.push_back(std::thread(&ThreadPool::workerMain, this));
+
+                    job->helpersWanted = std::min(threads - 1, count - 1);
+
+                    if (job->helpersWanted > 0)
+                        mJobs.push_back(job);
+                }
+
+                for (int32_t i = 0; i < job->helpersWanted; i++)
+                    mWorkAvailable.notify_one();
+
+                job->run();
+
+                {
+                    std::unique_lock<std::mutex> lock(job->finishedMutex);
+                    job->finishedCondition.wait(lock, [&job]() { return job->finished == job->count; });
+                }
+
+                // drop the job if not every helper it asked for got to it
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    mJobs.erase(std::remove(mJobs.begin(), mJobs.end(), job), mJobs.end());
+                }
+
+                if (job->exception)
+                    std::rethrow_exception(job->exception);
+
+                return job->error;
+            }
+
+            void shutdown()
+            {
+                std::vector<std::thread> workers;
+
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    mStopping = true;
+                    workers.swap(mWorkers);
+                }
+
+                mWorkAvailable.notify_all();
+
+                for (std::thread& worker : workers)
+                    worker.join();
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopping = false;
+            }
+
+        private:
+            void workerMain()
+            {
+                while (true)
+                {
+                    std::shared_ptr<Job> job;
+
+                    {
+                        std::unique_lock<std::mutex> lock(mMutex);
+                        mWorkAvailable.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+
+                        if (mStopping)
+                            return;
+
+                        job = mJobs.front();
+                        if (++job->helpersJoined >= job->helpersWanted)
+                            mJobs.pop_front();
+                    }
+
+                    job->run();
+                }
+            }
+
+            std::mutex mMutex;
+            std::condition_variable mWorkAvailable;
+            std::deque<std::shared_ptr<Job>> mJobs;
+            std::vector<std::thread> mWorkers;
+            bool mStopping = false;
+        };
+
+        // Never destroyed, as joining threads from static destructors can deadlock (eg while a DLL is unloading).
+        // AImgCleanUp stops the workers properly.
+        ThreadPool& getPool()
+        {
+            static ThreadPool* pool = new ThreadPool();
+            return *pool;
+        }
+    }
+
+    int32_t parallelFor(int32_t count, int32_t maxThreads, const std::function<int32_t(int32_t)>& body)
+    {
+        if (count <= 0)
+            return AImgErrorCode::AIMG_SUCCESS;
+
+        if (count == 1 || maxThreads == 1 || (maxThreads <= 0 && getMaxThreads() == 1))
+        {
+            for (int32_t i = 0; i < count; i++)
+            {
+                int32_t err = body(i);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
+            }
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        return getPool().run(count, maxThreads, body);
+    }
+
+    int32_t getMaxThreads()
+    {
+        static const int32_t maxThreads = std::max((int32_t)std::thread::hardware_concurrency(), 1);
+        return maxThreads;
+    }
+
+    void shutdownThreadPool()
+    {
+        getPool().shutdown();
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_THREAD_POOL_H
+#define ARTOMATIX_THREAD_POOL_H
+
+#include <stdint.h>
+#include <functional>
+
+namespace AImg
+{
+    // Calls body(0) to body(count - 1), spread over the calling thread and up to maxThreads - 1 of an internal pool's workers,
+    // and returns once they have all finished. maxThreads <= 0 means one thread per hardware thread. A larger maxThreads (up to
+    // 64) starts more workers, which is mostly useful for tests on machines with few cores. The calling thread always works
+    // through the indices too, so this makes progress even when the workers are busy with other calls. Safe to call from
+    // several threads at once, but not from inside body.
+    // body returns an AImgErrorCode. Once one call fails (or throws), the indices not yet started are skipped, and the first
+    // error is returned (or the first exception rethrown on the calling thread) after every call in progress has finished.
+    int32_t parallelFor(int32_t count, int32_t maxThreads, const std::function<int32_t(int32_t)>& body);
+
+    // How many threads parallelFor uses by default, counting the caller: one per hardware thread
+    int32_t getMaxThreads();
+
+    // Stops and joins the workers (see AImgCleanUp). They're started again the next time they're needed.
+    void shutdownThreadPool();
+}
+
+#endif // ARTOMATIX_THREAD_POOL_H
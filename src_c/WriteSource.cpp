@@ -0,0 +1,163 @@
+#include "WriteSource.h"
+#include "AIL_internal.h"
+
+#include <string.h>
+
+namespace AImg
+{
+    AImgWriteSource packedWriteSource(void* data, int32_t format)
+    {
+        AImgWriteSource source;
+        memset(&source, 0, sizeof(AImgWriteSource));
+
+        source.format = format;
+        source.channelOrder = AImgChannelOrder::AIMG_CHANNEL_ORDER_RGBA;
+        source.data = data;
+
+        return source;
+    }
+
+    int32_t normaliseWriteSource(const AImgWriteSource& source, int32_t width, AImgWriteSource& normalised, std::string& errorDetails)
+    {
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(source.format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+        if (numChannels <= 0)
+        {
+            errorDetails = "[AImg::normaliseWriteSource] invalid source format";
+            return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
+        }
+
+        bool planar = source.data == NULL;
+
+        if (planar)
+        {
+            for (int32_t c = 0; c < numChannels; c++)
+            {
+                if (source.planes[c] == NULL)
+                {
+                    errorDetails = "[AImg::normaliseWriteSource] source has no data pointer, and is missing a plane";
+                    return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
+                }
+            }
+        }
+        else if (source.channelOrder != AImgChannelOrder::AIMG_CHANNEL_ORDER_RGBA)
+        {
+            if (source.channelOrder != AImgChannelOrder::AIMG_CHANNEL_ORDER_BGRA || numChannels < 3)
+            {
+                errorDetails = "[AImg::normaliseWriteSource] invalid channel order";
+                return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
+            }
+        }
+
+        size_t elementSize = planar ? bytesPerChannel : (size_t)numChannels * bytesPerChannel;
+
+        normalised = source;
+        if (planar)
+            normalised.channelOrder = AImgChannelOrder::AIMG_CHANNEL_ORDER_RGBA;
+
+        if (normalised.pixelStrideBytes == 0)
+            normalised.pixelStrideBytes = elementSize;
+        if (normalised.rowPitchBytes == 0)
+            normalised.rowPitchBytes = normalised.pixelStrideBytes * width;
+
+        if (normalised.pixelStrideBytes < elementSize)
+        {
+            errorDetails = "[AImg::normaliseWriteSource] pixelStrideBytes is smaller than a pixel";
+            return AImgErrorCode::AIMG_INVALID_WRITE_SOURCE;
+        }
+
+        if (width > 0 && normalised.rowPitchBytes < normalised.pixelStrideBytes * (width - 1) + elementSize)
+        {
+            errorDetails = "[AImg::normaliseWriteSource] rowPitchBytes is smaller than a row";
+            return AImgErrorCode::AIMG_INVALID_ROW_PITCH;
+        }
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
+    bool isPackedInterleaved(const AImgWriteSource& source)
+    {
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(source.format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+        return source.data != NULL &&
+            source.channelOrder == AImgChannelOrder::AIMG_CHANNEL_ORDER_RGBA &&
+            source.pixelStrideBytes == (size_t)numChannels * bytesPerChannel;
+    }
+
+    WriteSourceRows::WriteSourceRows(const AImgWriteSource& source, int32_t width, int32_t outFormat)
+        : mSource(source), mWidth(width), mOutFormat(outFormat), mGather(!isPackedInterleaved(source))
+    {
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+
+        if (mGather)
+        {
+            AIGetFormatDetails(source.format, &numChannels, &bytesPerChannel, &floatOrInt);
+            mGatherBuffer.resize((size_t)width * numChannels * bytesPerChannel);
+        }
+
+        if (source.format != outFormat)
+        {
+            AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+            mConvertBuffer.resize((size_t)width * numChannels * bytesPerChannel);
+        }
+    }
+
+    int32_t WriteSourceRows::getRow(int32_t y, const uint8_t** row)
+    {
+        const uint8_t* packed;
+
+        if (!mGather)
+        {
+            packed = (const uint8_t*)mSource.data + y * mSource.rowPitchBytes;
+        }
+        else
+        {
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(mSource.format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+            // where each of the R, G, B, A channels lives, relative to the start of a pixel
+            const uint8_t* channelBase[4];
+            for (int32_t c = 0; c < numChannels; c++)
+            {
+                if (mSource.data == NULL)
+                {
+                    channelBase[c] = (const uint8_t*)mSource.planes[c] + y * mSource.rowPitchBytes;
+                }
+                else
+                {
+                    int32_t offset = c;
+                    if (mSource.channelOrder == AImgChannelOrder::AIMG_CHANNEL_ORDER_BGRA && c < 3)
+                        offset = 2 - c;
+
+                    channelBase[c] = (const uint8_t*)mSource.data + y * mSource.rowPitchBytes + offset * bytesPerChannel;
+                }
+            }
+
+            uint8_t* dest = mGatherBuffer.data();
+            for (int32_t x = 0; x < mWidth; x++)
+            {
+                for (int32_t c = 0; c < numChannels; c++)
+                {
+                    memcpy(dest, channelBase[c] + x * mSource.pixelStrideBytes, bytesPerChannel);
+                    dest += bytesPerChannel;
+                }
+            }
+
+            packed = mGatherBuffer.data();
+        }
+
+        if (mSource.format != mOutFormat)
+        {
+            int32_t err = AImgConvertFormat((void*)packed, mConvertBuffer.data(), mWidth, 1, mSource.format, mOutFormat);
+            if (err != AImgErrorCode::AIMG_SUCCESS)
+                return err;
+
+            packed = mConvertBuffer.data();
+        }
+
+        *row = packed;
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2016-2019 Artomatix LTD
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+ * LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ARTOMATIX_WRITE_SOURCE_H
+#define ARTOMATIX_WRITE_SOURCE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "AIL.h"
+#include "ScratchBuffer.h"
+
+namespace AImg
+{
+    // The AImgWriteSource for a packed, interleaved, RGBA ordered buffer, as passed to AImgWriteImage
+    AImgWriteSource packedWriteSource(void* data, int32_t format);
+
+    // Checks source is usable for a width pixel wide image, and copies it to normalised with the 0 (tightly packed) pitches filled in.
+    // Returns an AImgErrorCode, with errorDetails set on failure.
+    int32_t normaliseWriteSource(const AImgWriteSource& source, int32_t width, AImgWriteSource& normalised, std::string& errorDetails);
+
+    // True if source is interleaved, RGBA ordered and has no gaps between pixels, so rows can be handed to an encoder as is
+    bool isPackedInterleaved(const AImgWriteSource& source);
+
+    // Hands an encoder the rows of a normalised AImgWriteSource as tightly packed, RGBA ordered rows of outFormat.
+    // Rows that are already laid out like that are returned in place. Anything else is gathered and/or converted into
+    // a one row buffer, so there's never a whole-image copy.
+    class WriteSourceRows
+    {
+    public:
+        WriteSourceRows(const AImgWriteSource& source, int32_t width, int32_t outFormat);
+
+        // row is valid until the next call
+        int32_t getRow(int32_t y, const uint8_t** row);
+
+        // True if getRow never copies
+        bool inPlace() const { return !mGather && mSource.format == mOutFormat; }
+
+    private:
+        WriteSourceRows(const WriteSourceRows&) = delete;
+        WriteSourceRows& operator=(const WriteSourceRows&) = delete;
+
+        AImgWriteSource mSource;
+        int32_t mWidth;
+        int32_t mOutFormat;
+        bool mGather;
+
+        ScratchBuffer mGatherBuffer; // the source row, packed and RGBA ordered, but still in the source format
+        ScratchBuffer mConvertBuffer; // the row in outFormat
+    };
+}
+
+#endif // ARTOMATIX_WRITE_SOURCE_H
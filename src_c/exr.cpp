@@ -5,6 +5,7 @@
 #include <ImfChannelList.h>
 #include <ImathBox.h>
 #include <ImfIO.h>
+#include <Iex.h>
 
 #include <stdint.h>
 #include <vector>
@@ -21,73 +22,119 @@ namespace AImg
     class CallbackIStream : public Imf::IStream
     {
     public:
-        CallbackIStream(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData) : IStream("")
+        CallbackIStream(InputStream* stream) : IStream("")
         {
-            mReadCallback = readCallback;
-            mTellCallback = tellCallback;
-            mSeekCallback = seekCallback;
-            mCallbackData = callbackData;
+            mStream = stream;
         }
 
         virtual bool read(char c[], int n)
         {
-            return mReadCallback(mCallbackData, (uint8_t *)c, n) == n;
+            return mStream->read((uint8_t *)c, n) == n;
         }
 
         virtual uint64_t tellg()
         {
-            return mTellCallback(mCallbackData);
+            return mStream->tell();
         }
 
         virtual void seekg(uint64_t pos)
         {
-            mSeekCallback(mCallbackData, (int32_t)pos);
+            mStream->seek((int64_t)pos);
         }
 
         virtual void clear()
         {
         }
 
-        ReadCallback mReadCallback;
-        TellCallback mTellCallback;
-        SeekCallback mSeekCallback;
-        void *mCallbackData;
+        InputStream* mStream;
+    };
+
+    // Used when the whole file is already in memory, OpenEXR will then read its headers and compressed chunks
+    // straight out of the buffer through readMemoryMapped, rather than copying them into its own buffers first.
+    class MemoryIStream : public Imf::IStream
+    {
+    public:
+        MemoryIStream(const uint8_t* data, uint64_t size) : IStream("")
+        {
+            mData = (char *)data;
+            mSize = size;
+            mPos = 0;
+        }
+
+        virtual bool isMemoryMapped() const
+        {
+            return true;
+        }
+
+        virtual bool read(char c[], int n)
+        {
+            if (mPos + n > mSize)
+                throw Iex::InputExc("Unexpected end of file.");
+
+            memcpy(c, mData + mPos, n);
+            mPos += n;
+
+            return mPos < mSize;
+        }
+
+        virtual char* readMemoryMapped(int n)
+        {
+            if (mPos + n > mSize)
+                throw Iex::InputExc("Unexpected end of file.");
+
+            char* retval = mData + mPos;
+            mPos += n;
+
+            return retval;
+        }
+
+        virtual uint64_t tellg()
+        {
+            return mPos;
+        }
+
+        virtual void seekg(uint64_t pos)
+        {
+            mPos = pos;
+        }
+
+        virtual void clear()
+        {
+        }
+
+        char* mData;
+        uint64_t mSize;
+        uint64_t mPos;
     };
 
     class CallbackOStream : public Imf::OStream
     {
     public:
-        CallbackOStream(WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData) : OStream("")
+        CallbackOStream(OutputStream* stream) : OStream("")
         {
-            mWriteCallback = writeCallback;
-            mTellCallback = tellCallback;
-            mSeekCallback = seekCallback;
-            mCallbackData = callbackData;
+            mStream = stream;
         }
 
         virtual void write(const char c[], int n)
         {
-            mWriteCallback(mCallbackData, (const uint8_t *)c, n);
+            mStream->write((const uint8_t *)c, n);
         }
 
         virtual uint64_t tellp()
         {
-            return mTellCallback(mCallbackData);
+            return mStream->tell();
         }
 
         virtual void seekp(uint64_t pos)
         {
-            mSeekCallback(mCallbackData, (int32_t)pos);
+            mStream->seek((int64_t)pos);
         }
 
         virtual void clear()
         {
         }
 
-        WriteCallback mWriteCallback;
-        TellCallback mTellCallback;
-        SeekCallback mSeekCallback;
-        void *mCallbackData;
+        OutputStream* mStream;
     };
 
     int32_t ExrImageLoader::initialise()
@@ -104,16 +151,9 @@ namespace AImg
         }
     }
 
-    bool ExrImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool ExrImageLoader::canLoadImage(const uint8_t* header, size_t headerSize)
     {
-        int32_t startingPos = tellCallback(callbackData);
-
-        std::vector<uint8_t> header(4);
-        readCallback(callbackData, &header[0], 4);
-
-        seekCallback(callbackData, startingPos);
-
-        return header[0] == 0x76 && header[1] == 0x2f && header[2] == 0x31 && header[3] == 0x01;
+        return headerSize >= 4 && header[0] == 0x76 && header[1] == 0x2f && header[2] == 0x31 && header[3] == 0x01;
     }
 
     std::string ExrImageLoader::getFileExtension()
@@ -168,12 +208,27 @@ namespace AImg
     class ExrFile : public AImgBase
     {
     public:
-        CallbackIStream *data = nullptr;
+        Imf::IStream *data = nullptr;
         Imf::InputFile *file = nullptr;
         Imath::Box2i dw;
 
+        // The encoder, between startWriteRows and finishWriteRows/abortWriteRows
+        CallbackOStream *writeStream = nullptr;
+        Imf::OutputFile *writeFile = nullptr;
+        int32_t writeFormat = AImgFormat::INVALID_FORMAT;
+        int32_t writeWidth = 0;
+        int32_t writeNextRow = 0;
+
         virtual ~ExrFile()
         {
+            try
+            {
+                closeWriteFile();
+            }
+            catch (const std::exception &)
+            {
+            }
+
             if (data)
                 delete data;
             if (file)
@@ -285,12 +340,11 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
+        virtual int32_t decodeRegion(int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, void *realDestBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat)
         {
             try
             {
                 int32_t width = dw.max.x - dw.min.x + 1;
-                int32_t height = dw.max.y - dw.min.y + 1;
 
                 int32_t decodeFormat = getDecodeFormat();
 
@@ -303,15 +357,6 @@ namespace AImg
                     return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
                 }
 
-                char *destBuffer = (char *)realDestBuffer;
-
-                std::vector<uint8_t> convertTmpBuffer(0);
-                if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-                {
-                    convertTmpBuffer.resize(width * height * decodeFormatBytesPerChannel * decodeFormatNumChannels);
-                    destBuffer = (char *)convertTmpBuffer.data();
-                }
-
                 std::vector<std::string> allChannelNames;
                 bool isRgba = true;
 
@@ -351,34 +396,89 @@ namespace AImg
                     }
                 }
 
-                Imf::FrameBuffer frameBuffer;
-                auto displayWindow = file->header().displayWindow();
+                auto dataWindow = file->header().dataWindow();
+                int32_t firstRow = std::max(y, dataWindow.min.y);
+                int32_t lastRow = std::min(y + regionHeight - 1, dataWindow.max.y);
+                bool coversRegion = dataWindow.min.x <= x && dataWindow.max.x >= x + regionWidth - 1 && firstRow == y && lastRow == y + regionHeight - 1;
 
-                auto fbMaxW = std::max(dw.max.x, displayWindow.max.x) + 1;
+                int32_t outputFormat = forceImageFormat == AImgFormat::INVALID_FORMAT ? decodeFormat : forceImageFormat;
 
-                auto channelType = decodeFormatBytesPerChannel == 4 ? Imf::FLOAT : Imf::HALF;
-                for (uint32_t i = 0; i < usedChannelNames.size(); i++)
+                // OpenEXR converts between half and float itself as it fills in the slices, exactly as AImgConvertFormat would,
+                // so when that's all that's needed the slices are just given the output type. It can also drop alpha, or fill a
+                // missing alpha channel in with 1 (though not outside the data window, where the pixels are left at 0).
+                int32_t outNumChannels, outBytesPerChannel, outFloatOrInt;
+                AIGetFormatDetails(outputFormat, &outNumChannels, &outBytesPerChannel, &outFloatOrInt);
+
+                bool isRgb = isRgba && usedChannelNames.size() == 3 && usedChannelNames[2] == "B" && coversRegion;
+                bool hasAlpha = isRgba && usedChannelNames.size() == 4;
+
+                if (outFloatOrInt == AImgFloatOrIntType::FITYPE_FLOAT && (outBytesPerChannel == 2 || outBytesPerChannel == 4) &&
+                    (outNumChannels == decodeFormatNumChannels || (isRgb && outNumChannels == 4) || (hasAlpha && outNumChannels == 3)))
                 {
-                    auto slice = Imf::Slice(channelType,
-                        destBuffer + i * decodeFormatBytesPerChannel,
-                        usedChannelNames.size() * decodeFormatBytesPerChannel,
-                        fbMaxW * usedChannelNames.size() * decodeFormatBytesPerChannel,
-                        1,
-                        1,
-                        0.0);
-
-                    frameBuffer.insert(usedChannelNames[i], slice);
+                    if (isRgb && outNumChannels == 4)
+                        usedChannelNames.push_back("A");
+                    else if (hasAlpha && outNumChannels == 3)
+                        usedChannelNames.pop_back();
+
+                    decodeFormat = outputFormat;
+                    decodeFormatNumChannels = outNumChannels;
+                    decodeFormatBytesPerChannel = outBytesPerChannel;
                 }
 
-                file->setFrameBuffer(frameBuffer);
-                auto dataWindow = file->header().dataWindow();
-                file->readPixels(dataWindow.min.y, dataWindow.max.y);
+                size_t pixelSize = (size_t)decodeFormatBytesPerChannel * decodeFormatNumChannels;
+                auto channelType = decodeFormatBytesPerChannel == 4 ? Imf::FLOAT : Imf::HALF;
 
-                if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+                // Slices are addressed by absolute pixel coordinates, so base points at where pixel (0, 0) would be. yStride is
+                // negative for bottom up rows, which OpenEXR's unsigned address arithmetic wraps round to the right place.
+                auto setFrameBuffer = [&](char *base, ptrdiff_t yStride)
                 {
-                    int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
+                    Imf::FrameBuffer frameBuffer;
+                    for (uint32_t i = 0; i < usedChannelNames.size(); i++)
+                    {
+                        auto slice = Imf::Slice(channelType,
+                            base + i * decodeFormatBytesPerChannel,
+                            pixelSize,
+                            (size_t)yStride,
+                            1,
+                            1,
+                            usedChannelNames[i] == "A" ? 1.0 : 0.0);
+
+                        frameBuffer.insert(usedChannelNames[i], slice);
+                    }
+
+                    file->setFrameBuffer(frameBuffer);
+                };
+
+                // OpenEXR writes whole rows of the data window, so the rows are read a band at a time into full width rows
+                // (or straight into the caller's buffer, when that's what they are already), and cropped and converted out.
+                // Pixels outside the data window are never written, so those are zeroed first.
+                int32_t rowBufferWidth = std::max(width, dataWindow.max.x + 1);
+
+                ConvertBand band;
+                band.init(rowBufferWidth, x, regionWidth, regionHeight, decodeFormat, outputFormat, realDestBuffer, rowPitchBytes);
+
+                for (int32_t row = y; row < y + regionHeight;)
+                {
+                    int32_t rowCount = band.rowsFree();
+
+                    if (!coversRegion)
+                    {
+                        for (int32_t i = 0; i < rowCount; i++)
+                            memset(band.nextRow() + i * band.rowPitch(), 0, rowBufferWidth * pixelSize);
+                    }
+
+                    setFrameBuffer((char *)band.nextRow() - (ptrdiff_t)row * band.rowPitch(), band.rowPitch());
+
+                    int32_t readFirst = std::max(row, firstRow);
+                    int32_t readLast = std::min(row + rowCount - 1, lastRow);
+                    if (readFirst <= readLast)
+                        file->readPixels(readFirst, readLast);
+
+                    int32_t err = band.rowsDecoded(rowCount);
                     if (err != AImgErrorCode::AIMG_SUCCESS)
                         return err;
+
+                    row += rowCount;
                 }
 
                 return AImgErrorCode::AIMG_SUCCESS;
@@ -390,11 +490,31 @@ namespace AImg
             }
         }
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        virtual bool canDecodeRows()
+        {
+            return true;
+        }
+
+        // OpenEXR reads any range of rows on its own, keeping just the compressed block they're in
+        virtual int32_t decodeRows(int32_t firstRow, int32_t rowCount, void *destBuffer, size_t rowPitchBytes, int32_t forceImageFormat)
+        {
+            return decodeRegion(0, firstRow, dw.max.x - dw.min.x + 1, rowCount, destBuffer, rowPitchBytes, forceImageFormat);
+        }
+
+        virtual int32_t openImage(InputStream* stream)
         {
             try
             {
-                data = new CallbackIStream(readCallback, tellCallback, seekCallback, callbackData);
+                if (stream->getMemory())
+                {
+                    size_t startPos = (size_t)stream->tell();
+                    data = new MemoryIStream(stream->getMemory() + startPos, stream->getMemorySize() - startPos);
+                }
+                else
+                {
+                    data = new CallbackIStream(stream);
+                }
+
                 file = new Imf::InputFile(*data);
                 dw = file->header().displayWindow();
                 auto header = file->header();
@@ -408,76 +528,183 @@ namespace AImg
             }
         }
 
-        int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void *encodingOptions)
+        static const char *getChannelName(int32_t channel, int32_t numChannels)
         {
-            AIL_UNUSED_PARAM(encodingOptions);
+            const char *RGBAChannelNames[] = { "R", "G", "B", "A" };
+            const char *GreyScaleChannelName = "Y";
+
+            if (numChannels == 1)
+                return GreyScaleChannelName;
+
+            return RGBAChannelNames[channel];
+        }
+
+        // Deleting the file writes out the line offset table, so this can throw
+        void closeWriteFile()
+        {
+            Imf::OutputFile *oldFile = writeFile;
+            CallbackOStream *oldStream = writeStream;
+            writeFile = nullptr;
+            writeStream = nullptr;
 
             try
             {
-                std::vector<uint8_t> reformattedDataTmp(0);
+                delete oldFile;
+            }
+            catch (...)
+            {
+                delete oldStream;
+                throw;
+            }
 
-                void *inputBuf = data;
-                AImgFormat inputBufFormat = getWriteFormatExr(inputFormat, outputFormat);
+            delete oldStream;
+        }
 
-                bool needConversion = inputBufFormat != inputFormat;
+        virtual bool canWriteRows()
+        {
+            return true;
+        }
 
-                // need 32F or 16F data, so convert if necessary
-                if (needConversion)
-                {
-                    // resize reformattedDataTmp to fit the converted image data
-                    int32_t bytesPerChannelTmp, numChannelsTmp, floatOrIntTmp;
-                    AIGetFormatDetails(inputBufFormat, &numChannelsTmp, &bytesPerChannelTmp, &floatOrIntTmp);
-                    reformattedDataTmp.resize(numChannelsTmp * bytesPerChannelTmp * width * height);
+        virtual int32_t startWriteRows(int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+            const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+            OutputStream* stream, void* encodingOptions)
+        {
+            AIL_UNUSED_PARAM(profileName);
+            AIL_UNUSED_PARAM(colourProfile);
+            AIL_UNUSED_PARAM(colourProfileLen);
+            AIL_UNUSED_PARAM(encodingOptions);
 
-                    AImgConvertFormat(data, &reformattedDataTmp[0], width, height, inputFormat, inputBufFormat);
-                    inputBuf = &reformattedDataTmp[0];
-                }
+            try
+            {
+                // need 32F or 16F data, so convert if necessary
+                writeFormat = getWriteFormatExr(inputFormat, outputFormat);
+                writeWidth = width;
+                writeNextRow = 0;
 
                 int32_t bytesPerChannel, numChannels, floatOrInt;
-                AIGetFormatDetails(inputBufFormat, &numChannels, &bytesPerChannel, &floatOrInt);
-
-                const char *RGBAChannelNames[] = { "R", "G", "B", "A" };
-                const char *GreyScaleChannelName = "Y";
+                AIGetFormatDetails(writeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
                 Imf::Header header(width, height);
 
                 for (int32_t i = 0; i < numChannels; i++)
-                {
-                    const char *channelName;
-                    if (numChannels == 1)
-                        channelName = GreyScaleChannelName;
-                    else
-                        channelName = RGBAChannelNames[i];
+                    header.channels().insert(getChannelName(i, numChannels), Imf::Channel((bytesPerChannel == 4) ? Imf::FLOAT : Imf::HALF));
+
+                writeStream = new CallbackOStream(stream);
+                writeFile = new Imf::OutputFile(*writeStream, header);
 
-                    header.channels().insert(channelName, Imf::Channel((bytesPerChannel == 4) ? Imf::FLOAT : Imf::HALF));
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+            catch (const std::exception &e)
+            {
+                abortWriteRows();
+                mErrorDetails = std::string("[AImg::EXRImageLoader::EXRFile::] ") + e.what();
+                return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
+            }
+        }
+
+        virtual int32_t writeRowBand(const AImgWriteSource& source, int32_t rowCount)
+        {
+            try
+            {
+                int32_t bytesPerChannel, numChannels, floatOrInt;
+                AIGetFormatDetails(writeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+                // Slices can point straight at any layout, so the source is only copied if it needs converting.
+                // In that case the slices point at a single row (yStride 0), which is refilled before each scanline is written.
+                bool needConversion = writeFormat != source.format;
+                WriteSourceRows rows(source, writeWidth, writeFormat);
+                const uint8_t* convertedRow = NULL;
+                if (needConversion)
+                {
+                    int32_t err = rows.getRow(0, &convertedRow);
+                    if (err != AImgErrorCode::AIMG_SUCCESS)
+                        return err;
                 }
 
                 Imf::FrameBuffer frameBuffer;
 
                 for (int32_t i = 0; i < numChannels; i++)
                 {
-                    const char *channelName;
-                    if (numChannels == 1)
-                        channelName = GreyScaleChannelName;
+                    char* base;
+                    size_t xStride, yStride;
+
+                    if (needConversion)
+                    {
+                        base = (char *)convertedRow + bytesPerChannel * i;
+                        xStride = bytesPerChannel * numChannels;
+                        yStride = 0;
+                    }
                     else
-                        channelName = RGBAChannelNames[i];
+                    {
+                        if (source.data == NULL)
+                        {
+                            base = (char *)source.planes[i];
+                        }
+                        else
+                        {
+                            int32_t offset = i;
+                            if (source.channelOrder == AImgChannelOrder::AIMG_CHANNEL_ORDER_BGRA && i < 3)
+                                offset = 2 - i;
+
+                            base = (char *)source.data + bytesPerChannel * offset;
+                        }
+
+                        xStride = source.pixelStrideBytes;
+                        yStride = source.rowPitchBytes;
+
+                        // Slices are addressed by absolute row, and source starts at the next row to be written
+                        base -= (ptrdiff_t)writeNextRow * yStride;
+                    }
 
                     frameBuffer.insert(
-                        channelName,
+                        getChannelName(i, numChannels),
                         Imf::Slice(
                         (bytesPerChannel == 4) ? Imf::FLOAT : Imf::HALF,
-                            &((char *)inputBuf)[bytesPerChannel * i],
-                            bytesPerChannel * numChannels,
-                            bytesPerChannel * width * numChannels,
+                            base,
+                            xStride,
+                            yStride,
                             1, 1,
                             0.0));
                 }
 
-                CallbackOStream ostream(writeCallback, tellCallback, seekCallback, callbackData);
-                Imf::OutputFile file(ostream, header);
-                file.setFrameBuffer(frameBuffer);
-                file.writePixels(height);
+                writeFile->setFrameBuffer(frameBuffer);
+
+                if (!needConversion)
+                {
+                    writeFile->writePixels(rowCount);
+                }
+                else
+                {
+                    for (int32_t y = 0; y < rowCount; y++)
+                    {
+                        // getRow converts every row into the same buffer, which is where the slices point
+                        if (y > 0)
+                        {
+                            int32_t err = rows.getRow(y, &convertedRow);
+                            if (err != AImgErrorCode::AIMG_SUCCESS)
+                                return err;
+                        }
+
+                        writeFile->writePixels(1);
+                    }
+                }
+
+                writeNextRow += rowCount;
+
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+            catch (const std::exception &e)
+            {
+                mErrorDetails = std::string("[AImg::EXRImageLoader::EXRFile::] ") + e.what();
+                return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
+            }
+        }
+
+        virtual int32_t finishWriteRows()
+        {
+            try
+            {
+                closeWriteFile();
 
                 return AImgErrorCode::AIMG_SUCCESS;
             }
@@ -488,6 +715,17 @@ namespace AImg
             }
         }
 
+        virtual void abortWriteRows()
+        {
+            try
+            {
+                closeWriteFile();
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+
         virtual bool SupportsExif() const noexcept override
         {
             return false;
@@ -509,6 +747,149 @@ namespace AImg
         return new ExrFile();
     }
 
+    namespace
+    {
+        // Reads a null terminated attribute name or type from an exr header. Both are at most 255 bytes, even with long names enabled.
+        bool readExrHeaderString(InputStream* stream, char* str, size_t maxLen)
+        {
+            for (size_t i = 0; i < maxLen; i++)
+            {
+                if (stream->read((uint8_t*)&str[i], 1) != 1)
+                    return false;
+
+                if (str[i] == '\0')
+                    return true;
+            }
+
+            return false;
+        }
+    }
+
+    // Walks the attributes of the (first) header directly, picking out "channels" and "displayWindow", rather than
+    // constructing an Imf::InputFile, which would also read the line offset table.
+    int32_t ExrImageLoader::probeImage(InputStream* stream, AImgProbeInfo* info)
+    {
+        uint8_t buf[16];
+
+        // magic + version
+        if (stream->read(buf, 8) != 8)
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+        bool gotChannels = false;
+        bool gotDisplayWindow = false;
+
+        int32_t channelNum = 0;
+        bool allChannelsSame = true;
+        int32_t firstChannelType = -1;
+
+        while (true)
+        {
+            char name[256];
+            char type[256];
+
+            if (!readExrHeaderString(stream, name, sizeof(name)))
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+            // an empty name ends the header
+            if (name[0] == '\0')
+                break;
+
+            if (!readExrHeaderString(stream, type, sizeof(type)) || stream->read(buf, 4) != 4)
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+            int64_t attributeSize = (int32_t)readUInt32(buf, true);
+            if (attributeSize < 0)
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+            int64_t attributeEnd = stream->tell() + attributeSize;
+
+            if (strcmp(name, "channels") == 0 && strcmp(type, "chlist") == 0)
+            {
+                // each channel is: name, pixel type (int32), pLinear + 3 reserved bytes, xSampling (int32), ySampling (int32)
+                while (true)
+                {
+                    char channelName[256];
+                    if (!readExrHeaderString(stream, channelName, sizeof(channelName)))
+                        return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+                    if (channelName[0] == '\0')
+                        break;
+
+                    if (stream->read(buf, 16) != 16)
+                        return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+                    int32_t channelType = (int32_t)readUInt32(buf, true);
+
+                    if (channelNum == 0)
+                        firstChannelType = channelType;
+                    else if (channelType != firstChannelType)
+                        allChannelsSame = false;
+
+                    channelNum++;
+                }
+
+                gotChannels = true;
+            }
+            else if (strcmp(name, "displayWindow") == 0 && strcmp(type, "box2i") == 0)
+            {
+                // the size getImageInfo reports, and decodes fill (the data window can be smaller)
+                if (stream->read(buf, 16) != 16)
+                    return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+                int32_t xMin = (int32_t)readUInt32(buf, true);
+                int32_t yMin = (int32_t)readUInt32(buf + 4, true);
+                int32_t xMax = (int32_t)readUInt32(buf + 8, true);
+                int32_t yMax = (int32_t)readUInt32(buf + 12, true);
+
+                info->width = xMax - xMin + 1;
+                info->height = yMax - yMin + 1;
+
+                gotDisplayWindow = true;
+            }
+
+            stream->seek(attributeEnd);
+        }
+
+        if (!gotChannels || !gotDisplayWindow || channelNum <= 0)
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+        info->numChannels = channelNum;
+        info->colourProfileLen = 0;
+
+        if (!allChannelsSame)
+        {
+            info->bytesPerChannel = -1;
+            info->floatOrInt = AImgFloatOrIntType::FITYPE_UNKNOWN;
+        }
+        else if (firstChannelType == Imf::PixelType::UINT)
+        {
+            info->bytesPerChannel = 4;
+            info->floatOrInt = AImgFloatOrIntType::FITYPE_INT;
+        }
+        else if (firstChannelType == Imf::PixelType::FLOAT)
+        {
+            info->bytesPerChannel = 4;
+            info->floatOrInt = AImgFloatOrIntType::FITYPE_FLOAT;
+        }
+        else if (firstChannelType == Imf::PixelType::HALF)
+        {
+            info->bytesPerChannel = 2;
+            info->floatOrInt = AImgFloatOrIntType::FITYPE_FLOAT;
+        }
+        else
+        {
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+        }
+
+        // same rules as ExrFile::getDecodeFormat
+        bool useHalfFloat = allChannelsSame && firstChannelType == Imf::PixelType::HALF;
+        int32_t format = (useHalfFloat ? AImgFormat::_16BITS : AImgFormat::_32BITS) | AImgFormat::FLOAT_FORMAT;
+        format |= (AImgFormat::R << (std::min(channelNum, 4) - 1));
+        info->decodedImgFormat = format;
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
     bool ExrImageLoader::isFormatSupported(int32_t format)
     {
         return isFormatSupportedByExr(format);
@@ -12,28 +12,22 @@ namespace AImg
     {
         int readCallback(void * user, char * data, int size)
         {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-            return callbackFunctions->readCallback(callbackFunctions->callbackData, (uint8_t *)data, size);
+            InputStream * stream = (InputStream *)user;
+            return (int)stream->read((uint8_t *)data, size);
         }
 
-        void seekCallback(void * user, int num_bytes)
+        void skipCallback(void * user, int num_bytes)
         {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-            callbackFunctions->seekCallback(callbackFunctions->callbackData, num_bytes);
+            InputStream * stream = (InputStream *)user;
+            stream->seek(stream->tell() + num_bytes);
         }
 
         int eofCallback(void * user)
         {
-            CallbackData * callbackFunctions = (CallbackData *)user;
+            InputStream * stream = (InputStream *)user;
 
-            int startPos = callbackFunctions->tellCallback(callbackFunctions->callbackData);
-            callbackFunctions->seekCallback(callbackFunctions->callbackData, startPos + 1);
-
-            int newPos = callbackFunctions->tellCallback(callbackFunctions->callbackData);
-
-            callbackFunctions->seekCallback(callbackFunctions->callbackData, startPos);
-
-            return (startPos - newPos) != 0 ? 1 : 0;
+            uint8_t tmp;
+            return stream->peek(&tmp, 1) == 0 ? 1 : 0;
         }
     }
 
@@ -41,40 +35,57 @@ namespace AImg
     {
     public:
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        virtual int32_t openImage(InputStream* stream)
         {
-            data.readCallback = readCallback;
-            data.tellCallback = tellCallback;
-            data.seekCallback = seekCallback;
-            data.callbackData = callbackData;
+            this->stream = stream;
+            startPos = stream->tell();
 
-            stbi_io_callbacks callback;
-            callback.read = STBIHDRCallbacks::readCallback;
-            callback.skip = STBIHDRCallbacks::seekCallback;
-            callback.eof = STBIHDRCallbacks::eofCallback;
+            int ok;
+            if (stream->getMemory())
+            {
+                ok = stbi_info_from_memory(stream->getMemory() + startPos, (int)(stream->getMemorySize() - startPos), &width, &height, &numChannels);
+            }
+            else
+            {
+                stbi_io_callbacks callbacks;
+                callbacks.read = STBIHDRCallbacks::readCallback;
+                callbacks.skip = STBIHDRCallbacks::skipCallback;
+                callbacks.eof = STBIHDRCallbacks::eofCallback;
 
-            int startingPosition = tellCallback(callbackData);
-            stbi_hdr_to_ldr_gamma(1.0f);
-            stbi_ldr_to_hdr_gamma(1.0f);
+                ok = stbi_info_from_callbacks(&callbacks, stream, &width, &height, &numChannels);
+                stream->seek(startPos);
+            }
 
-            stbi_info_from_callbacks(&callback, &data, &width, &height, &numChannels);
-            seekCallback(callbackData, startingPosition);
+            if (!ok)
+            {
+                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::openImage] stbi_info failed!";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
+        virtual int32_t decodeRegion(int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, void *realDestBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat)
         {
-            stbi_io_callbacks callbacks;
+            float * loadedData = NULL;
 
-            callbacks.read = STBIHDRCallbacks::readCallback;
-            callbacks.skip = STBIHDRCallbacks::seekCallback;
-            callbacks.eof = STBIHDRCallbacks::eofCallback;
-            float * loadedData = stbi_loadf_from_callbacks(&callbacks, &data, &width, &height, &numChannels, numChannels);
+            if (stream->getMemory())
+            {
+                loadedData = stbi_loadf_from_memory(stream->getMemory() + startPos, (int)(stream->getMemorySize() - startPos), &width, &height, &numChannels, numChannels);
+            }
+            else
+            {
+                stbi_io_callbacks callbacks;
+                callbacks.read = STBIHDRCallbacks::readCallback;
+                callbacks.skip = STBIHDRCallbacks::skipCallback;
+                callbacks.eof = STBIHDRCallbacks::eofCallback;
+
+                loadedData = stbi_loadf_from_callbacks(&callbacks, stream, &width, &height, &numChannels, numChannels);
+            }
 
             if (!loadedData)
             {
-                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::decodeImage] stbi_loadf_from_callbacks failed!";
+                mErrorDetails = "[AImg::HDRImageLoader::HDRFile::decodeImage] stbi_loadf failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
@@ -82,30 +93,22 @@ namespace AImg
             int32_t numChannels, bytesPerChannel, floatOrInt;
             AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-            void* destBuffer = realDestBuffer;
+            // stb always decodes the whole image into a tightly packed buffer, so convert (or just copy) the region straight out of it
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = decodeFormat;
 
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-            {
-                convertTmpBuffer.resize(width * height * bytesPerChannel * numChannels);
-                destBuffer = convertTmpBuffer.data();
-            }
+            size_t pixelSize = (size_t)bytesPerChannel * numChannels;
+            size_t loadedRowSize = pixelSize * width;
+            const uint8_t* regionStart = (const uint8_t*)loadedData + y * loadedRowSize + x * pixelSize;
 
-            memcpy(destBuffer, loadedData, width * height * bytesPerChannel * numChannels);
+            int32_t err = convertFormatStrided(regionStart, loadedRowSize, realDestBuffer, rowPitchBytes, regionWidth, regionHeight, decodeFormat, forceImageFormat);
             stbi_image_free(loadedData);
 
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-            {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
-                if (err != AImgErrorCode::AIMG_SUCCESS)
-                    return err;
-            }
-
-            return AImgErrorCode::AIMG_SUCCESS;
+            return err;
         }
 
-        virtual int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+        virtual int32_t writeImage(const AImgWriteSource& source, int32_t width, int32_t height, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+            OutputStream* stream, void* encodingOptions)
         {
             return AImgErrorCode::AIMG_WRITE_NOT_SUPPORTED_FOR_FORMAT;
         }
@@ -156,7 +159,8 @@ namespace AImg
         }
 
     private:
-        CallbackData data;
+        InputStream* stream = nullptr;
+        int64_t startPos = 0;
         int32_t numChannels, width, height;
     };
 
@@ -165,20 +169,23 @@ namespace AImg
         return new HDRFile();
     }
 
-    bool HDRImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData)
+    // Opening a HDR file only runs stbi_info on the header, so probing is just an open on the stack
+    int32_t HDRImageLoader::probeImage(InputStream* stream, AImgProbeInfo* info)
     {
-        int startingPosition = tellCallback(callbackData);
+        HDRFile file;
 
-        std::vector<uint8_t> magic = { 0x23, 0x3f, 0x52, 0x41, 0x44, 0x49, 0x41, 0x4e, 0x43, 0x45, 0x0a };
+        int32_t err = file.openImage(stream);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
 
-        std::vector<uint8_t> readBackData;
-        readBackData.resize(magic.size());
-
-        readCallback(callbackData, readBackData.data(), (int32_t)magic.size());
+        return file.getImageInfo(&info->width, &info->height, &info->numChannels, &info->bytesPerChannel, &info->floatOrInt, &info->decodedImgFormat, &info->colourProfileLen);
+    }
 
-        seekCallback(callbackData, startingPosition);
+    bool HDRImageLoader::canLoadImage(const uint8_t* header, size_t headerSize)
+    {
+        static const uint8_t magic[] = { 0x23, 0x3f, 0x52, 0x41, 0x44, 0x49, 0x41, 0x4e, 0x43, 0x45, 0x0a }; // "#?RADIANCE\n"
 
-        return memcmp(magic.data(), readBackData.data(), magic.size()) == 0;
+        return headerSize >= sizeof(magic) && memcmp(magic, header, sizeof(magic)) == 0;
     }
 
     std::string HDRImageLoader::getFileExtension()
@@ -191,7 +198,15 @@ namespace AImg
         return HDR_IMAGE_FORMAT;
     }
 
-    int32_t HDRImageLoader::initialise() { return AImgErrorCode::AIMG_SUCCESS; }
+    int32_t HDRImageLoader::initialise()
+    {
+        // These are process wide stb globals, so they're set once here (AImgInitialise is serialised) rather than on every open,
+        // where they would race with decodes on other threads.
+        stbi_hdr_to_ldr_gamma(1.0f);
+        stbi_ldr_to_hdr_gamma(1.0f);
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
 
     bool HDRImageLoader::isFormatSupported(int32_t format) { return format == AImgFormat::RGB32F; }
 
@@ -2,10 +2,12 @@
 #include "jpeg.h"
 #include "AIL_internal.h"
 #include <vector>
+#include <algorithm>
 #include <string.h>
 #include <cstring>
 #include <setjmp.h>
 #include <jpeglib.h>
+#include <jerror.h>
 #include "JpegExifHandler.hpp"
 
 #ifdef HAVE_JPEG
@@ -15,14 +17,14 @@ namespace AImg
     {
         jpeg_source_mgr pub;
         void *data;
-        CallbackData callbackFunctionData;
+        InputStream *stream;
     } ArtomatixJPEGSourceMGR;
 
     typedef struct
     {
         jpeg_destination_mgr pub;
         void *buffer;
-        CallbackData callbackFunctionData;
+        OutputStream *stream;
     } ArtomatixJPEGDestinationMGR;
 
     typedef struct
@@ -51,7 +53,7 @@ namespace AImg
             {
                 ArtomatixJPEGDestinationMGR * dst = (ArtomatixJPEGDestinationMGR *)cinfo->dest;
 
-                dst->callbackFunctionData.writeCallback(dst->callbackFunctionData.callbackData, (uint8_t *)dst->buffer, JPEGConsts::BUFFER_SIZE);
+                dst->stream->write((uint8_t *)dst->buffer, JPEGConsts::BUFFER_SIZE);
                 dst->pub.next_output_byte = (JOCTET *)dst->buffer;
                 dst->pub.free_in_buffer = JPEGConsts::BUFFER_SIZE;
                 return TRUE;
@@ -62,7 +64,7 @@ namespace AImg
                 ArtomatixJPEGDestinationMGR * dst = (ArtomatixJPEGDestinationMGR *)cinfo->dest;
                 size_t datacount = JPEGConsts::BUFFER_SIZE - dst->pub.free_in_buffer;
                 if (datacount > 0)
-                    dst->callbackFunctionData.writeCallback(dst->callbackFunctionData.callbackData, (uint8_t *)dst->buffer, (int32_t)datacount);
+                    dst->stream->write((uint8_t *)dst->buffer, (int64_t)datacount);
             }
         }
 
@@ -92,12 +94,12 @@ namespace AImg
             boolean fillInputBuffer(j_decompress_ptr cinfo)
             {
                 ArtomatixJPEGSourceMGR * src = (ArtomatixJPEGSourceMGR *)cinfo->src;
-                size_t bytesRead = src->callbackFunctionData.readCallback(src->callbackFunctionData.callbackData, (uint8_t *)src->data, JPEGConsts::BUFFER_SIZE);
+                int64_t bytesRead = src->stream->read((uint8_t *)src->data, JPEGConsts::BUFFER_SIZE);
 
                 if (bytesRead <= 0)
                     return FALSE;
 
-                src->pub.bytes_in_buffer = bytesRead;
+                src->pub.bytes_in_buffer = (size_t)bytesRead;
                 src->pub.next_input_byte = (JOCTET *)src->data;
 
                 return TRUE;
@@ -122,13 +124,254 @@ namespace AImg
         }
     }
 
-    void setArtomatixSourceMGR(j_decompress_ptr cinfo, CallbackData callbackData)
+    // A replacement for libjpeg's memory manager that takes all of its memory from aimgMalloc (ie AImgSetAllocator).
+    // It's much simpler than the stock one (jmemmgr.c): every allocation is its own block, and virtual arrays
+    // always live fully in memory, which is all the stock manager does without a backing store anyway.
+    // libjpeg-turbo's SIMD code wants 32 byte aligned sample rows, so everything is aligned to that.
+    namespace JPEGMemoryManager
+    {
+        const size_t ALIGNMENT = 32;
+
+        // sits just before each aligned block
+        struct Block
+        {
+            Block* next;
+            void* raw;
+        };
+
+        struct VirtualArray
+        {
+            void* buffer; // JSAMPARRAY or JBLOCKARRAY, NULL until realize_virt_arrays
+            JDIMENSION numRows;
+            JDIMENSION rowSize; // samples or blocks per row
+            boolean preZero;
+            bool isBlockArray;
+            VirtualArray* next;
+        };
+
+        struct Manager
+        {
+            jpeg_memory_mgr pub;
+            jpeg_memory_mgr* original; // the stock manager jpeg_create_* made, which owns everything allocated before we were installed
+            Block* pools[JPOOL_NUMPOOLS];
+            VirtualArray* virtualArrays;
+        };
+
+        size_t alignUp(size_t size)
+        {
+            return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        }
+
+        void* allocBlock(j_common_ptr cinfo, int pool_id, size_t size)
+        {
+            Manager* mem = (Manager*)cinfo->mem;
+
+            if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
+                ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+
+            // the stock manager also rounds sizes up, and the SIMD code relies on being able to write to the padding
+            size = alignUp(size);
+
+            void* raw = aimgMalloc(size + sizeof(Block) + ALIGNMENT);
+            if (raw == NULL)
+                ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+
+            uintptr_t aligned = ((uintptr_t)raw + sizeof(Block) + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+
+            Block* block = (Block*)(aligned - sizeof(Block));
+            block->raw = raw;
+            block->next = mem->pools[pool_id];
+            mem->pools[pool_id] = block;
+
+            return (void*)aligned;
+        }
+
+        void* allocSmall(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
+        {
+            return allocBlock(cinfo, pool_id, sizeofobject);
+        }
+
+        void FAR* allocLarge(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
+        {
+            return allocBlock(cinfo, pool_id, sizeofobject);
+        }
+
+        // row pointers followed by the rows themselves, in one block
+        void** allocRows(j_common_ptr cinfo, int pool_id, size_t rowBytes, JDIMENSION numrows)
+        {
+            // libjpeg-turbo pads rows to twice the alignment, its SIMD upsamplers write that far past the end
+            rowBytes = (rowBytes + 2 * ALIGNMENT - 1) & ~(2 * ALIGNMENT - 1);
+            size_t pointersBytes = alignUp(sizeof(void*) * numrows);
+
+            uint8_t* block = (uint8_t*)allocBlock(cinfo, pool_id, pointersBytes + rowBytes * numrows);
+
+            void** rows = (void**)block;
+            for (JDIMENSION i = 0; i < numrows; i++)
+                rows[i] = block + pointersBytes + rowBytes * i;
+
+            return rows;
+        }
+
+        JSAMPARRAY allocSArray(j_common_ptr cinfo, int pool_id, JDIMENSION samplesperrow, JDIMENSION numrows)
+        {
+            return (JSAMPARRAY)allocRows(cinfo, pool_id, sizeof(JSAMPLE) * samplesperrow, numrows);
+        }
+
+        JBLOCKARRAY allocBArray(j_common_ptr cinfo, int pool_id, JDIMENSION blocksperrow, JDIMENSION numrows)
+        {
+            return (JBLOCKARRAY)allocRows(cinfo, pool_id, sizeof(JBLOCK) * blocksperrow, numrows);
+        }
+
+        VirtualArray* requestVirtualArray(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION rowSize, JDIMENSION numrows, bool isBlockArray)
+        {
+            Manager* mem = (Manager*)cinfo->mem;
+
+            // same restriction as the stock manager
+            if (pool_id != JPOOL_IMAGE)
+                ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+
+            VirtualArray* array = (VirtualArray*)allocBlock(cinfo, pool_id, sizeof(VirtualArray));
+            array->buffer = NULL;
+            array->numRows = numrows;
+            array->rowSize = rowSize;
+            array->preZero = pre_zero;
+            array->isBlockArray = isBlockArray;
+            array->next = mem->virtualArrays;
+            mem->virtualArrays = array;
+
+            return array;
+        }
+
+        jvirt_sarray_ptr requestVirtSArray(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION samplesperrow, JDIMENSION numrows, JDIMENSION maxaccess)
+        {
+            AIL_UNUSED_PARAM(maxaccess);
+            return (jvirt_sarray_ptr)requestVirtualArray(cinfo, pool_id, pre_zero, samplesperrow, numrows, false);
+        }
+
+        jvirt_barray_ptr requestVirtBArray(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION blocksperrow, JDIMENSION numrows, JDIMENSION maxaccess)
+        {
+            AIL_UNUSED_PARAM(maxaccess);
+            return (jvirt_barray_ptr)requestVirtualArray(cinfo, pool_id, pre_zero, blocksperrow, numrows, true);
+        }
+
+        void realizeVirtArrays(j_common_ptr cinfo)
+        {
+            Manager* mem = (Manager*)cinfo->mem;
+
+            for (VirtualArray* array = mem->virtualArrays; array != NULL; array = array->next)
+            {
+                if (array->buffer != NULL)
+                    continue;
+
+                size_t rowBytes = array->isBlockArray ? sizeof(JBLOCK) * array->rowSize : sizeof(JSAMPLE) * array->rowSize;
+                void** rows = allocRows(cinfo, JPOOL_IMAGE, rowBytes, array->numRows);
+
+                if (array->preZero)
+                {
+                    for (JDIMENSION i = 0; i < array->numRows; i++)
+                        memset(rows[i], 0, rowBytes);
+                }
+
+                array->buffer = rows;
+            }
+        }
+
+        void** accessVirtualArray(j_common_ptr cinfo, VirtualArray* array, JDIMENSION start_row, JDIMENSION num_rows)
+        {
+            if (array->buffer == NULL || start_row + num_rows > array->numRows)
+                ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+
+            return (void**)array->buffer + start_row;
+        }
+
+        JSAMPARRAY accessVirtSArray(j_common_ptr cinfo, jvirt_sarray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable)
+        {
+            AIL_UNUSED_PARAM(writable);
+            return (JSAMPARRAY)accessVirtualArray(cinfo, (VirtualArray*)ptr, start_row, num_rows);
+        }
+
+        JBLOCKARRAY accessVirtBArray(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable)
+        {
+            AIL_UNUSED_PARAM(writable);
+            return (JBLOCKARRAY)accessVirtualArray(cinfo, (VirtualArray*)ptr, start_row, num_rows);
+        }
+
+        void freePool(j_common_ptr cinfo, int pool_id)
+        {
+            Manager* mem = (Manager*)cinfo->mem;
+
+            if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
+                ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+
+            // virtual arrays are all in the image pool, and their memory goes with it
+            if (pool_id == JPOOL_IMAGE)
+                mem->virtualArrays = NULL;
+
+            Block* block = mem->pools[pool_id];
+            while (block != NULL)
+            {
+                Block* next = block->next;
+                aimgFree(block->raw);
+                block = next;
+            }
+            mem->pools[pool_id] = NULL;
+
+            // and the same pool in the stock manager
+            cinfo->mem = mem->original;
+            (*cinfo->mem->free_pool)(cinfo, pool_id);
+            cinfo->mem = &mem->pub;
+        }
+
+        void selfDestruct(j_common_ptr cinfo)
+        {
+            Manager* mem = (Manager*)cinfo->mem;
+
+            for (int pool = JPOOL_NUMPOOLS - 1; pool >= JPOOL_PERMANENT; pool--)
+                freePool(cinfo, pool);
+
+            cinfo->mem = mem->original;
+            aimgFree(mem);
+
+            (*cinfo->mem->self_destruct)(cinfo);
+        }
+
+        // Call straight after jpeg_create_compress/jpeg_create_decompress
+        void install(j_common_ptr cinfo)
+        {
+            Manager* mem = (Manager*)aimgMalloc(sizeof(Manager));
+            if (mem == NULL)
+                ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+
+            mem->pub.alloc_small = allocSmall;
+            mem->pub.alloc_large = allocLarge;
+            mem->pub.alloc_sarray = allocSArray;
+            mem->pub.alloc_barray = allocBArray;
+            mem->pub.request_virt_sarray = requestVirtSArray;
+            mem->pub.request_virt_barray = requestVirtBArray;
+            mem->pub.realize_virt_arrays = realizeVirtArrays;
+            mem->pub.access_virt_sarray = accessVirtSArray;
+            mem->pub.access_virt_barray = accessVirtBArray;
+            mem->pub.free_pool = freePool;
+            mem->pub.self_destruct = selfDestruct;
+            mem->pub.max_memory_to_use = cinfo->mem->max_memory_to_use;
+            mem->pub.max_alloc_chunk = cinfo->mem->max_alloc_chunk;
+
+            mem->original = cinfo->mem;
+            for (int pool = 0; pool < JPOOL_NUMPOOLS; pool++)
+                mem->pools[pool] = NULL;
+            mem->virtualArrays = NULL;
+
+            cinfo->mem = &mem->pub;
+        }
+    }
+
+    void setArtomatixSourceMGR(j_decompress_ptr cinfo, InputStream* stream)
     {
         if (cinfo->src == NULL)
         {
             cinfo->src = (jpeg_source_mgr *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(ArtomatixJPEGSourceMGR));
             ((ArtomatixJPEGSourceMGR *)cinfo->src)->data = (void *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT, JPEGConsts::BUFFER_SIZE);
-            ((ArtomatixJPEGSourceMGR *)cinfo->src)->callbackFunctionData = callbackData;
+            ((ArtomatixJPEGSourceMGR *)cinfo->src)->stream = stream;
         }
 
         ArtomatixJPEGSourceMGR * src = (ArtomatixJPEGSourceMGR *)cinfo->src;
@@ -141,7 +384,7 @@ namespace AImg
         src->pub.bytes_in_buffer = 0;
     }
 
-    void setArtomatixDestinationMGR(j_compress_ptr cinfo, CallbackData callbackData)
+    void setArtomatixDestinationMGR(j_compress_ptr cinfo, OutputStream* stream)
     {
         if (cinfo->dest == NULL)
         {
@@ -150,7 +393,7 @@ namespace AImg
         }
 
         ArtomatixJPEGDestinationMGR * src = (ArtomatixJPEGDestinationMGR *)cinfo->dest;
-        src->callbackFunctionData = callbackData;
+        src->stream = stream;
         src->pub.init_destination = JPEGCallbackFunctions::WriteFunctions::initDestination;
         src->pub.empty_output_buffer = JPEGCallbackFunctions::WriteFunctions::emptyOutputBuffer;
         src->pub.term_destination = JPEGCallbackFunctions::WriteFunctions::termDestination;
@@ -163,18 +406,101 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool JPEGImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool JPEGImageLoader::canLoadImage(const uint8_t* header, size_t headerSize)
+    {
+        static const uint8_t magic[] = { 0xFF, 0xD8, 0xFF };
+
+        return headerSize >= 3 && memcmp(header, magic, 3) == 0;
+    }
+
+    // Walks the markers up to the first SOF, picking up the orientation from the first APP1 segment on the way, as JPEGFile does
+    int32_t JPEGImageLoader::probeImage(InputStream* stream, AImgProbeInfo* info)
     {
-        AIL_UNUSED_PARAM(tellCallback);
-        uint8_t magic[] = { 0xFF, 0xD8, 0xFF };
+        const uint8_t markerSOI = 0xD8;
+        const uint8_t markerEOI = 0xD9;
+        const uint8_t markerSOS = 0xDA;
+        const uint8_t markerAPP1 = 0xE1;
 
-        int startingPosition = tellCallback(callbackData);
-        std::vector<uint8_t> header(4);
-        readCallback(callbackData, &header[0], 4);
+        uint8_t buf[4096]; // EXIF orientation lives in IFD0, right at the start of the segment, so this is plenty
 
-        seekCallback(callbackData, startingPosition);
+        if (stream->read(buf, 2) != 2 || buf[0] != 0xFF || buf[1] != markerSOI)
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
 
-        return ((int32_t)memcmp(&header[0], magic, 3)) == 0;
+        bool seenApp1 = false;
+        uint16_t orientation = 0;
+
+        while (true)
+        {
+            // markers can be preceded by any number of 0xFF fill bytes
+            uint8_t marker = 0xFF;
+            if (stream->read(&marker, 1) != 1 || marker != 0xFF)
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+            while (marker == 0xFF)
+            {
+                if (stream->read(&marker, 1) != 1)
+                    return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+            }
+
+            if (marker == markerSOS || marker == markerEOI)
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL; // no frame header before the image data
+
+            // standalone markers, no length
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+                continue;
+
+            if (stream->read(buf, 2) != 2)
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+            int64_t segmentStart = stream->tell();
+            uint16_t length = readUInt16(buf, false);
+            if (length < 2)
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+            bool isSOF = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+
+            if (isSOF)
+            {
+                // precision, height, width, component count
+                if (length < 8 || stream->read(buf, 6) != 6)
+                    return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+                int32_t numComponents = buf[5];
+                if (numComponents < 1 || numComponents > 4)
+                    return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+                int32_t height = readUInt16(buf + 1, false);
+                int32_t width = readUInt16(buf + 3, false);
+
+                // landscape <=> portrait
+                bool rotate = orientation >= 5 && orientation <= 8;
+
+                info->width = rotate ? height : width;
+                info->height = rotate ? width : height;
+                info->numChannels = numComponents;
+                info->bytesPerChannel = 1;
+                info->floatOrInt = AImgFloatOrIntType::FITYPE_INT;
+                info->decodedImgFormat = AImgFormat::_8BITS | AImgFormat::R << (numComponents - 1);
+                info->colourProfileLen = 0;
+
+                return AImgErrorCode::AIMG_SUCCESS;
+            }
+
+            if (marker == markerAPP1 && !seenApp1)
+            {
+                seenApp1 = true;
+
+                int64_t toRead = std::min((int64_t)sizeof(buf), (int64_t)length - 2);
+                int64_t bytesRead = stream->read(buf, toRead);
+
+                int16_t error;
+                uint16_t flag = JpegExifHandler::ParseOrientationField(buf, (size_t)std::max(bytesRead, (int64_t)0), &error);
+                if (error == AIMG_SUCCESS)
+                    orientation = flag;
+            }
+
+            stream->seek(segmentStart + length - 2);
+        }
     }
 
     std::string JPEGImageLoader::getFileExtension()
@@ -194,30 +520,44 @@ namespace AImg
         ArtomatixErrorStruct err_mgr;
         int orientation_flag;
 
+        // The format scanlines come out in, between startRowDecode and the end of decoding
+        int32_t rowDecodeFormat = AImgFormat::INVALID_FORMAT;
+
+        // The encoder, between startWriteRows and finishWriteRows/abortWriteRows
+        jpeg_compress_struct jpeg_write_struct;
+        ArtomatixErrorStruct write_err_mgr;
+        bool compressing = false;
+
         std::shared_ptr<IExifHandler> exifData;
     public:
 
         JPEGFile()
         {
+            jpeg_read_struct.err = jpeg_std_error(&err_mgr.pub);
             jpeg_create_decompress(&jpeg_read_struct);
+            JPEGMemoryManager::install((j_common_ptr)&jpeg_read_struct);
 
             exifData = std::make_shared<JpegExifHandler>(&jpeg_read_struct);
         }
 
         virtual ~JPEGFile()
         {
+            destroyCompress();
             jpeg_destroy_decompress(&jpeg_read_struct);
         }
 
-        int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        int32_t openImage(InputStream* stream)
         {
-            CallbackData data;
-            data.callbackData = callbackData;
-            data.readCallback = readCallback;
-            data.tellCallback = tellCallback;
-            data.seekCallback = seekCallback;
-
-            setArtomatixSourceMGR(&jpeg_read_struct, data);
+            // libjpeg can decode directly out of a memory buffer, so don't bother copying through our own source manager if we have one
+            if (stream->getMemory())
+            {
+                size_t startPos = (size_t)stream->tell();
+                jpeg_mem_src(&jpeg_read_struct, (unsigned char *)stream->getMemory() + startPos, (unsigned long)(stream->getMemorySize() - startPos));
+            }
+            else
+            {
+                setArtomatixSourceMGR(&jpeg_read_struct, stream);
+            }
             jpeg_read_struct.err = jpeg_std_error(&err_mgr.pub);
 
             ArtomatixErrorStruct jerr;
@@ -304,19 +644,51 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
+        // libjpeg can colour convert straight to some of the formats AImgConvertFormat would otherwise be needed for, giving
+        // exactly the same pixels: grey can come out as RGB, and with libjpeg-turbo, grey or colour can come out as RGBA with
+        // an opaque alpha. Asking for grey from a colour image gives luma rather than the red channel AImgConvertFormat keeps,
+        // so that's left to AImgConvertFormat. Sets out_color_space if outputFormat can be reached, and returns the format
+        // scanlines will come out in. Has to be called before jpeg_start_decompress.
+        int32_t setOutColourSpace(int32_t outputFormat)
         {
-            void* destBuffer = realDestBuffer;
+            int32_t decodeFormat = AImgFormat::_8BITS | AImgFormat::R << (jpeg_read_struct.num_components - 1);
 
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != AImgFormat::RGB8U)
+            bool greyOrRgb = jpeg_read_struct.out_color_space == JCS_GRAYSCALE || jpeg_read_struct.out_color_space == JCS_RGB;
+            if (!greyOrRgb || outputFormat == AImgFormat::INVALID_FORMAT || outputFormat == decodeFormat)
+                return decodeFormat;
+
+            if (outputFormat == AImgFormat::RGB8U && jpeg_read_struct.out_color_space == JCS_GRAYSCALE)
             {
-                int32_t numChannels, bytesPerChannel, floatOrInt;
-                AIGetFormatDetails(AImgFormat::RGB8U, &numChannels, &bytesPerChannel, &floatOrInt);
+                jpeg_read_struct.out_color_space = JCS_RGB;
+                return outputFormat;
+            }
 
-                convertTmpBuffer.resize(jpeg_read_struct.image_width * jpeg_read_struct.image_height * bytesPerChannel * numChannels);
-                destBuffer = &convertTmpBuffer[0];
+#ifdef JCS_ALPHA_EXTENSIONS
+            if (outputFormat == AImgFormat::RGBA8U)
+            {
+                jpeg_read_struct.out_color_space = JCS_EXT_RGBA;
+                return outputFormat;
             }
+#endif
+
+            return decodeFormat;
+        }
+
+        virtual int32_t decodeRegion(int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, void *realDestBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat)
+        {
+            // Read after the setjmps below, so kept out of registers that a longjmp could leave stale
+            volatile int32_t decodeFormat = setOutColourSpace(forceImageFormat);
+            volatile int32_t outputFormat = forceImageFormat == AImgFormat::INVALID_FORMAT ? (int32_t)decodeFormat : forceImageFormat;
+            bool reorient = this->orientation_flag > 1 && this->orientation_flag <= 8;
+
+            // The region is in reoriented coordinates, so find where it comes from in the image as stored
+            int32_t storedX, storedY, storedWidth, storedHeight;
+            orientedRegionToStored(reorient ? this->orientation_flag : 1, jpeg_read_struct.image_width, jpeg_read_struct.image_height,
+                x, y, regionWidth, regionHeight, &storedX, &storedY, &storedWidth, &storedHeight);
+
+            // Scanlines go through a band that crops, converts and reorients them as they're decoded, so each band lands
+            // straight where it belongs in the caller's buffer
+            ConvertBand band;
 
             ArtomatixErrorStruct jerr;
             jpeg_read_struct.err = jpeg_std_error(&jerr.pub);
@@ -327,50 +699,123 @@ namespace AImg
 
             if (setjmp(err_ptr->buf))
             {
-                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeImage] jpeg_start_decompress failed!";
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeRegion] jpeg_start_decompress failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
             jpeg_start_decompress(&jpeg_read_struct);
 
-            int row_stride = jpeg_read_struct.output_components * jpeg_read_struct.output_width;
+            JDIMENSION firstColumn = 0;
+            JDIMENSION decodedWidth = jpeg_read_struct.output_width;
 
-            JSAMPROW buffer[1];
+#ifdef LIBJPEG_TURBO_VERSION
+            // libjpeg-turbo can leave out whole iMCU columns, and skip rows without colour converting or upsampling them.
+            // The crop is widened out to iMCU boundaries, so it may start to the left of the region. Chroma upsampling at
+            // the edges of a crop uses the edge samples rather than their neighbours, so we ask for an extra iMCU each side
+            // to keep the pixels in the region identical to a full decode.
+            if (storedX != 0 || storedWidth != (int32_t)jpeg_read_struct.output_width)
+            {
+                int32_t margin = jpeg_read_struct.max_h_samp_factor * DCTSIZE;
+                firstColumn = std::max(storedX - margin, 0);
+                decodedWidth = std::min(storedX + storedWidth + margin, (int32_t)jpeg_read_struct.output_width) - firstColumn;
+                jpeg_crop_scanline(&jpeg_read_struct, &firstColumn, &decodedWidth);
+            }
+
+            if (storedY > 0)
+                jpeg_skip_scanlines(&jpeg_read_struct, storedY);
+#endif
 
-            buffer[0] = (JSAMPROW)destBuffer;
+            band.init(decodedWidth, storedX - firstColumn, storedWidth, storedHeight, decodeFormat, outputFormat, realDestBuffer, rowPitchBytes,
+                reorient ? this->orientation_flag : 1);
+
+            JSAMPROW buffer[1];
 
             if (setjmp(err_ptr->buf))
             {
-                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeImage] jpeg_read_scanlines failed!";
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeRegion] jpeg_read_scanlines failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
-            while (jpeg_read_struct.output_scanline < jpeg_read_struct.output_height)
+            // Rows above the region that couldn't be skipped are decoded to where the first row of the region will go, and
+            // overwritten by it
+            while (jpeg_read_struct.output_scanline < (JDIMENSION)storedY)
             {
+                buffer[0] = (JSAMPROW)band.nextRow();
                 jpeg_read_scanlines(&jpeg_read_struct, buffer, 1);
-                buffer[0] = (uint8_t *)buffer[0] + row_stride;
             }
 
-            jpeg_finish_decompress(&jpeg_read_struct);
-
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != AImgFormat::RGB8U)
+            for (int32_t row = 0; row < storedHeight; row++)
             {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, jpeg_read_struct.image_width, jpeg_read_struct.image_height, AImgFormat::RGB8U, forceImageFormat);
+                buffer[0] = (JSAMPROW)band.nextRow();
+                jpeg_read_scanlines(&jpeg_read_struct, buffer, 1);
+
+                int32_t err = band.rowsDecoded(1);
                 if (err != AImgErrorCode::AIMG_SUCCESS)
+                {
+                    jpeg_abort_decompress(&jpeg_read_struct);
                     return err;
+                }
             }
 
-            if (this->orientation_flag > 1 && this->orientation_flag <= 8)
+            // Rows below the region are never decoded
+            if (jpeg_read_struct.output_scanline == jpeg_read_struct.output_height)
+                jpeg_finish_decompress(&jpeg_read_struct);
+            else
+                jpeg_abort_decompress(&jpeg_read_struct);
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual bool canDecodeRows()
+        {
+            // reorienting needs the whole image
+            return this->orientation_flag <= 1 || this->orientation_flag > 8;
+        }
+
+        // The error manager has to outlive a single call here, as libjpeg holds on to it between reading rows
+        void setRowDecodeErrorHandlers()
+        {
+            jpeg_read_struct.err = jpeg_std_error(&err_mgr.pub);
+            jpeg_read_struct.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
+            jpeg_read_struct.err->error_exit = JPEGCallbackFunctions::handleFatalError;
+        }
+
+        virtual int32_t startRowDecode(int32_t forceImageFormat)
+        {
+            setRowDecodeErrorHandlers();
+            rowDecodeFormat = setOutColourSpace(forceImageFormat);
+
+            if (setjmp(err_mgr.buf))
             {
-                int32_t err = AImgConvertOrientation(
-                    destBuffer,
-                    realDestBuffer,
-                    jpeg_read_struct.image_width,
-                    jpeg_read_struct.image_height,
-                    AImgFormat::RGB8U,
-                    forceImageFormat,
-                    this->orientation_flag);
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::startRowDecode] jpeg_start_decompress failed!";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
+
+            jpeg_start_decompress(&jpeg_read_struct);
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t decodeRows(int32_t /*firstRow*/, int32_t rowCount, void *realDestBuffer, size_t rowPitchBytes, int32_t forceImageFormat)
+        {
+            int32_t outputFormat = forceImageFormat == AImgFormat::INVALID_FORMAT ? rowDecodeFormat : forceImageFormat;
+
+            ConvertBand band;
+            band.init(jpeg_read_struct.output_width, 0, jpeg_read_struct.output_width, rowCount, rowDecodeFormat, outputFormat, realDestBuffer, rowPitchBytes);
+
+            if (setjmp(err_mgr.buf))
+            {
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::decodeRows] jpeg_read_scanlines failed!";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
 
+            JSAMPROW buffer[1];
+            for (int32_t row = 0; row < rowCount; row++)
+            {
+                buffer[0] = (JSAMPROW)band.nextRow();
+                jpeg_read_scanlines(&jpeg_read_struct, buffer, 1);
+
+                int32_t err = band.rowsDecoded(1);
                 if (err != AImgErrorCode::AIMG_SUCCESS)
                     return err;
             }
@@ -378,77 +823,118 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+        virtual void finishRowDecode()
         {
-            AIL_UNUSED_PARAM(encodingOptions);
-            AIL_UNUSED_PARAM(outputFormat);
+            if (setjmp(err_mgr.buf))
+                return;
 
-            std::vector<uint8_t> convertBuffer(0);
-            if (inputFormat != AImgFormat::RGB8U)
-            {
-                convertBuffer.resize(width * height * 3);
-
-                int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, AImgFormat::RGB8U);
+            if (jpeg_read_struct.output_scanline == jpeg_read_struct.output_height)
+                jpeg_finish_decompress(&jpeg_read_struct);
+            else
+                jpeg_abort_decompress(&jpeg_read_struct);
+        }
 
-                if (convertError != AImgErrorCode::AIMG_SUCCESS)
-                    return convertError;
-                data = &convertBuffer[0];
+        void destroyCompress()
+        {
+            if (compressing)
+            {
+                jpeg_destroy_compress(&jpeg_write_struct);
+                compressing = false;
             }
+        }
 
-            CallbackData dataStruct;
-            dataStruct.writeCallback = writeCallback;
-            dataStruct.tellCallback = tellCallback;
-            dataStruct.seekCallback = seekCallback;
-            dataStruct.callbackData = callbackData;
+        virtual bool canWriteRows()
+        {
+            return true;
+        }
 
-            ArtomatixErrorStruct jerr;
-            jpeg_compress_struct cinfo;
-            cinfo.err = jpeg_std_error(&jerr.pub);
-            cinfo.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
-            cinfo.err->error_exit = JPEGCallbackFunctions::handleFatalError;
-            jpeg_create_compress(&cinfo);
+        virtual int32_t startWriteRows(int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+            const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+            OutputStream* stream, void* encodingOptions)
+        {
+            AIL_UNUSED_PARAM(inputFormat);
+            AIL_UNUSED_PARAM(outputFormat);
+            AIL_UNUSED_PARAM(profileName);
+            AIL_UNUSED_PARAM(colourProfile);
+            AIL_UNUSED_PARAM(colourProfileLen);
+            AIL_UNUSED_PARAM(encodingOptions);
 
-            setArtomatixDestinationMGR(&cinfo, dataStruct);
+            // libjpeg holds on to the error manager between writing rows, so it's a member rather than on the stack
+            jpeg_write_struct.err = jpeg_std_error(&write_err_mgr.pub);
+            jpeg_write_struct.err->emit_message = JPEGCallbackFunctions::lessAnnoyingEmitMessage;
+            jpeg_write_struct.err->error_exit = JPEGCallbackFunctions::handleFatalError;
+            jpeg_create_compress(&jpeg_write_struct);
+            JPEGMemoryManager::install((j_common_ptr)&jpeg_write_struct);
+            compressing = true;
 
-            cinfo.image_width = width;
-            cinfo.image_height = height;
-            cinfo.input_components = 3;
-            cinfo.in_color_space = JCS_RGB;
+            setArtomatixDestinationMGR(&jpeg_write_struct, stream);
 
-            jpeg_set_defaults(&cinfo);
+            jpeg_write_struct.image_width = width;
+            jpeg_write_struct.image_height = height;
+            jpeg_write_struct.input_components = 3;
+            jpeg_write_struct.in_color_space = JCS_RGB;
 
-            jpeg_set_quality(&cinfo, JPEGConsts::Quality, TRUE);
+            jpeg_set_defaults(&jpeg_write_struct);
 
-            if (setjmp(jerr.buf))
+            jpeg_set_quality(&jpeg_write_struct, JPEGConsts::Quality, TRUE);
+
+            if (setjmp(write_err_mgr.buf))
             {
-                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::writeImage] jpeg_start_compress failed!";
+                destroyCompress();
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::startWriteRows] jpeg_start_compress failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
-            jpeg_start_compress(&cinfo, TRUE);
+            jpeg_start_compress(&jpeg_write_struct, TRUE);
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
 
-            int row_stride = width * cinfo.input_components;
+        virtual int32_t writeRowBand(const AImgWriteSource& source, int32_t rowCount)
+        {
+            WriteSourceRows rows(source, jpeg_write_struct.image_width, AImgFormat::RGB8U);
 
             JSAMPROW row_pointer[1];
 
-            if (setjmp(jerr.buf))
+            if (setjmp(write_err_mgr.buf))
             {
-                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::writeImage] jpeg_write_scanlines failed!";
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::writeRowBand] jpeg_write_scanlines failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
-            while (cinfo.next_scanline < cinfo.image_height)
+            for (int32_t y = 0; y < rowCount; y++)
+            {
+                const uint8_t* row;
+                int32_t err = rows.getRow(y, &row);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
+
+                row_pointer[0] = (JSAMPROW)row;
+                jpeg_write_scanlines(&jpeg_write_struct, row_pointer, 1);
+            }
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t finishWriteRows()
+        {
+            if (setjmp(write_err_mgr.buf))
             {
-                row_pointer[0] = (uint8_t *)data + row_stride * cinfo.next_scanline;
-                jpeg_write_scanlines(&cinfo, row_pointer, 1);
+                destroyCompress();
+                mErrorDetails = "[AImg::JPEGImageLoader::JPEGFile::finishWriteRows] jpeg_finish_compress failed!";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
-            jpeg_finish_compress(&cinfo);
-            jpeg_destroy_compress(&cinfo);
+            jpeg_finish_compress(&jpeg_write_struct);
+            destroyCompress();
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
+        virtual void abortWriteRows()
+        {
+            destroyCompress();
+        }
+
         virtual bool SupportsExif() const noexcept override
         {
             return true;
@@ -5,9 +5,11 @@
 #include "AIL_internal.h"
 #include <vector>
 #include <png.h>
+#include <zlib.h>
 #include <string.h>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 
 namespace AImg
 {
@@ -16,31 +18,25 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool PNGImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool PNGImageLoader::canLoadImage(const uint8_t* header, size_t headerSize)
     {
-        int32_t startingPosition = tellCallback(callbackData);
-        std::vector<uint8_t> header(8);
-        readCallback(callbackData, &header[0], 8);
+        static const uint8_t png_signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
 
-        seekCallback(callbackData, startingPosition);
-
-        uint8_t png_signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
-
-        return ((int32_t)(memcmp(&header[0], &png_signature[0], 8))) == 0;
+        return headerSize >= 8 && memcmp(header, png_signature, 8) == 0;
     }
 
     void png_custom_read_data(png_struct* png_ptr, png_byte* data, png_size_t length)
     {
-        CallbackData callbackData = *((CallbackData *)png_get_io_ptr(png_ptr));
+        InputStream* stream = (InputStream*)png_get_io_ptr(png_ptr);
 
-        callbackData.readCallback(callbackData.callbackData, data, (int32_t)length);
+        stream->read(data, (int64_t)length);
     }
 
     void png_custom_write_data(png_struct* png_ptr, png_byte* data, png_size_t length)
     {
-        CallbackData callbackData = *((CallbackData *)png_get_io_ptr(png_ptr));
+        OutputStream* stream = (OutputStream*)png_get_io_ptr(png_ptr);
 
-        callbackData.writeCallback(callbackData.callbackData, data, (int32_t)length);
+        stream->write(data, (int64_t)length);
     }
 
     std::string PNGImageLoader::getFileExtension()
@@ -107,10 +103,225 @@ namespace AImg
         return AImgFormat::INVALID_FORMAT;
     }
 
+    // libpng allocates everything through these once they're passed to png_create_*_struct_2
+    png_voidp pngMalloc(png_structp png_ptr, png_alloc_size_t size)
+    {
+        AIL_UNUSED_PARAM(png_ptr);
+        return aimgMalloc(size);
+    }
+
+    void pngFree(png_structp png_ptr, png_voidp ptr)
+    {
+        AIL_UNUSED_PARAM(png_ptr);
+        aimgFree(ptr);
+    }
+
+    int32_t getDecodeFormatPNG(uint8_t bit_depth, uint8_t numChannels)
+    {
+        if (bit_depth == 8)
+        {
+            if (numChannels == 1)
+                return AImgFormat::R8U;
+            else if (numChannels == 2)
+                return AImgFormat::RG8U;
+            else if (numChannels == 3)
+                return AImgFormat::RGB8U;
+            else if (numChannels == 4)
+                return AImgFormat::RGBA8U;
+        }
+
+        else if (bit_depth == 16)
+        {
+            if (numChannels == 1)
+                return AImgFormat::R16U;
+            else if (numChannels == 2)
+                return AImgFormat::RG16U;
+            else if (numChannels == 3)
+                return AImgFormat::RGB16U;
+            else if (numChannels == 4)
+                return AImgFormat::RGBA16U;
+        }
+
+        return AImgFormat::INVALID_FORMAT;
+    }
+
+    namespace
+    {
+        // A fixed block of stack memory for zlib to allocate from, so probing an iCCP chunk doesn't touch the heap.
+        // Big enough for inflate's state plus the largest (32KB) window.
+        struct ZlibArena
+        {
+            alignas(16) uint8_t memory[48 * 1024];
+            size_t used = 0;
+        };
+
+        voidpf zlibArenaAlloc(voidpf opaque, uInt items, uInt size)
+        {
+            ZlibArena* arena = (ZlibArena*)opaque;
+
+            size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+            if (arena->used + bytes > sizeof(arena->memory))
+                return Z_NULL;
+
+            voidpf ptr = arena->memory + arena->used;
+            arena->used += bytes;
+            return ptr;
+        }
+
+        void zlibArenaFree(voidpf, voidpf)
+        {
+        }
+
+        // Returns the decompressed size of the profile in an iCCP chunk, which is what png_get_iCCP reports.
+        // Every ICC profile starts with its own size as a big endian uint32, so we only need to inflate 4 bytes.
+        uint32_t probeICCProfileLength(InputStream* stream, uint32_t chunkLength)
+        {
+            uint8_t buf[256];
+            uint32_t remaining = chunkLength;
+
+            uint32_t toRead = std::min(remaining, (uint32_t)sizeof(buf));
+            if (stream->read(buf, toRead) != toRead)
+                return 0;
+            remaining -= toRead;
+
+            // profile name (1-79 bytes), null terminator, compression method (always 0)
+            const uint8_t* nameEnd = (const uint8_t*)memchr(buf, 0, std::min(toRead, (uint32_t)80));
+            if (nameEnd == NULL || nameEnd == buf || (uint32_t)(nameEnd - buf) + 2 > toRead || nameEnd[1] != 0)
+                return 0;
+
+            ZlibArena arena;
+            z_stream zs = {};
+            zs.zalloc = zlibArenaAlloc;
+            zs.zfree = zlibArenaFree;
+            zs.opaque = &arena;
+
+            if (inflateInit(&zs) != Z_OK)
+                return 0;
+
+            uint8_t profileHeader[4];
+            zs.next_in = (Bytef*)nameEnd + 2;
+            zs.avail_in = (uInt)(toRead - (uint32_t)(nameEnd - buf) - 2);
+            zs.next_out = profileHeader;
+            zs.avail_out = sizeof(profileHeader);
+
+            while (zs.avail_out > 0)
+            {
+                if (zs.avail_in == 0)
+                {
+                    if (remaining == 0)
+                        break;
+
+                    toRead = std::min(remaining, (uint32_t)sizeof(buf));
+                    if (stream->read(buf, toRead) != toRead)
+                        break;
+                    remaining -= toRead;
+
+                    zs.next_in = buf;
+                    zs.avail_in = toRead;
+                }
+
+                int err = inflate(&zs, Z_SYNC_FLUSH);
+                if (err != Z_OK && err != Z_BUF_ERROR)
+                    break;
+            }
+
+            bool gotHeader = zs.avail_out == 0;
+            inflateEnd(&zs);
+
+            return gotHeader ? readUInt32(profileHeader, false) : 0;
+        }
+    }
+
+    // Reads IHDR, then the chunks up to the first IDAT, and works out the same channel count, bit depth and profile as PNGFile::openImage
+    int32_t PNGImageLoader::probeImage(InputStream* stream, AImgProbeInfo* info)
+    {
+        uint8_t buf[25];
+
+        // signature + IHDR length/type + IHDR data (13 bytes)
+        if (stream->read(buf, 8) != 8 || stream->read(buf, 21) != 21 || memcmp(buf + 4, "IHDR", 4) != 0)
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+        uint32_t width = readUInt32(buf + 8, false);
+        uint32_t height = readUInt32(buf + 12, false);
+        uint8_t bit_depth = buf[16];
+        uint8_t colour_type = buf[17];
+
+        uint8_t numChannels;
+        switch (colour_type)
+        {
+        case PNG_COLOR_TYPE_GRAY: numChannels = 1; break;
+        case PNG_COLOR_TYPE_GRAY_ALPHA: numChannels = 2; break;
+        case PNG_COLOR_TYPE_RGB: numChannels = 3; break;
+        case PNG_COLOR_TYPE_PALETTE: numChannels = 1; break;
+        case PNG_COLOR_TYPE_RGB_ALPHA: numChannels = 4; break;
+        default: return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+        }
+
+        // skip the IHDR crc
+        stream->seek(stream->tell() + 4);
+
+        bool hasTransparency = false;
+        bool hasProfile = false;
+        uint32_t profileLen = 0;
+
+        while (true)
+        {
+            if (stream->read(buf, 8) != 8)
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+            uint32_t chunkLength = readUInt32(buf, false);
+            int64_t chunkEnd = stream->tell() + chunkLength + 4; // + crc
+
+            if (memcmp(buf + 4, "IDAT", 4) == 0 || memcmp(buf + 4, "IEND", 4) == 0)
+                break;
+
+            if (memcmp(buf + 4, "tRNS", 4) == 0)
+            {
+                hasTransparency = true;
+            }
+            else if (memcmp(buf + 4, "iCCP", 4) == 0 && !hasProfile)
+            {
+                hasProfile = true;
+                profileLen = probeICCProfileLength(stream, chunkLength);
+            }
+
+            stream->seek(chunkEnd);
+        }
+
+        // the same adjustments as PNGFile::openImage
+        if (colour_type == PNG_COLOR_TYPE_PALETTE)
+        {
+            bit_depth = 8;
+            numChannels = 3;
+        }
+        if (colour_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+            bit_depth = 8;
+
+        bool numChannelsChanged = false;
+
+        if (hasTransparency)
+            numChannels++;
+
+        if ((hasTransparency && colour_type == PNG_COLOR_TYPE_GRAY) || colour_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        {
+            numChannels = 4;
+            numChannelsChanged = true;
+        }
+
+        info->width = (int32_t)width;
+        info->height = (int32_t)height;
+        info->numChannels = numChannels;
+        info->bytesPerChannel = bit_depth / 8 == 0 ? -1 : bit_depth / 8;
+        info->floatOrInt = AImgFloatOrIntType::FITYPE_INT;
+        info->decodedImgFormat = getDecodeFormatPNG(bit_depth, numChannels);
+        info->colourProfileLen = numChannelsChanged ? 0 : profileLen;
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
     class PNGFile : public AImgBase
     {
     public:
-        CallbackData * data = nullptr;
         png_info * png_info_ptr = nullptr;
         png_struct * png_read_ptr = nullptr;
         uint32_t width;
@@ -125,15 +336,18 @@ namespace AImg
         uint8_t * compressedProfile = NULL;
         uint32_t compressedProfileLen = 0;
 
-        PNGFile()
-        {
-            data = new CallbackData();
-        }
+        // The format libpng gives rows in, between startRowDecode and the end of decoding
+        int32_t rowDecodeFormat = AImgFormat::INVALID_FORMAT;
+
+        // The encoder, between startWriteRows and finishWriteRows/abortWriteRows
+        png_struct * png_write_ptr = nullptr;
+        png_info * png_write_info_ptr = nullptr;
+        int32_t writeWidth = 0;
+        int32_t writeFormat = AImgFormat::INVALID_FORMAT;
 
         virtual ~PNGFile()
         {
-            if (data)
-                delete data;
+            destroyWriteStruct();
 
             if (png_info_ptr)
             {
@@ -142,18 +356,13 @@ namespace AImg
             }
         }
 
-        int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        int32_t openImage(InputStream* stream)
         {
-            data->readCallback = readCallback;
-            data->tellCallback = tellCallback;
-            data->seekCallback = seekCallback;
-            data->callbackData = callbackData;
-
-            png_read_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+            png_read_ptr = png_create_read_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, pngMalloc, pngFree);
             png_set_option(png_read_ptr, PNG_SKIP_sRGB_CHECK_PROFILE, PNG_OPTION_OFF);
             png_info_ptr = png_create_info_struct(png_read_ptr);
 
-            png_set_read_fn(png_read_ptr, (void *)(data), png_custom_read_data);
+            png_set_read_fn(png_read_ptr, (void *)stream, png_custom_read_data);
             png_read_info(png_read_ptr, png_info_ptr);
 
             width = png_get_image_width(png_read_ptr, png_info_ptr);
@@ -255,75 +464,157 @@ namespace AImg
 
         int32_t getDecodeFormat()
         {
-            if (bit_depth == 8)
-            {
-                if (numChannels == 1)
-                    return AImgFormat::R8U;
-                else if (numChannels == 2)
-                    return AImgFormat::RG8U;
-                else if (numChannels == 3)
-                    return AImgFormat::RGB8U;
-                else if (numChannels == 4)
-                    return AImgFormat::RGBA8U;
-            }
-
-            else if (bit_depth == 16)
-            {
-                if (numChannels == 1)
-                    return AImgFormat::R16U;
-                else if (numChannels == 2)
-                    return AImgFormat::RG16U;
-                else if (numChannels == 3)
-                    return AImgFormat::RGB16U;
-                else if (numChannels == 4)
-                    return AImgFormat::RGBA16U;
-            }
-
-            return AImgFormat::INVALID_FORMAT;
+            return getDecodeFormatPNG(bit_depth, numChannels);
         }
 
-        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
+        // libpng can do some conversions itself while it decodes, giving exactly what AImgConvertFormat would: widening 8 bit
+        // channels to 16 (v * 257), copying grey out to RGB, adding an opaque alpha channel and dropping alpha. Narrowing to
+        // 8 bits can't be done this way, as png_set_strip_16 and png_set_scale_16 both round differently.
+        // Sets up the transforms for outputFormat if it can be reached with them, and returns the format rows will come out in.
+        int32_t setDecodeTransforms(int32_t outputFormat)
         {
-            if (!IsMachineBigEndian())
+            int32_t decodeFormat = getDecodeFormat();
+
+            if (outputFormat != AImgFormat::INVALID_FORMAT && outputFormat != decodeFormat)
             {
-                if (bit_depth > 8)
+                int32_t outChannels, outBytesPerChannel, outFloatOrInt;
+                AIGetFormatDetails(outputFormat, &outChannels, &outBytesPerChannel, &outFloatOrInt);
+
+                bool reachable = outFloatOrInt == AImgFloatOrIntType::FITYPE_INT && outBytesPerChannel * 8 >= bit_depth &&
+                    (outChannels == numChannels ||
+                    (numChannels == 1 && (outChannels == 3 || outChannels == 4)) ||
+                    (numChannels == 3 && outChannels == 4) ||
+                    (numChannels == 4 && outChannels == 3));
+
+                if (reachable)
                 {
-                    png_set_swap(png_read_ptr);
+                    if (outBytesPerChannel == 2 && bit_depth == 8)
+                        png_set_expand_16(png_read_ptr);
+
+                    if (numChannels == 1 && outChannels > 1)
+                        png_set_gray_to_rgb(png_read_ptr);
+
+                    if (numChannels < 4 && outChannels == 4)
+                        png_set_filler(png_read_ptr, 0xffff, PNG_FILLER_AFTER);
+
+                    if (numChannels == 4 && outChannels == 3)
+                        png_set_strip_alpha(png_read_ptr);
+
+                    decodeFormat = outputFormat;
                 }
             }
 
+            int32_t decodeNumChannels, decodeBytesPerChannel, decodeFloatOrInt;
+            AIGetFormatDetails(decodeFormat, &decodeNumChannels, &decodeBytesPerChannel, &decodeFloatOrInt);
+
+            if (!IsMachineBigEndian() && decodeBytesPerChannel == 2)
+                png_set_swap(png_read_ptr);
+
+            return decodeFormat;
+        }
+
+        virtual int32_t decodeRegion(int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, void *realDestBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat)
+        {
+            int32_t decodeFormat = setDecodeTransforms(forceImageFormat);
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = decodeFormat;
+
+            int32_t decodeNumChannels, decodeBytesPerChannel, decodeFloatOrInt;
+            AIGetFormatDetails(decodeFormat, &decodeNumChannels, &decodeBytesPerChannel, &decodeFloatOrInt);
+            size_t pixelSize = (size_t)decodeBytesPerChannel * decodeNumChannels;
+            size_t rowSize = pixelSize * width;
+
+            bool interlaced = png_get_interlace_type(png_read_ptr, png_info_ptr) != PNG_INTERLACE_NONE;
+
+            // Every pass of an interlaced image covers all of it, so it has to be decoded into a whole image temporary, and the
+            // region converted out of that, unless the caller wants all of it as it is. Otherwise rows go through a band that
+            // crops and converts them as they're decoded.
+            bool interlacedDirect = interlaced && regionWidth == (int32_t)width && regionHeight == (int32_t)height && decodeFormat == forceImageFormat;
+
+            ScratchBuffer interlacedBuffer;
+            ConvertBand band;
+            if (interlaced && !interlacedDirect)
+                interlacedBuffer.resize(rowSize * height);
+            else if (!interlaced)
+                band.init(width, x, regionWidth, regionHeight, decodeFormat, forceImageFormat, realDestBuffer, rowPitchBytes);
+
             // This sets a restore point for libpng if reading fails internally
             // Crazy old C exceptions without exceptions
             if (setjmp(png_jmpbuf(png_read_ptr)))
             {
-                mErrorDetails = "[PNGImageLoader::PNGFile::decodeImage] Failed to read file";
+                mErrorDetails = "[PNGImageLoader::PNGFile::decodeRegion] Failed to read file";
                 return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
             }
 
-            void* destBuffer = realDestBuffer;
+            if (interlaced)
+            {
+                // The row pointers go straight to the caller's rows (which run backwards for bottom up) when they can
+                uint8_t* rowsStart = interlacedDirect ? (uint8_t*)realDestBuffer : interlacedBuffer.data();
+                ptrdiff_t rowsPitch = interlacedDirect ? rowPitchBytes : (ptrdiff_t)rowSize;
 
-            int32_t decodeFormat = getDecodeFormat();
+                Vector<png_bytep> ptrs(height);
+
+                for (uint32_t row = 0; row < height; row++)
+                    ptrs[row] = rowsStart + row * rowsPitch;
+
+                png_read_image(png_read_ptr, &ptrs[0]);
+
+                if (interlacedDirect)
+                    return AImgErrorCode::AIMG_SUCCESS;
 
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+                const uint8_t* regionStart = interlacedBuffer.data() + y * rowSize + x * pixelSize;
+                return convertFormatStrided(regionStart, rowSize, realDestBuffer, rowPitchBytes, regionWidth, regionHeight, decodeFormat, forceImageFormat);
+            }
+
+            // Rows above the region still have to be inflated, but they all go where the first row of the region will, and
+            // are overwritten by it. Rows below the region aren't read at all.
+            for (int32_t row = 0; row < y; row++)
+                png_read_row(png_read_ptr, band.nextRow(), NULL);
+
+            for (int32_t row = 0; row < regionHeight; row++)
             {
-                int32_t numChannels, bytesPerChannel, floatOrInt;
-                AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+                png_read_row(png_read_ptr, band.nextRow(), NULL);
 
-                convertTmpBuffer.resize(width * height * bytesPerChannel * numChannels);
-                destBuffer = &convertTmpBuffer[0];
+                int32_t err = band.rowsDecoded(1);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
             }
 
-            std::vector<void*> ptrs(height);
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
 
-            for (uint32_t y = 0; y < height; y++)
-                ptrs[y] = (void *)((size_t)destBuffer + (y*width * (bit_depth / 8) * numChannels));
+        virtual bool canDecodeRows()
+        {
+            // every pass of an interlaced image covers all of it
+            return png_get_interlace_type(png_read_ptr, png_info_ptr) == PNG_INTERLACE_NONE;
+        }
 
-            png_read_image(png_read_ptr, (png_bytepp)&ptrs[0]);
+        virtual int32_t startRowDecode(int32_t forceImageFormat)
+        {
+            rowDecodeFormat = setDecodeTransforms(forceImageFormat);
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t decodeRows(int32_t /*firstRow*/, int32_t rowCount, void *realDestBuffer, size_t rowPitchBytes, int32_t forceImageFormat)
+        {
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = rowDecodeFormat;
 
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+            ConvertBand band;
+            band.init(width, 0, width, rowCount, rowDecodeFormat, forceImageFormat, realDestBuffer, rowPitchBytes);
+
+            if (setjmp(png_jmpbuf(png_read_ptr)))
+            {
+                mErrorDetails = "[PNGImageLoader::PNGFile::decodeRows] Failed to read file";
+                return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+            }
+
+            for (int32_t row = 0; row < rowCount; row++)
             {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
+                png_read_row(png_read_ptr, band.nextRow(), NULL);
+
+                int32_t err = band.rowsDecoded(1);
                 if (err != AImgErrorCode::AIMG_SUCCESS)
                     return err;
             }
@@ -331,16 +622,24 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
-            const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+        void destroyWriteStruct()
+        {
+            if (png_write_ptr)
+                png_destroy_write_struct(&png_write_ptr, &png_write_info_ptr);
+        }
+
+        virtual bool canWriteRows()
         {
-            AIL_UNUSED_PARAM(tellCallback);
-            AIL_UNUSED_PARAM(seekCallback);
+            return true;
+        }
 
-            png_struct * png_write_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        virtual int32_t startWriteRows(int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+            const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+            OutputStream* stream, void* encodingOptions)
+        {
+            png_write_ptr = png_create_write_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, pngMalloc, pngFree);
             png_set_option(png_write_ptr, PNG_SKIP_sRGB_CHECK_PROFILE, PNG_OPTION_OFF);
-            png_info * png_info_ptr = png_create_info_struct(png_write_ptr);
+            png_write_info_ptr = png_create_info_struct(png_write_ptr);
 
             if (encodingOptions != NULL)
             {
@@ -350,28 +649,15 @@ namespace AImg
                 png_set_filter(png_write_ptr, 0, realOptions->filter);
             }
 
-            CallbackData * callbackDataStruct = new CallbackData();
-
-            callbackDataStruct->writeCallback = writeCallback;
-            callbackDataStruct->callbackData = callbackData;
-
-            png_set_write_fn(png_write_ptr, (void *)callbackDataStruct, png_custom_write_data, flush_data_noop_func);
-
-            int32_t writeFormat = getWhatFormatWillBeWrittenForDataPNG(inputFormat, outputFormat);
+            png_set_write_fn(png_write_ptr, (void *)stream, png_custom_write_data, flush_data_noop_func);
 
-            std::vector<uint8_t> convertBuffer(0);
+            writeWidth = width;
+            writeFormat = getWhatFormatWillBeWrittenForDataPNG(inputFormat, outputFormat);
 
             if (writeFormat != inputFormat)
             {
                 int32_t numChannels, bytesPerChannel, floatOrInt;
                 AIGetFormatDetails(writeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
-                convertBuffer.resize(width * height * numChannels * bytesPerChannel);
-
-                int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, writeFormat);
-
-                if (convertError != AImgErrorCode::AIMG_SUCCESS)
-                    return convertError;
-                data = &convertBuffer[0];
 
                 int outChannels = numChannels;
                 AIGetFormatDetails(inputFormat, &numChannels, &bytesPerChannel, &floatOrInt);
@@ -426,30 +712,18 @@ namespace AImg
 
             if (setjmp(png_jmpbuf(png_write_ptr)))
             {
-                mErrorDetails = "[AImg::PNGImageLoader::PNGFile::writeImage] Failed to write PNG header";
+                destroyWriteStruct();
+                mErrorDetails = "[AImg::PNGImageLoader::PNGFile::startWriteRows] Failed to write PNG header";
                 return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
             }
 
-            int32_t numChannels, bytesPerChannel, floatOrInt;
-            AIGetFormatDetails(writeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
-
-            size_t step = width * numChannels * bytesPerChannel;
-
-            png_bytepp ptrs = (png_bytepp)malloc(sizeof(png_bytep) * height);
-
-            ptrs[0] = (png_bytep)data;
-            for (int32_t y = 1; y < height; y++)
-            {
-                ptrs[y] = ptrs[y - 1] + step;
-            }
-
-            png_set_IHDR(png_write_ptr, png_info_ptr, width, height, bit_depth, colour_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+            png_set_IHDR(png_write_ptr, png_write_info_ptr, width, height, bit_depth, colour_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
             if (colourProfile != NULL)
             {
-                png_set_iCCP(png_write_ptr, png_info_ptr, profileName, 0, colourProfile, colourProfileLen);
+                png_set_iCCP(png_write_ptr, png_write_info_ptr, profileName, 0, colourProfile, colourProfileLen);
             }
-            png_write_info(png_write_ptr, png_info_ptr);
+            png_write_info(png_write_ptr, png_write_info_ptr);
 
             if (!IsMachineBigEndian())
             {
@@ -459,28 +733,54 @@ namespace AImg
                 }
             }
 
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t writeRowBand(const AImgWriteSource& source, int32_t rowCount)
+        {
+            // BGR(A) rows are put back in order here rather than with png_set_bgr, as that would apply to every band after
+            // it, and each band can be laid out differently
+            WriteSourceRows rows(source, writeWidth, writeFormat);
+
             if (setjmp(png_jmpbuf(png_write_ptr)))
             {
-                mErrorDetails = "[AImg::PNGImageLoader::PNGFile::writeImage] Failed to write file";
+                mErrorDetails = "[AImg::PNGImageLoader::PNGFile::writeRowBand] Failed to write file";
                 return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
             }
-            png_write_image(png_write_ptr, (png_bytepp)ptrs);
 
+            for (int32_t y = 0; y < rowCount; y++)
+            {
+                const uint8_t* row;
+                int32_t err = rows.getRow(y, &row);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
+
+                png_write_row(png_write_ptr, (png_const_bytep)row);
+            }
+
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t finishWriteRows()
+        {
             if (setjmp(png_jmpbuf(png_write_ptr)))
             {
-                mErrorDetails = "[AImg::PNGImageLoader::PNGFile::writeImage] Failed to finalize write";
+                destroyWriteStruct();
+                mErrorDetails = "[AImg::PNGImageLoader::PNGFile::finishWriteRows] Failed to finalize write";
                 return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
             }
 
-            png_write_end(png_write_ptr, png_info_ptr);
+            png_write_end(png_write_ptr, png_write_info_ptr);
 
-            free(ptrs);
-            png_destroy_write_struct(&png_write_ptr, &png_info_ptr);
-            png_destroy_info_struct(png_write_ptr, &png_info_ptr);
-            delete callbackDataStruct;
+            destroyWriteStruct();
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
+        virtual void abortWriteRows()
+        {
+            destroyWriteStruct();
+        }
+
         int32_t verifyEncodeOptions(void* encodeOptions)
         {
             if (encodeOptions != NULL)
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include "../AIL.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "testCommon.h"
+
+// The checks every codec that can write has to pass, run once per codec over an image written by that codec
+struct CodecParams
+{
+    int32_t fileFormat;
+    // where under test_images its files go, and their extension
+    const char* directory;
+    const char* extension;
+    // the format the test image is written and read back in
+    int32_t format;
+    // a format to decode to that the codec can't give directly
+    int32_t convertFormat;
+    // a format at a different bit depth or channel type, for the conversions that run over several bands
+    int32_t bandsFormat;
+    // formats to write through a conversion, from and to
+    int32_t writeInputFormat;
+    int32_t writeOutputFormat;
+};
+
+static std::ostream& operator<<(std::ostream& os, const CodecParams& params)
+{
+    return os << params.directory;
+}
+
+static std::vector<CodecParams> getCodecParams()
+{
+    std::vector<CodecParams> params;
+
+#ifdef HAVE_PNG
+    params.push_back({ AImgFileFormat::PNG_IMAGE_FORMAT, "png", "png", AImgFormat::RGBA8U, AImgFormat::RGB16U, AImgFormat::RGBA32F,
+        AImgFormat::RGBA8U, AImgFormat::RGBA16U });
+#endif
+#ifdef HAVE_JPEG
+    params.push_back({ AImgFileFormat::JPEG_IMAGE_FORMAT, "jpeg", "jpg", AImgFormat::RGB8U, AImgFormat::RGBA8U, AImgFormat::RGBA32F,
+        AImgFormat::RGBA8U, AImgFormat::RGB8U });
+#endif
+#ifdef HAVE_TGA
+    params.push_back({ AImgFileFormat::TGA_IMAGE_FORMAT, "tga", "tga", AImgFormat::RGB8U, AImgFormat::RGBA32F, AImgFormat::RGB16U,
+        AImgFormat::RG8U, AImgFormat::RGB8U });
+#endif
+#ifdef HAVE_TIFF
+    params.push_back({ AImgFileFormat::TIFF_IMAGE_FORMAT, "tiff", "tif", AImgFormat::RGBA16U, AImgFormat::RGB8U, AImgFormat::RGBA32F,
+        AImgFormat::RGB16U, AImgFormat::RGB32F });
+#endif
+#ifdef HAVE_EXR
+    params.push_back({ AImgFileFormat::EXR_IMAGE_FORMAT, "exr", "exr", AImgFormat::RGBA32F, AImgFormat::RGB16U, AImgFormat::RGBA8U,
+        AImgFormat::RGBA32F, AImgFormat::RGBA16F });
+#endif
+
+    return params;
+}
+
+class Codecs : public ::testing::TestWithParam<CodecParams>
+{
+protected:
+    std::vector<uint8_t> makeFile(int32_t width = TEST_IMAGE_WIDTH, int32_t height = TEST_IMAGE_HEIGHT)
+    {
+        return makeTestFile(GetParam().fileFormat, GetParam().format, width, height);
+    }
+};
+
+TEST_P(Codecs, TestOpenMemory)
+{
+    ASSERT_TRUE(compareOpenMemory(makeFile(), GetParam().fileFormat));
+}
+
+TEST_P(Codecs, TestOpenFile)
+{
+    ASSERT_TRUE(compareOpenFile(makeFile(), getImagesDir() + "/" + GetParam().directory + "/openFile." + GetParam().extension, GetParam().fileFormat));
+}
+
+TEST_P(Codecs, TestOpenStream)
+{
+    auto pixels = makeTestImage(GetParam().format);
+    auto fileData = writeToMemoryStream(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &pixels[0], GetParam().format, GetParam().format, GetParam().fileFormat);
+
+    ASSERT_TRUE(compareOpenStream(fileData, GetParam().fileFormat));
+}
+
+TEST_P(Codecs, TestProbe)
+{
+    ASSERT_TRUE(compareProbe(makeFile(), GetParam().fileFormat));
+}
+
+TEST_P(Codecs, TestDecodeStrided)
+{
+    auto fileData = makeFile();
+
+    ASSERT_TRUE(compareDecodeStrided(fileData, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeStrided(fileData, GetParam().convertFormat));
+}
+
+TEST_P(Codecs, TestWriteSource)
+{
+    const CodecParams& params = GetParam();
+    auto pixels = makeTestImage(params.format);
+    auto writePixels = makeTestImage(params.writeInputFormat);
+
+    ASSERT_TRUE(compareWriteSource(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &pixels[0], params.format, params.format, params.fileFormat));
+    ASSERT_TRUE(compareWriteSource(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &writePixels[0], params.writeInputFormat, params.writeOutputFormat, params.fileFormat));
+}
+
+TEST_P(Codecs, TestDecodeRegion)
+{
+    auto fileData = makeFile();
+
+    // whole rows, and regions that aren't aligned to jpeg's MCUs or tiff's strips
+    ASSERT_TRUE(compareDecodeRegion(fileData, 0, 5, TEST_IMAGE_WIDTH, 9, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 11, 3, 23, 17, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 19, 21, 37, 10, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 11, 3, 23, 17, GetParam().convertFormat));
+}
+
+TEST_P(Codecs, TestReadRows)
+{
+    auto fileData = makeFile();
+
+    ASSERT_TRUE(compareReadRows(fileData, 1, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareReadRows(fileData, 8, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareReadRows(fileData, 8, GetParam().convertFormat));
+}
+
+TEST_P(Codecs, TestWriteRows)
+{
+    const CodecParams& params = GetParam();
+    auto pixels = makeTestImage(params.format);
+    auto writePixels = makeTestImage(params.writeInputFormat);
+
+    ASSERT_TRUE(compareWriteRows(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &pixels[0], params.format, params.format, params.fileFormat, 1));
+    ASSERT_TRUE(compareWriteRows(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &writePixels[0], params.writeInputFormat, params.writeOutputFormat, params.fileFormat, 8));
+}
+
+TEST_P(Codecs, TestWriteRowsMixedLayouts)
+{
+    const CodecParams& params = GetParam();
+    auto pixels = makeTestImage(params.format);
+    auto writePixels = makeTestImage(params.writeInputFormat);
+
+    ASSERT_TRUE(compareWriteRowsMixedLayouts(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &pixels[0], params.format, params.format, params.fileFormat, 3));
+    ASSERT_TRUE(compareWriteRowsMixedLayouts(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &writePixels[0], params.writeInputFormat, params.writeOutputFormat, params.fileFormat, 8));
+}
+
+TEST_P(Codecs, TestForceFormatBands)
+{
+    // tall enough that converting goes through several bands
+    auto fileData = makeFile(300, 700);
+
+    ASSERT_TRUE(compareForceFormatDecode(fileData, GetParam().bandsFormat));
+    ASSERT_TRUE(compareForceFormatDecode(fileData, GetParam().convertFormat));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 17, 123, 201, 500, GetParam().bandsFormat));
+    ASSERT_TRUE(compareReadRows(fileData, 97, GetParam().bandsFormat));
+}
+
+TEST_P(Codecs, TestDecodeBottomUp)
+{
+    auto fileData = makeFile();
+
+    ASSERT_TRUE(compareDecodeBottomUp(fileData, 11, 3, 23, 17, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeBottomUp(fileData, 11, 3, 23, 17, GetParam().convertFormat));
+}
+
+INSTANTIATE_TEST_CASE_P(AllWriters, Codecs, ::testing::ValuesIn(getCodecParams()));
+
+int main(int argc, char **argv)
+{
+    AImgInitialise();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    int retval = RUN_ALL_TESTS();
+
+    AImgCleanUp();
+
+    return retval;
+}
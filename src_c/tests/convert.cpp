@@ -0,0 +1,398 @@
+#include <gtest/gtest.h>
+#include "../AIL.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <vector>
+#include <stdint.h>
+#include "testCommon.h"
+
+static const int32_t allFormats[] =
+{
+    AImgFormat::R8U, AImgFormat::RG8U, AImgFormat::RGB8U, AImgFormat::RGBA8U,
+    AImgFormat::R16U, AImgFormat::RG16U, AImgFormat::RGB16U, AImgFormat::RGBA16U,
+    AImgFormat::R16F, AImgFormat::RG16F, AImgFormat::RGB16F, AImgFormat::RGBA16F,
+    AImgFormat::R32F, AImgFormat::RG32F, AImgFormat::RGB32F, AImgFormat::RGBA32F
+};
+
+static size_t pixelSize(int32_t format)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    return (size_t)numChannels * bytesPerChannel;
+}
+
+// Pixels in format covering the whole range of each channel type, plus out of range and special values for the float formats.
+// Returns false if format can't be converted to.
+static bool makeTestPixels(int32_t format, int32_t count, std::vector<uint8_t>& pixels)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    pixels.resize(count * pixelSize(format));
+
+    if (floatOrInt == AImgFloatOrIntType::FITYPE_INT)
+    {
+        uint32_t state = 12345;
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            state = state * 1103515245 + 12345;
+            pixels[i] = (uint8_t)(state >> 16);
+        }
+
+        return true;
+    }
+
+    std::vector<float> floats(count * 4);
+    const float special[] = { 0.0f, 1.0f, -1.0f, 2.0f, 0.5f, -0.0f, std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN() };
+    for (size_t i = 0; i < floats.size(); i++)
+        floats[i] = i < 64 ? special[i % 8] : -0.25f + 1.5f * (float)((i * 7919) % 10007) / 10007.0f;
+
+    return AImgConvertFormat(&floats[0], &pixels[0], count, 1, AImgFormat::RGBA32F, format) == AImgErrorCode::AIMG_SUCCESS;
+}
+
+TEST(Convert, TestToRGBA32F)
+{
+    const int32_t count = 4099;
+
+    for (int32_t inFormat : allFormats)
+    {
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(inFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        if (bytesPerChannel == 2 && floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT)
+            continue;
+
+        std::vector<uint8_t> src;
+        ASSERT_TRUE(makeTestPixels(inFormat, count, src));
+
+        std::vector<float> rgba(count * 4);
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat(&src[0], &rgba[0], count, 1, inFormat, AImgFormat::RGBA32F));
+
+        for (int32_t i = 0; i < count; i++)
+        {
+            float expected[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+            for (int32_t c = 0; c < numChannels; c++)
+            {
+                size_t index = (size_t)i * numChannels + c;
+                if (bytesPerChannel == 1)
+                    expected[c] = ((float)src[index]) / 255.0f;
+                else if (bytesPerChannel == 2)
+                    expected[c] = ((float)((uint16_t*)&src[0])[index]) / 65535.0f;
+                else
+                    expected[c] = ((float*)&src[0])[index];
+            }
+
+            if (numChannels == 1)
+                expected[1] = expected[2] = expected[0];
+
+            ASSERT_EQ(0, memcmp(expected, &rgba[i * 4], sizeof(expected))) << "format " << inFormat << " pixel " << i;
+        }
+    }
+}
+
+TEST(Convert, TestFromRGBA32F)
+{
+    const int32_t count = 4099;
+
+    std::vector<uint8_t> srcBytes;
+    ASSERT_TRUE(makeTestPixels(AImgFormat::RGBA32F, count, srcBytes));
+    const float* src = (const float*)&srcBytes[0];
+
+    for (int32_t outFormat : allFormats)
+    {
+        int32_t numChannels, bytesPerChannel, floatOrInt;
+        AIGetFormatDetails(outFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+        if (floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT)
+            continue;
+
+        std::vector<uint8_t> dest(count * pixelSize(outFormat));
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat((void*)src, &dest[0], count, 1, AImgFormat::RGBA32F, outFormat));
+
+        for (int32_t i = 0; i < count; i++)
+        {
+            for (int32_t c = 0; c < numChannels; c++)
+            {
+                size_t index = (size_t)i * numChannels + c;
+                float clamped = std::min(1.0f, std::max(0.0f, src[i * 4 + c]));
+
+                if (bytesPerChannel == 1)
+                    ASSERT_EQ((uint8_t)(clamped * 255.0f), dest[index]) << "format " << outFormat << " pixel " << i;
+                else
+                    ASSERT_EQ((uint16_t)(clamped * 65535.0f), ((uint16_t*)&dest[0])[index]) << "format " << outFormat << " pixel " << i;
+            }
+        }
+    }
+}
+
+// Converting straight from one format to another must give exactly what going through RGBA32F does, for every pair
+TEST(Convert, TestAllPairsMatchRGBA32F)
+{
+    const int32_t count = 4099;
+
+    for (int32_t inFormat : allFormats)
+    {
+        std::vector<uint8_t> src;
+        if (!makeTestPixels(inFormat, count, src))
+            continue;
+
+        std::vector<float> rgba(count * 4);
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat(&src[0], &rgba[0], count, 1, inFormat, AImgFormat::RGBA32F));
+
+        for (int32_t outFormat : allFormats)
+        {
+            std::vector<uint8_t> expected(count * pixelSize(outFormat));
+            if (AImgConvertFormat(&rgba[0], &expected[0], count, 1, AImgFormat::RGBA32F, outFormat) != AImgErrorCode::AIMG_SUCCESS)
+                continue;
+
+            std::vector<uint8_t> direct(expected.size());
+            ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat(&src[0], &direct[0], count, 1, inFormat, outFormat));
+
+            ASSERT_EQ(expected, direct) << "converting " << inFormat << " to " << outFormat;
+        }
+    }
+}
+
+// Every SIMD level must give exactly what the scalar kernels do, for every pair, including the tails and unaligned buffers
+TEST(Convert, TestSimdLevelsMatchScalar)
+{
+    const int32_t counts[] = { 1, 5, 6, 7, 16, 33, 4099 };
+
+    int32_t supportedLevel = AImgGetSimdLevel();
+
+    for (int32_t inFormat : allFormats)
+    {
+        std::vector<uint8_t> pixels;
+        if (!makeTestPixels(inFormat, 4099, pixels))
+            continue;
+
+        for (int32_t outFormat : allFormats)
+        {
+            for (int32_t count : counts)
+            {
+                // offset by a byte so nothing is aligned
+                std::vector<uint8_t> src(count * pixelSize(inFormat) + 1);
+                memcpy(&src[1], &pixels[0], count * pixelSize(inFormat));
+
+                std::vector<uint8_t> expected(count * pixelSize(outFormat) + 1);
+                AImgSetMaxSimdLevel(AImgSimdLevel::AIMG_SIMD_NONE);
+                int32_t err = AImgConvertFormat(&src[1], &expected[1], count, 1, inFormat, outFormat);
+                AImgSetMaxSimdLevel(AImgSimdLevel::AIMG_SIMD_AVX2);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    continue;
+
+                for (int32_t level = AImgSimdLevel::AIMG_SIMD_SSE2; level <= supportedLevel; level++)
+                {
+                    std::vector<uint8_t> result(expected.size());
+                    AImgSetMaxSimdLevel(level);
+                    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat(&src[1], &result[1], count, 1, inFormat, outFormat));
+                    AImgSetMaxSimdLevel(AImgSimdLevel::AIMG_SIMD_AVX2);
+
+                    ASSERT_EQ(expected, result) << "converting " << count << " pixels of " << inFormat << " to " << outFormat << " at level " << level;
+                }
+            }
+        }
+    }
+}
+
+// The 16 bit float formats work without OpenEXR, and every half converts to float and back exactly, at every SIMD level
+TEST(Convert, TestHalfFloat)
+{
+    std::vector<uint16_t> halves(65536);
+    for (size_t i = 0; i < halves.size(); i++)
+        halves[i] = (uint16_t)i;
+
+    for (int32_t level = AImgSimdLevel::AIMG_SIMD_NONE; level <= AImgGetSimdLevel(); level++)
+    {
+        AImgSetMaxSimdLevel(level);
+
+        std::vector<float> floats(halves.size());
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat(&halves[0], &floats[0], (int32_t)halves.size(), 1, AImgFormat::R16F, AImgFormat::R32F));
+
+        ASSERT_EQ(0.0f, floats[0x0000]);
+        ASSERT_EQ(1.0f, floats[0x3c00]);
+        ASSERT_EQ(-2.0f, floats[0xc000]);
+        ASSERT_EQ(65504.0f, floats[0x7bff]);
+        ASSERT_EQ(std::ldexp(1.0f, -24), floats[0x0001]);
+        ASSERT_EQ(std::numeric_limits<float>::infinity(), floats[0x7c00]);
+        ASSERT_TRUE(std::isnan(floats[0x7e00]));
+
+        std::vector<uint16_t> roundTripped(halves.size());
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat(&floats[0], &roundTripped[0], (int32_t)halves.size(), 1, AImgFormat::R32F, AImgFormat::R16F));
+
+        for (size_t i = 0; i < halves.size(); i++)
+        {
+            // NaNs come back quiet
+            bool isNaN = (i & 0x7c00) == 0x7c00 && (i & 0x3ff) != 0;
+            ASSERT_EQ(isNaN ? (halves[i] | 0x200) : halves[i], roundTripped[i]) << "half " << i << " at level " << level;
+        }
+
+        // rounds to nearest, ties to even
+        float toRound[] = { 1.0f + std::ldexp(1.0f, -11), 1.0f + 3 * std::ldexp(1.0f, -11), 65519.0f, 65520.0f, std::ldexp(1.0f, -25), 1e-10f };
+        uint16_t rounded[6];
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormat(toRound, rounded, 6, 1, AImgFormat::R32F, AImgFormat::R16F));
+        ASSERT_EQ(0x3c00, rounded[0]);
+        ASSERT_EQ(0x3c02, rounded[1]);
+        ASSERT_EQ(0x7bff, rounded[2]);
+        ASSERT_EQ(0x7c00, rounded[3]);
+        ASSERT_EQ(0x0000, rounded[4]);
+        ASSERT_EQ(0x0000, rounded[5]);
+    }
+
+    AImgSetMaxSimdLevel(AImgSimdLevel::AIMG_SIMD_AVX2);
+}
+
+#if defined(HAVE_JPEG) || defined(HAVE_TIFF)
+// Where each source pixel goes for each EXIF orientation flag, one pixel at a time
+static void referenceOrientation(const std::vector<uint8_t>& src, std::vector<uint8_t>& dest, int32_t width, int32_t height, int32_t inFormat, int32_t outFormat, int32_t orientationFlag)
+{
+    dest.resize(width * height * pixelSize(outFormat));
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            int32_t targetX = x, targetY = y, destWidth = width;
+            switch (orientationFlag)
+            {
+            case 2: targetX = width - 1 - x; break;
+            case 3: targetX = width - 1 - x; targetY = height - 1 - y; break;
+            case 4: targetY = height - 1 - y; break;
+            case 5: targetX = y; targetY = x; destWidth = height; break;
+            case 6: targetX = height - 1 - y; targetY = x; destWidth = height; break;
+            case 7: targetX = height - 1 - y; targetY = width - 1 - x; destWidth = height; break;
+            case 8: targetX = y; targetY = width - 1 - x; destWidth = height; break;
+            }
+
+            AImgConvertFormat((void*)&src[(y * width + x) * pixelSize(inFormat)], &dest[(targetY * destWidth + targetX) * pixelSize(outFormat)], 1, 1, inFormat, outFormat);
+        }
+    }
+}
+
+TEST(Convert, TestOrientation)
+{
+    // not a multiple of the tile size either way
+    const int32_t width = 131, height = 77;
+
+    const int32_t formatPairs[][2] =
+    {
+        { AImgFormat::R8U, AImgFormat::R8U },
+        { AImgFormat::RGB8U, AImgFormat::RGB8U },
+        { AImgFormat::RGBA8U, AImgFormat::RGBA8U },
+        { AImgFormat::RGB16U, AImgFormat::RGB16U },
+        { AImgFormat::RGB32F, AImgFormat::RGB32F },
+        { AImgFormat::RGBA32F, AImgFormat::RGBA32F },
+        { AImgFormat::RGB8U, AImgFormat::RGBA8U },
+        { AImgFormat::RGBA8U, AImgFormat::RGB16U },
+        { AImgFormat::RGBA32F, AImgFormat::R8U },
+    };
+
+    for (const auto& pair : formatPairs)
+    {
+        std::vector<uint8_t> src;
+        ASSERT_TRUE(makeTestPixels(pair[0], width * height, src));
+
+        for (int32_t orientation = 1; orientation <= 8; orientation++)
+        {
+            std::vector<uint8_t> expected;
+            referenceOrientation(src, expected, width, height, pair[0], pair[1], orientation);
+
+            std::vector<uint8_t> result(expected.size());
+            ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertOrientation(&src[0], &result[0], width, height, pair[0], pair[1], orientation));
+            ASSERT_EQ(expected, result) << "orientation " << orientation << " from " << pair[0] << " to " << pair[1];
+        }
+    }
+}
+#endif
+
+// Splitting a conversion between threads must give the same result as doing it all on one
+TEST(Convert, TestThreaded)
+{
+    const int32_t width = 1500, height = 1101;
+
+    std::vector<uint8_t> src;
+    ASSERT_TRUE(makeTestPixels(AImgFormat::RGBA8U, width * height, src));
+
+    std::vector<uint8_t> expected(width * height * pixelSize(AImgFormat::RGBA32F));
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormatThreaded(&src[0], &expected[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGBA32F, 1));
+
+    for (int32_t numThreads : { 0, 2, 3, 64 })
+    {
+        std::vector<uint8_t> result(expected.size());
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormatThreaded(&src[0], &result[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGBA32F, numThreads));
+        ASSERT_EQ(expected, result) << numThreads << " threads";
+    }
+
+#if defined(HAVE_JPEG) || defined(HAVE_TIFF)
+    for (int32_t orientation = 1; orientation <= 8; orientation++)
+    {
+        std::vector<uint8_t> orientedExpected(width * height * pixelSize(AImgFormat::RGB16U));
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertOrientationThreaded(&src[0], &orientedExpected[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGB16U, orientation, 1));
+
+        std::vector<uint8_t> result(orientedExpected.size());
+        ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertOrientation(&src[0], &result[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGB16U, orientation));
+        ASSERT_EQ(orientedExpected, result) << "orientation " << orientation;
+    }
+#endif
+
+    // the pool is started again after AImgCleanUp stops it
+    AImgCleanUp();
+    AImgInitialise();
+
+    std::vector<uint8_t> result(expected.size());
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertFormatThreaded(&src[0], &result[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGBA32F, 4));
+    ASSERT_EQ(expected, result);
+}
+
+#if defined(HAVE_JPEG) || defined(HAVE_TIFF)
+static void* CALLCONV failingMalloc(void*, size_t)
+{
+    return NULL;
+}
+
+static void CALLCONV failingFree(void*, void*)
+{
+}
+
+// An allocation failing on one of the pool's threads must come back out of the call that split the work, not take the process down
+TEST(Convert, TestThreadedAllocationFailure)
+{
+    // wide enough that every band needs a fresh row buffer to flip into, rather than one cached by an earlier test
+    const int32_t width = 100000, height = 16;
+
+    std::vector<uint8_t> src;
+    ASSERT_TRUE(makeTestPixels(AImgFormat::RGBA8U, width * height, src));
+    std::vector<uint8_t> result(width * height * pixelSize(AImgFormat::RGBA32F));
+
+    AImgSetAllocator(failingMalloc, failingFree, NULL);
+    // an explicit thread count, so the failure happens on the pool's threads even on a single core machine
+    ASSERT_THROW(AImgConvertOrientationThreaded(&src[0], &result[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGBA32F, 2, 4), std::bad_alloc);
+    AImgSetAllocator(NULL, NULL, NULL);
+
+    // and the pool is still usable afterwards
+    std::vector<uint8_t> expected(result.size());
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertOrientation(&src[0], &expected[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGBA32F, 2));
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertOrientationThreaded(&src[0], &result[0], width, height, AImgFormat::RGBA8U, AImgFormat::RGBA32F, 2, 4));
+    ASSERT_EQ(expected, result);
+}
+#endif
+
+TEST(Convert, TestInvalidFormat)
+{
+    uint8_t src[4] = {}, dest[4] = {};
+    ASSERT_EQ(AImgErrorCode::AIMG_CONVERSION_FAILED_BAD_FORMAT, AImgConvertFormat(src, dest, 1, 1, AImgFormat::INVALID_FORMAT, AImgFormat::RGBA8U));
+    ASSERT_EQ(AImgErrorCode::AIMG_CONVERSION_FAILED_BAD_FORMAT, AImgConvertFormat(src, dest, 1, 1, AImgFormat::RGBA8U, AImgFormat::RGBA));
+}
+
+int main(int argc, char **argv)
+{
+    AImgInitialise();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    int retval = RUN_ALL_TESTS();
+
+    AImgCleanUp();
+
+    return retval;
+}
@@ -6,6 +6,13 @@
 #ifdef HAVE_EXR
 
 #include <half.h>
+#include <ImathBox.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfOutputFile.h>
+#include <ImfStdIO.h>
+#include <cstring>
 
 void WriteImageTest(AImgFormat decodeFormat, AImgFormat writeFormat, AImgFormat expectedWritten = AImgFormat::INVALID_FORMAT)
 {
@@ -316,6 +323,98 @@ TEST(Exr, TestWrite16bitsU)
     WriteImageTest(AImgFormat::R16U, AImgFormat::R16U, AImgFormat::R16F);
 }
 
+TEST(Exr, TestProbeHalf)
+{
+    auto imgData = makeTestImage(AImgFormat::RGB32F);
+    auto fileData = writeToMemory(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &imgData[0], AImgFormat::RGB32F, AImgFormat::RGB16F, AImgFileFormat::EXR_IMAGE_FORMAT);
+
+    ASSERT_TRUE(compareProbe(fileData, AImgFileFormat::EXR_IMAGE_FORMAT));
+}
+
+TEST(Exr, TestForceFormatTransforms)
+{
+    auto imgData = makeTestImage(AImgFormat::RGBA32F);
+
+    // OpenEXR converts between half and float, and adds or drops alpha, itself
+    auto rgbFile = makeTestFile(AImgFileFormat::EXR_IMAGE_FORMAT, AImgFormat::RGB32F);
+    ASSERT_TRUE(compareForceFormatDecode(rgbFile, AImgFormat::RGB16F));
+    ASSERT_TRUE(compareForceFormatDecode(rgbFile, AImgFormat::RGBA32F));
+    ASSERT_TRUE(compareForceFormatDecode(rgbFile, AImgFormat::RGBA16F));
+
+    auto rgbaFile = writeToMemory(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &imgData[0], AImgFormat::RGBA32F, AImgFormat::RGBA16F, AImgFileFormat::EXR_IMAGE_FORMAT);
+    ASSERT_TRUE(compareForceFormatDecode(rgbaFile, AImgFormat::RGBA32F));
+    ASSERT_TRUE(compareForceFormatDecode(rgbaFile, AImgFormat::RGB32F));
+    ASSERT_TRUE(compareDecodeRegion(rgbaFile, 5, 3, 20, 10, AImgFormat::RGB32F));
+}
+
+// Only part of the display window has pixels in the file, the rest decodes as zero
+TEST(Exr, TestDataWindow)
+{
+    int32_t width = TEST_IMAGE_WIDTH;
+    int32_t height = TEST_IMAGE_HEIGHT;
+
+    Imath::Box2i displayWindow(Imath::V2i(0, 0), Imath::V2i(width - 1, height - 1));
+    Imath::Box2i dataWindow(Imath::V2i(9, 4), Imath::V2i(40, 22));
+    int32_t dataWidth = dataWindow.max.x - dataWindow.min.x + 1;
+    int32_t dataHeight = dataWindow.max.y - dataWindow.min.y + 1;
+
+    auto pixels = makeTestImage(AImgFormat::RGBA32F, dataWidth, dataHeight);
+    size_t pixelSize = 4 * sizeof(float);
+
+    const char* channelNames[] = { "R", "G", "B", "A" };
+
+    Imf::Header header(displayWindow, dataWindow);
+    for (const char* name : channelNames)
+        header.channels().insert(name, Imf::Channel(Imf::FLOAT));
+
+    Imf::StdOSStream stream;
+    {
+        Imf::OutputFile file(stream, header);
+
+        // slices are addressed by absolute pixel coordinates
+        char* base = (char*)pixels.data() - (dataWindow.min.x + (ptrdiff_t)dataWindow.min.y * dataWidth) * (ptrdiff_t)pixelSize;
+
+        Imf::FrameBuffer frameBuffer;
+        for (int32_t i = 0; i < 4; i++)
+            frameBuffer.insert(channelNames[i], Imf::Slice(Imf::FLOAT, base + i * sizeof(float), pixelSize, dataWidth * pixelSize));
+
+        file.setFrameBuffer(frameBuffer);
+        file.writePixels(dataHeight);
+    }
+
+    std::string written = stream.str();
+    std::vector<uint8_t> fileData(written.begin(), written.end());
+
+    std::vector<uint8_t> expected((size_t)width * height * pixelSize, 0);
+    for (int32_t y = 0; y < dataHeight; y++)
+    {
+        memcpy(&expected[(((size_t)dataWindow.min.y + y) * width + dataWindow.min.x) * pixelSize], &pixels[(size_t)y * dataWidth * pixelSize],
+            dataWidth * pixelSize);
+    }
+
+    AImgHandle img = NULL;
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL));
+
+    int32_t infoWidth, infoHeight, numChannels, bytesPerChannel, floatOrInt, decodeFormat;
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgGetInfo(img, &infoWidth, &infoHeight, &numChannels, &bytesPerChannel, &floatOrInt, &decodeFormat, NULL));
+    ASSERT_EQ(width, infoWidth);
+    ASSERT_EQ(height, infoHeight);
+
+    std::vector<uint8_t> decoded(expected.size(), 78);
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgDecodeImage(img, decoded.data(), AImgFormat::RGBA32F));
+    AImgClose(img);
+    ASSERT_TRUE(decoded == expected);
+
+    ASSERT_TRUE(compareProbe(fileData, AImgFileFormat::EXR_IMAGE_FORMAT));
+
+    // regions inside the data window, and partly outside it
+    ASSERT_TRUE(compareDecodeRegion(fileData, 12, 6, 20, 10, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 3, 1, 30, 25, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 3, 1, 30, 25, AImgFormat::RGB16U));
+    ASSERT_TRUE(compareDecodeBottomUp(fileData, 3, 1, 30, 25, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareReadRows(fileData, 5, AImgFormat::INVALID_FORMAT));
+}
+
 TEST(Exr, TestSupportedFormat)
 {
     ASSERT_FALSE(AImgIsFormatSupported(AImgFileFormat::EXR_IMAGE_FORMAT, AImgFormat::_8BITS));
@@ -4,6 +4,8 @@
 #define STBI_ONLY_HDR
 #define STB_IMAGE_IMPLEMENTATION
 #include "../extern/stb_image.h"
+#include <thread>
+#include <atomic>
 
 std::vector<uint8_t> decodeHDRFile(const std::string & path)
 {
@@ -85,6 +87,100 @@ TEST(HDR, TestReadHDRFile)
     AImgClose(img);
 }
 
+// A small uncompressed (flat RGBE) radiance file, stb only uses RLE scanlines for widths between 8 and 32767
+static std::vector<uint8_t> makeFlatHDRFile(int32_t width, int32_t height)
+{
+    std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+
+    std::vector<uint8_t> data(header.begin(), header.end());
+    for (int32_t i = 0; i < width * height; i++)
+    {
+        data.push_back((uint8_t)(i * 7));
+        data.push_back((uint8_t)(i * 13));
+        data.push_back((uint8_t)(i * 29));
+        data.push_back((uint8_t)(120 + i % 16));
+    }
+
+    return data;
+}
+
+static bool decodeHDRMemory(const std::vector<uint8_t>& fileData, std::vector<float>& decoded)
+{
+    AImgHandle img = NULL;
+    if (AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL) != AImgErrorCode::AIMG_SUCCESS)
+        return false;
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, imgFmt;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &imgFmt, NULL);
+
+    decoded.resize(width * height * numChannels);
+    int32_t error = AImgDecodeImage(img, &decoded[0], AImgFormat::INVALID_FORMAT);
+    AImgClose(img);
+
+    return error == AImgErrorCode::AIMG_SUCCESS;
+}
+
+TEST(HDR, TestParallelDecode)
+{
+    auto fileData = makeFlatHDRFile(5, 7);
+
+    std::vector<float> knownData;
+    ASSERT_TRUE(decodeHDRMemory(fileData, knownData));
+
+    std::atomic<int32_t> failures(0);
+
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < 8; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int32_t i = 0; i < 50; i++)
+            {
+                std::vector<float> decoded;
+                if (!decodeHDRMemory(fileData, decoded) || decoded != knownData)
+                    failures++;
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(0, failures.load());
+}
+
+TEST(HDR, TestDecodeStrided)
+{
+    auto fileData = makeFlatHDRFile(5, 7);
+
+    ASSERT_TRUE(compareDecodeStrided(fileData, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeStrided(fileData, AImgFormat::RGBA32F));
+}
+
+TEST(HDR, TestDecodeRegion)
+{
+    auto fileData = makeFlatHDRFile(5, 7);
+
+    ASSERT_TRUE(compareDecodeRegion(fileData, 1, 2, 3, 4, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 1, 2, 3, 4, AImgFormat::RGBA32F));
+}
+
+TEST(HDR, TestDecodeBottomUp)
+{
+    auto fileData = makeFlatHDRFile(5, 7);
+
+    ASSERT_TRUE(compareDecodeBottomUp(fileData, 1, 2, 3, 4, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeBottomUp(fileData, 1, 2, 3, 4, AImgFormat::RGBA32F));
+}
+
+TEST(HDR, TestReadRows)
+{
+    auto fileData = makeFlatHDRFile(5, 7);
+
+    ASSERT_TRUE(compareReadRows(fileData, 3, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareReadRows(fileData, 3, AImgFormat::RGBA32F));
+}
+
 int main(int argc, char * argv[])
 {
     AImgInitialise();
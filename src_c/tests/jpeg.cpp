@@ -456,6 +456,88 @@ TEST(JPEG, TestWriteConvert)
     TestWriteJpeg(AImgFormat::RGB16U, AImgFormat::RGB8U);
 }
 
+TEST(JPEG, TestAllocator)
+{
+    auto imgData = makeTestImage(AImgFormat::RGB8U);
+    ASSERT_TRUE(checkAllocatorUsed(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &imgData[0], AImgFormat::RGB8U, AImgFileFormat::JPEG_IMAGE_FORMAT));
+}
+
+// Inserts an APP1 segment holding just an EXIF orientation tag, right after the SOI marker
+static std::vector<uint8_t> addExifOrientation(const std::vector<uint8_t>& fileData, uint8_t orientation)
+{
+    const uint8_t exif[] =
+    {
+        0xFF, 0xE1, 0x00, 0x22, 'E', 'x', 'i', 'f', 0, 0,
+        'M', 'M', 0, 42, 0, 0, 0, 8, // big endian TIFF header, IFD0 at 8
+        0, 1, // one entry
+        0x01, 0x12, 0, 3, 0, 0, 0, 1, 0, orientation, 0, 0, // orientation, SHORT, count 1
+        0, 0, 0, 0 // no next IFD
+    };
+
+    std::vector<uint8_t> result(fileData.begin(), fileData.begin() + 2);
+    result.insert(result.end(), exif, exif + sizeof(exif));
+    result.insert(result.end(), fileData.begin() + 2, fileData.end());
+    return result;
+}
+
+TEST(JPEG, TestDecodeReoriented)
+{
+    // tall enough that transposing goes through several bands
+    int32_t width = 150;
+    int32_t height = 230;
+
+    auto fileData = makeTestFile(AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::RGB8U, width, height);
+
+    std::vector<uint8_t> stored(width * height * 3);
+    AImgHandle img = NULL;
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL));
+    ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgDecodeImage(img, stored.data(), AImgFormat::INVALID_FORMAT));
+    AImgClose(img);
+
+    for (uint8_t orientation = 2; orientation <= 8; orientation++)
+    {
+        auto orientedData = addExifOrientation(fileData, orientation);
+
+        for (int32_t format : { AImgFormat::RGB8U, AImgFormat::RGBA32F })
+        {
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+            size_t size = (size_t)width * height * numChannels * bytesPerChannel;
+
+            std::vector<uint8_t> expected(size);
+            ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertOrientation(stored.data(), expected.data(), width, height, AImgFormat::RGB8U, format, orientation));
+
+            std::vector<uint8_t> actual(size);
+            ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgOpenMemory(orientedData.data(), orientedData.size(), &img, NULL));
+            ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgDecodeImage(img, actual.data(), format));
+            AImgClose(img);
+
+            ASSERT_TRUE(expected == actual) << "orientation " << (int)orientation << ", format " << format;
+        }
+
+        ASSERT_TRUE(compareDecodeRegion(orientedData, 17, 9, 40, 100, AImgFormat::RGBA32F));
+    }
+}
+
+TEST(JPEG, TestDecodeBottomUpReoriented)
+{
+    // reoriented bands are flipped as they're written too
+    auto orientedData = addExifOrientation(makeTestFile(AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::RGB8U), 6);
+
+    ASSERT_TRUE(compareDecodeBottomUp(orientedData, 3, 11, 17, 23, AImgFormat::INVALID_FORMAT));
+    ASSERT_TRUE(compareDecodeBottomUp(orientedData, 3, 11, 17, 23, AImgFormat::RGBA8U));
+}
+
+TEST(JPEG, TestForceFormatTransforms)
+{
+    auto fileData = makeTestFile(AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::RGB8U);
+
+    ASSERT_TRUE(compareForceFormatDecode(fileData, AImgFormat::RGBA8U));
+    ASSERT_TRUE(compareForceFormatDecode(fileData, AImgFormat::R8U));
+    ASSERT_TRUE(compareDecodeRegion(fileData, 5, 3, 20, 10, AImgFormat::RGBA8U));
+    ASSERT_TRUE(compareReadRows(fileData, 8, AImgFormat::RGBA8U));
+}
+
 TEST(JPEG, TestSupportedFormat)
 {
     ASSERT_TRUE(AImgIsFormatSupported(AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::_8BITS | AImgFormat::RGB));
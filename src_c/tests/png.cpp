@@ -661,6 +661,122 @@ TEST(PNG, TestWriteConvert8)
     ASSERT_EQ(err, AImgErrorCode::AIMG_SUCCESS);
 }
 
+TEST(PNG, TestProbeGrayAlpha)
+{
+    // gray + alpha is expanded to RGBA on decode, the probe has to agree
+    ASSERT_TRUE(compareProbe(makeTestFile(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RG8U), AImgFileFormat::PNG_IMAGE_FORMAT));
+}
+
+TEST(PNG, TestAllocator)
+{
+    auto imgData = makeTestImage(AImgFormat::RGBA8U);
+    ASSERT_TRUE(checkAllocatorUsed(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &imgData[0], AImgFormat::RGBA8U, AImgFileFormat::PNG_IMAGE_FORMAT));
+}
+
+TEST(PNG, TestScratchBufferReuse)
+{
+    auto fileData = makeTestFile(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGBA8U);
+
+    // the second decode should reuse the first one's conversion buffer (libpng can widen to 16 bits itself, so this is to float)
+    int64_t firstCount, secondCount;
+    bool allFreed;
+    countRepeatedDecodeAllocations(fileData, AImgFormat::RGBA32F, firstCount, secondCount, allFreed);
+
+    ASSERT_TRUE(allFreed);
+    ASSERT_LT(secondCount, firstCount);
+
+    AImgSetScratchPoolLimit(0);
+    countRepeatedDecodeAllocations(fileData, AImgFormat::RGBA32F, firstCount, secondCount, allFreed);
+    AImgSetScratchPoolLimit(128 * 1024 * 1024);
+
+    ASSERT_TRUE(allFreed);
+    ASSERT_EQ(secondCount, firstCount);
+}
+
+TEST(PNG, TestForceFormatTransforms)
+{
+    // the formats libpng can give directly, and some it can't, which have to come out the same either way
+    auto rgbFile = makeTestFile(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGB8U);
+    ASSERT_TRUE(compareForceFormatDecode(rgbFile, AImgFormat::RGBA8U));
+    ASSERT_TRUE(compareForceFormatDecode(rgbFile, AImgFormat::RGB16U));
+    ASSERT_TRUE(compareForceFormatDecode(rgbFile, AImgFormat::RGBA16U));
+    ASSERT_TRUE(compareForceFormatDecode(rgbFile, AImgFormat::R8U));
+    ASSERT_TRUE(compareReadRows(rgbFile, 8, AImgFormat::RGBA16U));
+
+    auto greyFile = makeTestFile(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::R8U);
+    ASSERT_TRUE(compareForceFormatDecode(greyFile, AImgFormat::RGB8U));
+    ASSERT_TRUE(compareForceFormatDecode(greyFile, AImgFormat::RGBA16U));
+    ASSERT_TRUE(compareForceFormatDecode(greyFile, AImgFormat::RG8U));
+
+    auto rgba16File = makeTestFile(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGBA16U);
+    ASSERT_TRUE(compareForceFormatDecode(rgba16File, AImgFormat::RGB16U));
+    ASSERT_TRUE(compareForceFormatDecode(rgba16File, AImgFormat::RGBA8U));
+    ASSERT_TRUE(compareDecodeRegion(rgba16File, 5, 3, 20, 10, AImgFormat::RGB16U));
+}
+
+TEST(PNG, TestBufferedReads)
+{
+    auto imgData = makeTestImage(AImgFormat::RGBA8U);
+    auto fileData = makeTestFile(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGBA8U);
+
+    AImgSetReadBufferSize(0);
+    std::vector<uint8_t> unbufferedDecoded;
+    int32_t unbufferedReads = decodeCountingReads(fileData, unbufferedDecoded);
+
+    AImgSetReadBufferSize(64 * 1024);
+    std::vector<uint8_t> bufferedDecoded;
+    int32_t bufferedReads = decodeCountingReads(fileData, bufferedDecoded);
+
+    ASSERT_GT(unbufferedReads, 0);
+    ASSERT_GT(bufferedReads, 0);
+    ASSERT_LT(bufferedReads, unbufferedReads);
+    ASSERT_EQ(bufferedDecoded, unbufferedDecoded);
+    ASSERT_EQ(bufferedDecoded, imgData);
+}
+
+TEST(PNG, TestBufferedWrites)
+{
+    auto imgData = makeTestImage(AImgFormat::RGBA8U);
+
+    AImgSetWriteBufferSize(0);
+    std::vector<uint8_t> unbufferedData;
+    int32_t unbufferedWrites = writeCountingWrites(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &imgData[0], AImgFormat::RGBA8U, AImgFormat::RGBA8U, AImgFileFormat::PNG_IMAGE_FORMAT, unbufferedData);
+
+    AImgSetWriteBufferSize(64 * 1024);
+    std::vector<uint8_t> bufferedData;
+    int32_t bufferedWrites = writeCountingWrites(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &imgData[0], AImgFormat::RGBA8U, AImgFormat::RGBA8U, AImgFileFormat::PNG_IMAGE_FORMAT, bufferedData);
+
+    ASSERT_GT(unbufferedWrites, 0);
+    ASSERT_EQ(bufferedWrites, 1);
+    ASSERT_EQ(bufferedData, unbufferedData);
+}
+
+TEST(PNG, TestOpenWithHint)
+{
+    auto imgData = makeTestImage(AImgFormat::RGBA8U);
+    auto fileData = makeTestFile(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGBA8U);
+
+    ASSERT_EQ(AImgFileFormatFromExtension(".PNG"), AImgFileFormat::PNG_IMAGE_FORMAT);
+    ASSERT_EQ(AImgFileFormatFromExtension("jpg"), AImgFileFormat::JPEG_IMAGE_FORMAT);
+    ASSERT_EQ(AImgFileFormatFromExtension("txt"), AImgFileFormat::UNKNOWN_IMAGE_FORMAT);
+
+    // a correct hint, a wrong hint (falls back to detection) and a hint for a format TGA's heuristic could otherwise steal
+    int32_t hints[] = { AImgFileFormat::PNG_IMAGE_FORMAT, AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFileFormat::TGA_IMAGE_FORMAT };
+    for (int32_t hint : hints)
+    {
+        AImgHandle img = NULL;
+        int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
+        ASSERT_EQ(AImgOpenMemoryWithHint(fileData.data(), fileData.size(), hint, &img, &fileFormat), AImgErrorCode::AIMG_SUCCESS);
+        ASSERT_EQ(fileFormat, AImgFileFormat::PNG_IMAGE_FORMAT);
+
+        std::vector<uint8_t> decoded(imgData.size());
+        ASSERT_EQ(AImgDecodeImage(img, &decoded[0], AImgFormat::RGBA8U), AImgErrorCode::AIMG_SUCCESS);
+        ASSERT_EQ(decoded, imgData);
+
+        AImgClose(img);
+    }
+}
+
 TEST(PNG, TestSupportedFormat)
 {
     ASSERT_TRUE(AImgIsFormatSupported(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::_8BITS));
@@ -1,6 +1,8 @@
 #include "testCommon.h"
 #include <cmath>
+#include <algorithm>
 #include <string.h>
+#include <stdlib.h>
 
 bool detectImage(const std::string& path, int32_t format)
 {
@@ -171,6 +173,951 @@ void writeToFile(const std::string& path, int32_t width, int32_t height, void* d
     AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
 }
 
+std::vector<uint8_t> writeToMemory(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat)
+{
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    std::vector<uint8_t> fData(1);
+
+    AIGetResizableMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &fData);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+
+    AImgWriteImage(wImg, data, width, height, inputFormat, outputFormat, NULL, NULL, 0,
+        writeCallback, tellCallback, seekCallback, callbackData, NULL);
+
+    AImgClose(wImg);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    return fData;
+}
+
+std::vector<uint8_t> makeTestImage(int32_t format, int32_t width, int32_t height)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t count = (size_t)width * height * numChannels;
+
+    std::vector<uint8_t> pixels(count * bytesPerChannel);
+
+    if (floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT)
+    {
+        // kept within 0 to 1, so narrowing to integers doesn't just clamp
+        std::vector<float> values(count);
+        for (size_t i = 0; i < count; i++)
+            values[i] = (float)(i % 1000) / 1000.0f;
+
+        if (bytesPerChannel == 4)
+            memcpy(&pixels[0], &values[0], pixels.size());
+        else
+            AImgConvertFormat(&values[0], &pixels[0], width, height, (format & ~AImgFormat::_16BITS) | AImgFormat::_32BITS, format);
+    }
+    else if (bytesPerChannel == 2)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            uint16_t value = (uint16_t)(i * 1031);
+            memcpy(&pixels[i * 2], &value, 2);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+            pixels[i] = (uint8_t)(i * 7);
+    }
+
+    return pixels;
+}
+
+std::vector<uint8_t> makeTestFile(int32_t fileFormat, int32_t format, int32_t width, int32_t height)
+{
+    std::vector<uint8_t> pixels = makeTestImage(format, width, height);
+    return writeToMemory(width, height, &pixels[0], format, format, fileFormat);
+}
+
+static bool decodeWhole(AImgHandle img, std::vector<uint8_t>& out, int32_t& width, int32_t& height, int32_t& format)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    if (AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL) != AIMG_SUCCESS)
+        return false;
+
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    out.resize(width * height * numChannels * bytesPerChannel, 78);
+
+    return AImgDecodeImage(img, &out[0], AImgFormat::INVALID_FORMAT) == AIMG_SUCCESS;
+}
+
+bool compareOpenMemory(const std::vector<uint8_t>& fileData, int32_t expectedFileFormat)
+{
+    std::vector<uint8_t> data = fileData;
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgHandle img = NULL;
+    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
+    int32_t err = AImgOpen(readCallback, tellCallback, seekCallback, callbackData, &img, &fileFormat);
+    if (err != AIMG_SUCCESS || fileFormat != expectedFileFormat)
+        return false;
+
+    std::vector<uint8_t> callbackDecoded;
+    int32_t width, height, format;
+    bool ok = decodeWhole(img, callbackDecoded, width, height, format);
+
+    AImgClose(img);
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    if (!ok)
+        return false;
+
+    img = NULL;
+    fileFormat = UNKNOWN_IMAGE_FORMAT;
+    err = AImgOpenMemory(fileData.data(), fileData.size(), &img, &fileFormat);
+    if (err != AIMG_SUCCESS || fileFormat != expectedFileFormat)
+        return false;
+
+    std::vector<uint8_t> memoryDecoded;
+    int32_t memWidth, memHeight, memFormat;
+    ok = decodeWhole(img, memoryDecoded, memWidth, memHeight, memFormat);
+
+    AImgClose(img);
+
+    return ok && width == memWidth && height == memHeight && format == memFormat && callbackDecoded == memoryDecoded;
+}
+
+// 64 bit stream callbacks over a std::vector, for testing AImgOpenStream/AImgWriteImageStream
+struct VectorStream
+{
+    std::vector<uint8_t>* data;
+    int64_t pos = 0;
+};
+
+static int64_t CALLCONV vectorStreamRead(void* callbackData, uint8_t* dest, int64_t count)
+{
+    auto stream = (VectorStream*)callbackData;
+    int64_t toRead = std::min(count, (int64_t)stream->data->size() - stream->pos);
+    memcpy(dest, stream->data->data() + stream->pos, (size_t)toRead);
+    stream->pos += toRead;
+    return toRead;
+}
+
+static void CALLCONV vectorStreamWrite(void* callbackData, const uint8_t* src, int64_t count)
+{
+    auto stream = (VectorStream*)callbackData;
+    if (stream->pos + count > (int64_t)stream->data->size())
+        stream->data->resize((size_t)(stream->pos + count));
+    memcpy(stream->data->data() + stream->pos, src, (size_t)count);
+    stream->pos += count;
+}
+
+static int64_t CALLCONV vectorStreamTell(void* callbackData)
+{
+    return ((VectorStream*)callbackData)->pos;
+}
+
+static void CALLCONV vectorStreamSeek(void* callbackData, int64_t pos)
+{
+    ((VectorStream*)callbackData)->pos = pos;
+}
+
+static int64_t CALLCONV vectorStreamSize(void* callbackData)
+{
+    return (int64_t)((VectorStream*)callbackData)->data->size();
+}
+
+static AImgStreamCallbacks getVectorStreamCallbacks(VectorStream* stream)
+{
+    AImgStreamCallbacks callbacks;
+    callbacks.version = AIMG_STREAM_CALLBACKS_VERSION;
+    callbacks.callbackData = stream;
+    callbacks.readCallback = vectorStreamRead;
+    callbacks.writeCallback = vectorStreamWrite;
+    callbacks.tellCallback = vectorStreamTell;
+    callbacks.seekCallback = vectorStreamSeek;
+    callbacks.sizeCallback = vectorStreamSize;
+    return callbacks;
+}
+
+std::vector<uint8_t> writeToMemoryStream(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat)
+{
+    std::vector<uint8_t> fileData;
+    VectorStream stream;
+    stream.data = &fileData;
+    AImgStreamCallbacks callbacks = getVectorStreamCallbacks(&stream);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+    AImgWriteImageStream(wImg, data, width, height, inputFormat, outputFormat, NULL, NULL, 0, &callbacks, NULL);
+    AImgClose(wImg);
+
+    fileData.resize((size_t)stream.pos);
+    return fileData;
+}
+
+static int32_t writeSourceToMemory(const AImgWriteSource& source, int32_t width, int32_t height, int32_t outputFormat, int32_t fileFormat, std::vector<uint8_t>& fileData)
+{
+    VectorStream stream;
+    stream.data = &fileData;
+    AImgStreamCallbacks callbacks = getVectorStreamCallbacks(&stream);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+    int32_t err = AImgWriteImageFromSource(wImg, &source, width, height, outputFormat, NULL, NULL, 0, &callbacks, NULL);
+    AImgClose(wImg);
+
+    fileData.resize((size_t)stream.pos);
+    return err;
+}
+
+// interleaved, with gaps between pixels and rows, and red and blue swapped if there are enough channels
+static AImgWriteSource makeInterleavedSource(int32_t width, int32_t height, void* data, int32_t format, std::vector<uint8_t>& storage)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t pixelSize = numChannels * bytesPerChannel;
+
+    AImgWriteSource source;
+    memset(&source, 0, sizeof(AImgWriteSource));
+    source.format = format;
+    source.channelOrder = numChannels >= 3 ? AIMG_CHANNEL_ORDER_BGRA : AIMG_CHANNEL_ORDER_RGBA;
+    source.pixelStrideBytes = pixelSize + 3;
+    source.rowPitchBytes = source.pixelStrideBytes * width + 5;
+
+    storage.assign(source.rowPitchBytes * height, 0xAB);
+    source.data = &storage[0];
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            for (int32_t c = 0; c < numChannels; c++)
+            {
+                int32_t destChannel = (numChannels >= 3 && c < 3) ? 2 - c : c;
+                memcpy(&storage[y * source.rowPitchBytes + x * source.pixelStrideBytes + destChannel * bytesPerChannel],
+                    (uint8_t*)data + (y * width + x) * pixelSize + c * bytesPerChannel, bytesPerChannel);
+            }
+        }
+    }
+
+    return source;
+}
+
+// one plane per channel
+static AImgWriteSource makePlanarSource(int32_t width, int32_t height, void* data, int32_t format, std::vector<std::vector<uint8_t>>& planes)
+{
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t pixelSize = numChannels * bytesPerChannel;
+
+    AImgWriteSource source;
+    memset(&source, 0, sizeof(AImgWriteSource));
+    source.format = format;
+    source.rowPitchBytes = bytesPerChannel * width + 7;
+
+    planes.assign(numChannels, std::vector<uint8_t>());
+    for (int32_t c = 0; c < numChannels; c++)
+    {
+        planes[c].resize(source.rowPitchBytes * height, 0xAB);
+        source.planes[c] = &planes[c][0];
+
+        for (int32_t y = 0; y < height; y++)
+        {
+            for (int32_t x = 0; x < width; x++)
+                memcpy(&planes[c][y * source.rowPitchBytes + x * bytesPerChannel], (uint8_t*)data + (y * width + x) * pixelSize + c * bytesPerChannel, bytesPerChannel);
+        }
+    }
+
+    return source;
+}
+
+bool compareWriteSource(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat)
+{
+    std::vector<uint8_t> packedFile = writeToMemoryStream(width, height, data, inputFormat, outputFormat, fileFormat);
+
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(inputFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    std::vector<uint8_t> interleaved;
+    AImgWriteSource source = makeInterleavedSource(width, height, data, inputFormat, interleaved);
+
+    std::vector<uint8_t> interleavedFile;
+    if (writeSourceToMemory(source, width, height, outputFormat, fileFormat, interleavedFile) != AIMG_SUCCESS || interleavedFile != packedFile)
+        return false;
+
+    std::vector<std::vector<uint8_t>> planes;
+    source = makePlanarSource(width, height, data, inputFormat, planes);
+
+    std::vector<uint8_t> planarFile;
+    if (writeSourceToMemory(source, width, height, outputFormat, fileFormat, planarFile) != AIMG_SUCCESS || planarFile != packedFile)
+        return false;
+
+    // a missing plane is rejected
+    source.planes[numChannels - 1] = NULL;
+    std::vector<uint8_t> badFile;
+    return writeSourceToMemory(source, width, height, outputFormat, fileFormat, badFile) == AIMG_INVALID_WRITE_SOURCE;
+}
+
+bool compareWriteRows(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat, int32_t rowsPerCall)
+{
+    std::vector<uint8_t> wholeFile = writeToMemoryStream(width, height, data, inputFormat, outputFormat, fileFormat);
+
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(inputFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
+
+    std::vector<uint8_t> fileData;
+    VectorStream stream;
+    stream.data = &fileData;
+    AImgStreamCallbacks callbacks = getVectorStreamCallbacks(&stream);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+
+    // rows before begin
+    if (AImgWriteRows(wImg, data, 1) != AIMG_INVALID_WRITE_STATE || AImgWriteEnd(wImg) != AIMG_INVALID_WRITE_STATE)
+    {
+        AImgClose(wImg);
+        return false;
+    }
+
+    bool ok = AImgWriteBegin(wImg, width, height, inputFormat, outputFormat, NULL, NULL, 0, &callbacks, NULL) == AIMG_SUCCESS;
+
+    // a second begin while writing
+    ok = ok && AImgWriteBegin(wImg, width, height, inputFormat, outputFormat, NULL, NULL, 0, &callbacks, NULL) == AIMG_INVALID_WRITE_STATE;
+
+    bool useSource = false;
+    for (int32_t y = 0; ok && y < height; y += rowsPerCall)
+    {
+        int32_t rowCount = std::min(rowsPerCall, height - y);
+        uint8_t* rows = (uint8_t*)data + y * rowSize;
+
+        // alternate between the two entry points, which have to give the same file
+        if (useSource)
+        {
+            AImgWriteSource source;
+            memset(&source, 0, sizeof(AImgWriteSource));
+            source.format = inputFormat;
+            source.data = rows;
+            ok = AImgWriteRowsFromSource(wImg, &source, rowCount) == AIMG_SUCCESS;
+        }
+        else
+        {
+            ok = AImgWriteRows(wImg, rows, rowCount) == AIMG_SUCCESS;
+        }
+
+        useSource = !useSource;
+    }
+
+    // too many rows
+    ok = ok && AImgWriteRows(wImg, data, 1) == AIMG_INVALID_WRITE_STATE;
+    ok = ok && AImgWriteEnd(wImg) == AIMG_SUCCESS;
+
+    fileData.resize((size_t)stream.pos);
+    ok = ok && fileData == wholeFile;
+
+    // ending before every row is written fails, and leaves the handle ready for another image
+    std::vector<uint8_t> partialData;
+    stream.data = &partialData;
+    stream.pos = 0;
+    ok = ok && AImgWriteBegin(wImg, width, height, inputFormat, outputFormat, NULL, NULL, 0, &callbacks, NULL) == AIMG_SUCCESS;
+    ok = ok && AImgWriteRows(wImg, data, 1) == AIMG_SUCCESS;
+    ok = ok && AImgWriteEnd(wImg) == AIMG_INVALID_WRITE_STATE;
+    ok = ok && AImgWriteRows(wImg, data, 1) == AIMG_INVALID_WRITE_STATE;
+
+    // closing mid-write cleans up after itself
+    ok = ok && AImgWriteBegin(wImg, width, height, inputFormat, outputFormat, NULL, NULL, 0, &callbacks, NULL) == AIMG_SUCCESS;
+    ok = ok && AImgWriteRows(wImg, data, 1) == AIMG_SUCCESS;
+
+    AImgClose(wImg);
+
+    return ok;
+}
+
+bool compareWriteRowsMixedLayouts(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat, int32_t rowsPerCall)
+{
+    std::vector<uint8_t> wholeFile = writeToMemoryStream(width, height, data, inputFormat, outputFormat, fileFormat);
+
+    int32_t numChannels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(inputFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
+
+    std::vector<uint8_t> interleaved;
+    AImgWriteSource interleavedSource = makeInterleavedSource(width, height, data, inputFormat, interleaved);
+    std::vector<std::vector<uint8_t>> planes;
+    AImgWriteSource planarSource = makePlanarSource(width, height, data, inputFormat, planes);
+
+    std::vector<uint8_t> fileData;
+    VectorStream stream;
+    stream.data = &fileData;
+    AImgStreamCallbacks callbacks = getVectorStreamCallbacks(&stream);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+    bool ok = AImgWriteBegin(wImg, width, height, inputFormat, outputFormat, NULL, NULL, 0, &callbacks, NULL) == AIMG_SUCCESS;
+
+    // cycle through BGR(A) interleaved, packed RGBA and planar bands, so no band can rely on how an earlier one was laid out
+    for (int32_t y = 0, band = 0; ok && y < height; y += rowsPerCall, band++)
+    {
+        int32_t rowCount = std::min(rowsPerCall, height - y);
+
+        AImgWriteSource source;
+        if (band % 3 == 0)
+        {
+            source = interleavedSource;
+            source.data = (uint8_t*)source.data + y * source.rowPitchBytes;
+        }
+        else if (band % 3 == 1)
+        {
+            memset(&source, 0, sizeof(AImgWriteSource));
+            source.format = inputFormat;
+            source.data = (uint8_t*)data + y * rowSize;
+        }
+        else
+        {
+            source = planarSource;
+            for (int32_t c = 0; c < numChannels; c++)
+                source.planes[c] = (uint8_t*)source.planes[c] + y * source.rowPitchBytes;
+        }
+
+        ok = AImgWriteRowsFromSource(wImg, &source, rowCount) == AIMG_SUCCESS;
+    }
+
+    ok = ok && AImgWriteEnd(wImg) == AIMG_SUCCESS;
+    AImgClose(wImg);
+
+    fileData.resize((size_t)stream.pos);
+    return ok && fileData == wholeFile;
+}
+
+bool compareOpenStream(const std::vector<uint8_t>& fileData, int32_t expectedFileFormat)
+{
+    std::vector<uint8_t> data = fileData;
+    VectorStream stream;
+    stream.data = &data;
+    AImgStreamCallbacks callbacks = getVectorStreamCallbacks(&stream);
+
+    AImgHandle img = NULL;
+    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
+    int32_t err = AImgOpenStream(&callbacks, &img, &fileFormat);
+    if (err != AIMG_SUCCESS || fileFormat != expectedFileFormat)
+        return false;
+
+    std::vector<uint8_t> streamDecoded;
+    int32_t width, height, format;
+    bool ok = decodeWhole(img, streamDecoded, width, height, format);
+
+    AImgClose(img);
+
+    if (!ok)
+        return false;
+
+    img = NULL;
+    fileFormat = UNKNOWN_IMAGE_FORMAT;
+    err = AImgOpenMemory(fileData.data(), fileData.size(), &img, &fileFormat);
+    if (err != AIMG_SUCCESS || fileFormat != expectedFileFormat)
+        return false;
+
+    std::vector<uint8_t> memoryDecoded;
+    int32_t memWidth, memHeight, memFormat;
+    ok = decodeWhole(img, memoryDecoded, memWidth, memHeight, memFormat);
+
+    AImgClose(img);
+
+    return ok && width == memWidth && height == memHeight && format == memFormat && streamDecoded == memoryDecoded;
+}
+
+struct CountingCallbackData
+{
+    ReadCallback readCallback;
+    TellCallback tellCallback;
+    SeekCallback seekCallback;
+    void* callbackData;
+
+    int32_t readCount = 0;
+};
+
+static int32_t CALLCONV countingRead(void* callbackData, uint8_t* dest, int32_t count)
+{
+    auto data = (CountingCallbackData*)callbackData;
+    data->readCount++;
+    return data->readCallback(data->callbackData, dest, count);
+}
+
+static int32_t CALLCONV countingTell(void* callbackData)
+{
+    auto data = (CountingCallbackData*)callbackData;
+    return data->tellCallback(data->callbackData);
+}
+
+static void CALLCONV countingSeek(void* callbackData, int32_t pos)
+{
+    auto data = (CountingCallbackData*)callbackData;
+    data->seekCallback(data->callbackData, pos);
+}
+
+int32_t decodeCountingReads(const std::vector<uint8_t>& fileData, std::vector<uint8_t>& decoded)
+{
+    std::vector<uint8_t> data = fileData;
+
+    CountingCallbackData counting;
+    WriteCallback writeCallback = NULL;
+    AIGetSimpleMemoryBufferCallbacks(&counting.readCallback, &writeCallback, &counting.tellCallback, &counting.seekCallback, &counting.callbackData, &data[0], (int32_t)data.size());
+
+    AImgHandle img = NULL;
+    int32_t err = AImgOpen(countingRead, countingTell, countingSeek, &counting, &img, NULL);
+
+    bool ok = false;
+    if (err == AIMG_SUCCESS)
+    {
+        int32_t width, height, format;
+        ok = decodeWhole(img, decoded, width, height, format);
+        AImgClose(img);
+    }
+
+    AIDestroySimpleMemoryBufferCallbacks(counting.readCallback, writeCallback, counting.tellCallback, counting.seekCallback, counting.callbackData);
+
+    return ok ? counting.readCount : -1;
+}
+
+struct CountingWriteData
+{
+    WriteCallback writeCallback;
+    TellCallback tellCallback;
+    SeekCallback seekCallback;
+    void* callbackData;
+
+    int32_t writeCount = 0;
+};
+
+static void CALLCONV countingWrite(void* callbackData, const uint8_t* src, int32_t count)
+{
+    auto data = (CountingWriteData*)callbackData;
+    data->writeCount++;
+    data->writeCallback(data->callbackData, src, count);
+}
+
+static int32_t CALLCONV countingWriteTell(void* callbackData)
+{
+    auto data = (CountingWriteData*)callbackData;
+    return data->tellCallback(data->callbackData);
+}
+
+static void CALLCONV countingWriteSeek(void* callbackData, int32_t pos)
+{
+    auto data = (CountingWriteData*)callbackData;
+    data->seekCallback(data->callbackData, pos);
+}
+
+int32_t writeCountingWrites(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat, std::vector<uint8_t>& fileData)
+{
+    fileData.resize(1);
+
+    CountingWriteData counting;
+    ReadCallback readCallback = NULL;
+    AIGetResizableMemoryBufferCallbacks(&readCallback, &counting.writeCallback, &counting.tellCallback, &counting.seekCallback, &counting.callbackData, &fileData);
+
+    AImgHandle wImg = AImgGetAImg(fileFormat);
+    int32_t err = AImgWriteImage(wImg, data, width, height, inputFormat, outputFormat, NULL, NULL, 0,
+        countingWrite, countingWriteTell, countingWriteSeek, &counting, NULL);
+    AImgClose(wImg);
+
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, counting.writeCallback, counting.tellCallback, counting.seekCallback, counting.callbackData);
+
+    return err == AIMG_SUCCESS ? counting.writeCount : -1;
+}
+
+bool compareOpenFile(const std::vector<uint8_t>& fileData, const std::string& path, int32_t expectedFileFormat)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == NULL)
+        return false;
+    fwrite(&fileData[0], 1, fileData.size(), f);
+    fclose(f);
+
+    AImgHandle img = NULL;
+    int32_t fileFormat = UNKNOWN_IMAGE_FORMAT;
+    int32_t err = AImgOpenMemory(fileData.data(), fileData.size(), &img, &fileFormat);
+    if (err != AIMG_SUCCESS || fileFormat != expectedFileFormat)
+        return false;
+
+    std::vector<uint8_t> memoryDecoded;
+    int32_t width, height, format;
+    bool ok = decodeWhole(img, memoryDecoded, width, height, format);
+
+    AImgClose(img);
+
+    if (!ok)
+        return false;
+
+    img = NULL;
+    fileFormat = UNKNOWN_IMAGE_FORMAT;
+    err = AImgOpenFile(path.c_str(), &img, &fileFormat);
+    if (err != AIMG_SUCCESS || fileFormat != expectedFileFormat)
+        return false;
+
+    std::vector<uint8_t> fileDecoded;
+    int32_t fileWidth, fileHeight, fileFormatDecoded;
+    ok = decodeWhole(img, fileDecoded, fileWidth, fileHeight, fileFormatDecoded);
+
+    AImgClose(img);
+
+    return ok && width == fileWidth && height == fileHeight && format == fileFormatDecoded && memoryDecoded == fileDecoded;
+}
+
+struct CountingAllocator
+{
+    int64_t mallocCount = 0;
+    int64_t freeCount = 0;
+};
+
+static void* CALLCONV countingMalloc(void* user, size_t size)
+{
+    ((CountingAllocator*)user)->mallocCount++;
+    return malloc(size);
+}
+
+static void CALLCONV countingFree(void* user, void* ptr)
+{
+    ((CountingAllocator*)user)->freeCount++;
+    free(ptr);
+}
+
+bool checkAllocatorUsed(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t fileFormat)
+{
+    CountingAllocator counts;
+    AImgSetAllocator(countingMalloc, countingFree, &counts);
+
+    auto fileData = writeToMemory(width, height, data, inputFormat, inputFormat, fileFormat);
+    bool ok = compareOpenMemory(fileData, fileFormat);
+
+    AImgSetAllocator(NULL, NULL, NULL);
+
+    return ok && counts.mallocCount > 0 && counts.mallocCount == counts.freeCount;
+}
+
+bool compareDecodeStrided(const std::vector<uint8_t>& fileData, int32_t forceFormat)
+{
+    AImgHandle img = NULL;
+    if (AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL) != AIMG_SUCCESS)
+        return false;
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+    AIGetFormatDetails(forceFormat == AImgFormat::INVALID_FORMAT ? format : forceFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    size_t rowSize = width * numChannels * bytesPerChannel;
+    std::vector<uint8_t> packed(rowSize * height);
+    int32_t err = AImgDecodeImage(img, &packed[0], forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    // odd padding, so rows aren't aligned either
+    size_t rowPitch = rowSize + 13;
+    std::vector<uint8_t> strided(rowPitch * height, 0xCD);
+
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    err = AImgDecodeImageStrided(img, &strided[0], rowPitch, forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        if (memcmp(&strided[y * rowPitch], &packed[y * rowSize], rowSize) != 0)
+            return false;
+
+        for (size_t i = rowSize; i < rowPitch; i++)
+        {
+            if (strided[y * rowPitch + i] != 0xCD)
+                return false;
+        }
+    }
+
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    err = AImgDecodeImageStrided(img, &strided[0], rowSize - 1, forceFormat);
+    AImgClose(img);
+
+    return err == AIMG_INVALID_ROW_PITCH;
+}
+
+bool compareDecodeBottomUp(const std::vector<uint8_t>& fileData, int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, int32_t forceFormat)
+{
+    AImgHandle img = NULL;
+    if (AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL) != AIMG_SUCCESS)
+        return false;
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+    AIGetFormatDetails(forceFormat == AImgFormat::INVALID_FORMAT ? format : forceFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    size_t pixelSize = numChannels * bytesPerChannel;
+    size_t rowSize = width * pixelSize;
+    std::vector<uint8_t> full(rowSize * height);
+    int32_t err = AImgDecodeImage(img, &full[0], forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    // odd padding, so rows aren't aligned either
+    size_t rowPitch = rowSize + 13;
+    std::vector<uint8_t> flipped(rowPitch * height, 0xCD);
+
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    AImgSetDecodeFlags(img, AImgDecodeFlags::AIMG_DECODE_BOTTOM_UP);
+    err = AImgDecodeImageStrided(img, &flipped[0], rowPitch, forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    for (int32_t row = 0; row < height; row++)
+    {
+        if (memcmp(&flipped[row * rowPitch], &full[(height - 1 - row) * rowSize], rowSize) != 0)
+            return false;
+
+        for (size_t i = rowSize; i < rowPitch; i++)
+        {
+            if (flipped[row * rowPitch + i] != 0xCD)
+                return false;
+        }
+    }
+
+    size_t regionRowSize = regionWidth * pixelSize;
+    std::vector<uint8_t> region(regionRowSize * regionHeight);
+
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    AImgSetDecodeFlags(img, AImgDecodeFlags::AIMG_DECODE_BOTTOM_UP);
+    err = AImgDecodeRegion(img, x, y, regionWidth, regionHeight, &region[0], forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    for (int32_t row = 0; row < regionHeight; row++)
+    {
+        if (memcmp(&region[row * regionRowSize], &full[((y + regionHeight - 1 - row) * width + x) * pixelSize], regionRowSize) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+bool compareDecodeRegion(const std::vector<uint8_t>& fileData, int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, int32_t forceFormat)
+{
+    AImgHandle img = NULL;
+    if (AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL) != AIMG_SUCCESS)
+        return false;
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+    AIGetFormatDetails(forceFormat == AImgFormat::INVALID_FORMAT ? format : forceFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    size_t pixelSize = numChannels * bytesPerChannel;
+    std::vector<uint8_t> full(width * height * pixelSize);
+    int32_t err = AImgDecodeImage(img, &full[0], forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    size_t regionRowSize = regionWidth * pixelSize;
+    std::vector<uint8_t> region(regionRowSize * regionHeight);
+
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    err = AImgDecodeRegion(img, x, y, regionWidth, regionHeight, &region[0], forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    for (int32_t row = 0; row < regionHeight; row++)
+    {
+        if (memcmp(&region[row * regionRowSize], &full[((y + row) * width + x) * pixelSize], regionRowSize) != 0)
+            return false;
+    }
+
+    // a region hanging off the right hand side of the image
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    err = AImgDecodeRegion(img, width - regionWidth + 1, y, regionWidth, regionHeight, &region[0], forceFormat);
+    AImgClose(img);
+
+    return err == AIMG_INVALID_REGION;
+}
+
+bool compareReadRows(const std::vector<uint8_t>& fileData, int32_t rowsPerCall, int32_t forceFormat)
+{
+    AImgHandle img = NULL;
+    if (AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL) != AIMG_SUCCESS)
+        return false;
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+    AIGetFormatDetails(forceFormat == AImgFormat::INVALID_FORMAT ? format : forceFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    size_t rowSize = width * numChannels * bytesPerChannel;
+    std::vector<uint8_t> full(rowSize * height);
+    int32_t err = AImgDecodeImage(img, &full[0], forceFormat);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    std::vector<uint8_t> rows(rowSize * rowsPerCall);
+
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+
+    bool ok = AImgReadRows(img, &rows[0], 1) == AIMG_INVALID_DECODE_STATE;
+    ok = ok && AImgBeginDecode(img, forceFormat) == AIMG_SUCCESS;
+
+    for (int32_t row = 0; ok && row < height; row += rowsPerCall)
+    {
+        int32_t rowCount = std::min(rowsPerCall, height - row);
+
+        ok = AImgReadRows(img, &rows[0], rowCount) == AIMG_SUCCESS &&
+            memcmp(&rows[0], &full[row * rowSize], rowCount * rowSize) == 0;
+    }
+
+    ok = ok && AImgReadRows(img, &rows[0], 1) == AIMG_INVALID_DECODE_STATE;
+    ok = ok && AImgEndDecode(img) == AIMG_SUCCESS;
+    ok = ok && AImgEndDecode(img) == AIMG_INVALID_DECODE_STATE;
+    AImgClose(img);
+
+    // stopping part way through
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    ok = ok && AImgBeginDecode(img, forceFormat) == AIMG_SUCCESS;
+    ok = ok && AImgReadRows(img, &rows[0], 1) == AIMG_SUCCESS;
+    ok = ok && AImgEndDecode(img) == AIMG_SUCCESS;
+    AImgClose(img);
+
+    return ok;
+}
+
+bool compareForceFormatDecode(const std::vector<uint8_t>& fileData, int32_t forceFormat)
+{
+    AImgHandle img = NULL;
+    if (AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL) != AIMG_SUCCESS)
+        return false;
+
+    int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+
+    std::vector<uint8_t> native(width * height * numChannels * bytesPerChannel);
+    int32_t err = AImgDecodeImage(img, &native[0], AImgFormat::INVALID_FORMAT);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    AIGetFormatDetails(forceFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+    std::vector<uint8_t> converted(width * height * numChannels * bytesPerChannel);
+    if (AImgConvertFormat(&native[0], &converted[0], width, height, format, forceFormat) != AIMG_SUCCESS)
+        return false;
+
+    std::vector<uint8_t> forced(converted.size());
+    AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+    err = AImgDecodeImage(img, &forced[0], forceFormat);
+    AImgClose(img);
+
+    return err == AIMG_SUCCESS && forced == converted;
+}
+
+void countRepeatedDecodeAllocations(const std::vector<uint8_t>& fileData, int32_t forceFormat, int64_t& firstCount, int64_t& secondCount, bool& allFreed)
+{
+    CountingAllocator counts;
+    AImgSetAllocator(countingMalloc, countingFree, &counts);
+
+    int64_t counted[2];
+    for (int32_t i = 0; i < 2; i++)
+    {
+        int64_t before = counts.mallocCount;
+
+        AImgHandle img = NULL;
+        AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL);
+
+        int32_t width, height, numChannels, bytesPerChannel, floatOrInt, format;
+        AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &format, NULL);
+        AIGetFormatDetails(forceFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+        std::vector<uint8_t> decoded(width * height * numChannels * bytesPerChannel);
+        AImgDecodeImage(img, &decoded[0], forceFormat);
+        AImgClose(img);
+
+        counted[i] = counts.mallocCount - before;
+    }
+
+    AImgSetAllocator(NULL, NULL, NULL);
+
+    firstCount = counted[0];
+    secondCount = counted[1];
+    allFreed = counts.mallocCount == counts.freeCount;
+}
+
+static bool probeInfoMatches(const AImgProbeInfo& info, const AImgProbeInfo& expected)
+{
+    return info.fileFormat == expected.fileFormat && info.width == expected.width && info.height == expected.height &&
+        info.numChannels == expected.numChannels && info.bytesPerChannel == expected.bytesPerChannel &&
+        info.floatOrInt == expected.floatOrInt && info.decodedImgFormat == expected.decodedImgFormat &&
+        info.colourProfileLen == expected.colourProfileLen;
+}
+
+bool compareProbe(const std::vector<uint8_t>& fileData, int32_t expectedFileFormat)
+{
+    AImgProbeInfo expected;
+
+    AImgHandle img = NULL;
+    int32_t err = AImgOpenMemory(fileData.data(), fileData.size(), &img, &expected.fileFormat);
+    if (err != AIMG_SUCCESS || expected.fileFormat != expectedFileFormat)
+        return false;
+
+    err = AImgGetInfo(img, &expected.width, &expected.height, &expected.numChannels, &expected.bytesPerChannel, &expected.floatOrInt,
+        &expected.decodedImgFormat, &expected.colourProfileLen);
+    AImgClose(img);
+
+    if (err != AIMG_SUCCESS)
+        return false;
+
+    AImgProbeInfo memoryInfo;
+    if (AImgProbeMemory(fileData.data(), fileData.size(), &memoryInfo) != AIMG_SUCCESS || !probeInfoMatches(memoryInfo, expected))
+        return false;
+
+    // callback probes must leave the stream where it was
+    std::vector<uint8_t> data = fileData;
+
+    ReadCallback readCallback = NULL;
+    WriteCallback writeCallback = NULL;
+    TellCallback tellCallback = NULL;
+    SeekCallback seekCallback = NULL;
+    void* callbackData = NULL;
+    AIGetSimpleMemoryBufferCallbacks(&readCallback, &writeCallback, &tellCallback, &seekCallback, &callbackData, &data[0], (int32_t)data.size());
+
+    AImgProbeInfo callbackInfo;
+    err = AImgProbe(readCallback, tellCallback, seekCallback, callbackData, &callbackInfo);
+    int32_t callbackPos = tellCallback(callbackData);
+
+    AIDestroySimpleMemoryBufferCallbacks(readCallback, writeCallback, tellCallback, seekCallback, callbackData);
+
+    if (err != AIMG_SUCCESS || callbackPos != 0 || !probeInfoMatches(callbackInfo, expected))
+        return false;
+
+    VectorStream stream;
+    stream.data = &data;
+    AImgStreamCallbacks callbacks = getVectorStreamCallbacks(&stream);
+
+    AImgProbeInfo streamInfo;
+    err = AImgProbeStream(&callbacks, &streamInfo);
+
+    return err == AIMG_SUCCESS && stream.pos == 0 && probeInfoMatches(streamInfo, expected);
+}
+
 bool compareIccProfiles(const std::string & image1, const std::string & image2)
 {
     ///////////////////// Read image 1
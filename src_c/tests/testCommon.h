@@ -51,6 +51,51 @@ bool compareForceImageFormat(const std::string& path);
 void writeToFile(const std::string& path, int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat,
     const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen);
 
+std::vector<uint8_t> writeToMemory(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat);
+
+// The size makeTestImage and makeTestFile use unless told otherwise, small and not a multiple of any codec's block size
+const int32_t TEST_IMAGE_WIDTH = 67;
+const int32_t TEST_IMAGE_HEIGHT = 31;
+// Pixels in format that vary in every channel, in a pattern that survives writing and reading back
+std::vector<uint8_t> makeTestImage(int32_t format, int32_t width = TEST_IMAGE_WIDTH, int32_t height = TEST_IMAGE_HEIGHT);
+// makeTestImage(format) written out as fileFormat, without converting it
+std::vector<uint8_t> makeTestFile(int32_t fileFormat, int32_t format, int32_t width = TEST_IMAGE_WIDTH, int32_t height = TEST_IMAGE_HEIGHT);
+
+bool compareOpenMemory(const std::vector<uint8_t>& fileData, int32_t expectedFileFormat);
+std::vector<uint8_t> writeToMemoryStream(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat);
+bool compareOpenStream(const std::vector<uint8_t>& fileData, int32_t expectedFileFormat);
+// Writes data (packed, RGBA ordered) through AImgWriteImageFromSource, both as a strided BGR(A) buffer and as planes,
+// checking each gives the same file as writing it packed
+bool compareWriteSource(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat);
+// Checks writing an image rowsPerCall rows at a time with AImgWriteBegin/AImgWriteRows/AImgWriteEnd gives the same file as
+// AImgWriteImageStream, and that calls out of order fail
+bool compareWriteRows(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat, int32_t rowsPerCall);
+// Writes data rowsPerCall rows at a time with AImgWriteRowsFromSource, each band laid out differently from the one before
+// (strided BGR(A), packed RGBA or planar), checking it gives the same file as AImgWriteImageStream
+bool compareWriteRowsMixedLayouts(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat, int32_t rowsPerCall);
+// Decodes fileData through AImgOpen, counting how many times the read callback is called. Returns -1 on failure.
+int32_t decodeCountingReads(const std::vector<uint8_t>& fileData, std::vector<uint8_t>& decoded);
+// Encodes through AImgWriteImage into fileData, counting how many times the write callback is called. Returns -1 on failure.
+int32_t writeCountingWrites(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t outputFormat, int32_t fileFormat, std::vector<uint8_t>& fileData);
+bool compareOpenFile(const std::vector<uint8_t>& fileData, const std::string& path, int32_t expectedFileFormat);
+bool compareProbe(const std::vector<uint8_t>& fileData, int32_t expectedFileFormat);
+// Writes and decodes an image with a counting allocator installed, checking it was used and every allocation was freed
+bool checkAllocatorUsed(int32_t width, int32_t height, void* data, int32_t inputFormat, int32_t fileFormat);
+// Checks AImgDecodeImageStrided into padded rows gives the same pixels as AImgDecodeImage, without touching the padding
+bool compareDecodeStrided(const std::vector<uint8_t>& fileData, int32_t forceFormat);
+// Checks decoding with AIMG_DECODE_BOTTOM_UP, into padded rows, gives the rows of AImgDecodeImage in reverse without touching the
+// padding, and does the same for the region at (x, y)
+bool compareDecodeBottomUp(const std::vector<uint8_t>& fileData, int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, int32_t forceFormat);
+// Checks AImgDecodeRegion gives the same pixels as cropping the output of AImgDecodeImage, and rejects a region outside the image
+bool compareDecodeRegion(const std::vector<uint8_t>& fileData, int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, int32_t forceFormat);
+// Checks reading an image rowsPerCall rows at a time with AImgBeginDecode/AImgReadRows/AImgEndDecode gives the same pixels as
+// AImgDecodeImage, and that calls out of order fail
+bool compareReadRows(const std::vector<uint8_t>& fileData, int32_t rowsPerCall, int32_t forceFormat);
+// Checks decoding straight to forceFormat gives the same pixels as decoding in the native format and converting with AImgConvertFormat
+bool compareForceFormatDecode(const std::vector<uint8_t>& fileData, int32_t forceFormat);
+// Decodes the same file twice (converting to forceFormat) with a counting allocator installed, and reports how many allocations each decode made
+void countRepeatedDecodeAllocations(const std::vector<uint8_t>& fileData, int32_t forceFormat, int64_t& firstCount, int64_t& secondCount, bool& allFreed);
+
 void readWriteIcc(const std::string & path, const std::string & outPath, char *profileName, uint8_t **colourProfile, uint32_t *colourProfileLen);
 bool compareIccProfiles(const std::string & image1, const std::string & image2);
 
@@ -292,6 +292,12 @@ TEST(TGA, TestWriteConvert)
     TestWriteTga(AImgFormat::RGB16U, AImgFormat::RGB8U);
 }
 
+TEST(TGA, TestAllocator)
+{
+    auto imgData = makeTestImage(AImgFormat::RGB8U);
+    ASSERT_TRUE(checkAllocatorUsed(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, &imgData[0], AImgFormat::RGB8U, AImgFileFormat::TGA_IMAGE_FORMAT));
+}
+
 TEST(TGA, TestSupportedFormat)
 {
     ASSERT_TRUE(AImgIsFormatSupported(AImgFileFormat::TGA_IMAGE_FORMAT, AImgFormat::_8BITS));
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "../AIL.h"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+#include "testCommon.h"
+
+static const int32_t NUM_THREADS = 8;
+static const int32_t NUM_ITERATIONS = 25;
+
+struct EncodedImage
+{
+    int32_t fileFormat;
+    int32_t inputFormat;
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> fileData;
+};
+
+static std::vector<EncodedImage> makeTestImages(int32_t width, int32_t height)
+{
+    std::vector<EncodedImage> images;
+
+    auto add = [&](int32_t fileFormat, int32_t inputFormat)
+    {
+        EncodedImage img;
+        img.fileFormat = fileFormat;
+        img.inputFormat = inputFormat;
+        img.pixels = makeTestImage(inputFormat, width, height);
+        img.fileData = makeTestFile(fileFormat, inputFormat, width, height);
+        images.push_back(img);
+    };
+
+#ifdef HAVE_PNG
+    add(AImgFileFormat::PNG_IMAGE_FORMAT, AImgFormat::RGBA8U);
+#endif
+#ifdef HAVE_JPEG
+    add(AImgFileFormat::JPEG_IMAGE_FORMAT, AImgFormat::RGB8U);
+#endif
+#ifdef HAVE_TGA
+    add(AImgFileFormat::TGA_IMAGE_FORMAT, AImgFormat::RGB8U);
+#endif
+#ifdef HAVE_TIFF
+    add(AImgFileFormat::TIFF_IMAGE_FORMAT, AImgFormat::RGBA8U);
+#endif
+
+    (void)add;
+
+    return images;
+}
+
+TEST(Threading, TestConcurrentInitialise)
+{
+    std::atomic<int32_t> failures(0);
+
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < NUM_THREADS; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            if (AImgInitialise() != AImgErrorCode::AIMG_SUCCESS)
+                failures++;
+
+            if (AImgGetWhatFormatWillBeWrittenForData(AImgFileFormat::UNKNOWN_IMAGE_FORMAT, AImgFormat::RGBA8U, AImgFormat::RGBA8U) != AImgFormat::INVALID_FORMAT)
+                failures++;
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(0, failures.load());
+}
+
+TEST(Threading, TestConcurrentDecodeAndEncode)
+{
+    int32_t width = TEST_IMAGE_WIDTH;
+    int32_t height = TEST_IMAGE_HEIGHT;
+
+    std::vector<EncodedImage> images = makeTestImages(width, height);
+    if (images.empty())
+        return;
+
+    std::atomic<int32_t> failures(0);
+
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < NUM_THREADS; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (int32_t i = 0; i < NUM_ITERATIONS; i++)
+            {
+                EncodedImage& img = images[(t + i) % images.size()];
+
+                if (!AImgIsFormatSupported(img.fileFormat, img.inputFormat) ||
+                    AImgGetWhatFormatWillBeWrittenForData(img.fileFormat, img.inputFormat, img.inputFormat) == AImgFormat::INVALID_FORMAT)
+                    failures++;
+
+                if (!compareOpenMemory(img.fileData, img.fileFormat) || !compareProbe(img.fileData, img.fileFormat))
+                    failures++;
+
+                // the encoders are deterministic, so any cross-thread interference shows up as a different file
+                std::vector<uint8_t> pixels = img.pixels;
+                if (writeToMemory(width, height, &pixels[0], img.inputFormat, img.inputFormat, img.fileFormat) != img.fileData)
+                    failures++;
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(0, failures.load());
+}
+
+int main(int argc, char **argv)
+{
+    AImgInitialise();
+
+    ::testing::InitGoogleTest(&argc, argv);
+    int retval = RUN_ALL_TESTS();
+
+    AImgCleanUp();
+
+    return retval;
+}
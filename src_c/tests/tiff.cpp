@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "../AIL.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include "testCommon.h"
@@ -480,6 +481,199 @@ TEST(TIFF, TestCompareWithPngICCProfile)
     ASSERT_TRUE(compareIccProfiles("/png/ICC.png", "/tiff/ICC.tif"));
 }
 
+// Builds an uncompressed little endian TIFF by hand, for the layouts AIL's writer never makes. pixels are packed (RGBRGB...).
+static std::vector<uint8_t> makeTiff(int32_t width, int32_t height, int32_t format, bool separate, uint16_t orientation, int32_t rowsPerStrip,
+    const std::vector<uint8_t>& pixels)
+{
+    int32_t channels, bytesPerChannel, floatOrInt;
+    AIGetFormatDetails(format, &channels, &bytesPerChannel, &floatOrInt);
+
+    int32_t planes = separate ? channels : 1;
+    int32_t stripsPerPlane = (height + rowsPerStrip - 1) / rowsPerStrip;
+    size_t sampleSize = separate ? bytesPerChannel : (size_t)channels * bytesPerChannel;
+    size_t pixelSize = (size_t)channels * bytesPerChannel;
+
+    std::vector<uint8_t> file = { 'I', 'I', 42, 0, 0, 0, 0, 0 };
+
+    auto put16 = [&](uint32_t value) { file.push_back((uint8_t)value); file.push_back((uint8_t)(value >> 8)); };
+    auto put32 = [&](uint32_t value) { put16(value & 0xFFFF); put16(value >> 16); };
+    auto set32 = [&](size_t offset, uint32_t value) { for (int32_t i = 0; i < 4; i++) file[offset + i] = (uint8_t)(value >> (i * 8)); };
+
+    // the strips, every strip of the first plane before the second's
+    std::vector<uint32_t> stripOffsets, stripByteCounts;
+    for (int32_t plane = 0; plane < planes; plane++)
+    {
+        for (int32_t strip = 0; strip < stripsPerPlane; strip++)
+        {
+            stripOffsets.push_back((uint32_t)file.size());
+
+            int32_t endRow = std::min((strip + 1) * rowsPerStrip, height);
+            for (int32_t y = strip * rowsPerStrip; y < endRow; y++)
+            {
+                for (int32_t x = 0; x < width; x++)
+                {
+                    const uint8_t* sample = &pixels[(y * (size_t)width + x) * pixelSize + plane * sampleSize];
+                    file.insert(file.end(), sample, sample + sampleSize);
+                }
+            }
+
+            stripByteCounts.push_back((uint32_t)(file.size() - stripOffsets.back()));
+        }
+    }
+
+    struct Entry
+    {
+        uint16_t tag, type;
+        std::vector<uint32_t> values;
+    };
+
+    // tags in ascending order, as TIFF requires: width, length, bits per sample, compression (none), photometric (RGB or black is
+    // zero), strip offsets, orientation, samples per pixel, rows per strip, strip byte counts, planar config, extra samples
+    // (unassociated alpha) and sample format
+    const uint16_t SHORT = 3, LONG = 4;
+    std::vector<Entry> entries =
+    {
+        { 256, LONG, { (uint32_t)width } },
+        { 257, LONG, { (uint32_t)height } },
+        { 258, SHORT, std::vector<uint32_t>(channels, bytesPerChannel * 8) },
+        { 259, SHORT, { 1 } },
+        { 262, SHORT, { channels >= 3 ? 2u : 1u } },
+        { 273, LONG, stripOffsets },
+        { 274, SHORT, { orientation } },
+        { 277, SHORT, { (uint32_t)channels } },
+        { 278, LONG, { (uint32_t)rowsPerStrip } },
+        { 279, LONG, stripByteCounts },
+        { 284, SHORT, { separate ? 2u : 1u } },
+    };
+
+    if (channels == 2 || channels == 4)
+        entries.push_back({ 338, SHORT, { 2 } });
+
+    entries.push_back({ 339, SHORT, std::vector<uint32_t>(channels, floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT ? 3 : 1) });
+
+    if (file.size() % 2)
+        file.push_back(0);
+    set32(4, (uint32_t)file.size());
+
+    // the directory, then the values that don't fit in its entries
+    size_t dataOffset = file.size() + 2 + entries.size() * 12 + 4;
+    std::vector<size_t> patches;
+
+    put16((uint32_t)entries.size());
+    for (const Entry& entry : entries)
+    {
+        put16(entry.tag);
+        put16(entry.type);
+        put32((uint32_t)entry.values.size());
+
+        size_t valueSize = entry.type == SHORT ? 2 : 4;
+        if (entry.values.size() * valueSize <= 4)
+        {
+            for (uint32_t value : entry.values)
+                valueSize == 2 ? put16(value) : put32(value);
+            for (size_t i = entry.values.size() * valueSize; i < 4; i++)
+                file.push_back(0);
+        }
+        else
+        {
+            patches.push_back(file.size());
+            put32(0);
+        }
+    }
+    put32(0);
+
+    size_t patch = 0;
+    for (const Entry& entry : entries)
+    {
+        size_t valueSize = entry.type == SHORT ? 2 : 4;
+        if (entry.values.size() * valueSize <= 4)
+            continue;
+
+        set32(patches[patch++], (uint32_t)dataOffset);
+        for (uint32_t value : entry.values)
+            valueSize == 2 ? put16(value) : put32(value);
+        dataOffset = file.size();
+    }
+
+    return file;
+}
+
+static bool decodeTiff(const std::vector<uint8_t>& fileData, int32_t format, std::vector<uint8_t>& decoded, int32_t& width, int32_t& height)
+{
+    AImgHandle img = NULL;
+    if (AImgOpenMemory(fileData.data(), fileData.size(), &img, NULL) != AImgErrorCode::AIMG_SUCCESS)
+        return false;
+
+    int32_t numChannels, bytesPerChannel, floatOrInt, fileFormat;
+    AImgGetInfo(img, &width, &height, &numChannels, &bytesPerChannel, &floatOrInt, &fileFormat, NULL);
+    AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+    decoded.resize((size_t)width * height * numChannels * bytesPerChannel);
+    int32_t error = AImgDecodeImage(img, decoded.data(), format);
+    AImgClose(img);
+
+    return error == AImgErrorCode::AIMG_SUCCESS;
+}
+
+TEST(TIFF, TestReadSeparatePlanes)
+{
+    for (int32_t format : { AImgFormat::RGB8U, AImgFormat::RGBA16U, AImgFormat::RGB32F })
+    {
+        auto pixels = makeTestImage(format);
+
+        // a short last strip in every plane
+        auto fileData = makeTiff(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, format, true, 1, 8, pixels);
+
+        std::vector<uint8_t> decoded;
+        int32_t width, height;
+        ASSERT_TRUE(decodeTiff(fileData, format, decoded, width, height)) << format;
+        ASSERT_TRUE(decoded == pixels) << format;
+
+        ASSERT_TRUE(compareDecodeRegion(fileData, 11, 3, 23, 17, AImgFormat::INVALID_FORMAT)) << format;
+        ASSERT_TRUE(compareDecodeRegion(fileData, 11, 3, 23, 17, AImgFormat::RGBA32F)) << format;
+        ASSERT_TRUE(compareDecodeBottomUp(fileData, 11, 3, 23, 17, AImgFormat::RGBA8U)) << format;
+        ASSERT_TRUE(compareReadRows(fileData, 5, AImgFormat::INVALID_FORMAT)) << format;
+        ASSERT_TRUE(compareForceFormatDecode(fileData, AImgFormat::RGBA8U)) << format;
+    }
+}
+
+TEST(TIFF, TestDecodeReoriented)
+{
+    for (bool separate : { false, true })
+    {
+        auto pixels = makeTestImage(AImgFormat::RGB16U);
+
+        for (uint16_t orientation = 1; orientation <= 8; orientation++)
+        {
+            auto fileData = makeTiff(TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT, AImgFormat::RGB16U, separate, orientation, 8, pixels);
+
+            for (int32_t format : { AImgFormat::RGB16U, AImgFormat::RGBA32F })
+            {
+                int32_t numChannels, bytesPerChannel, floatOrInt;
+                AIGetFormatDetails(format, &numChannels, &bytesPerChannel, &floatOrInt);
+
+                std::vector<uint8_t> expected((size_t)TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT * numChannels * bytesPerChannel);
+                ASSERT_EQ(AImgErrorCode::AIMG_SUCCESS, AImgConvertOrientation(pixels.data(), expected.data(), TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT,
+                    AImgFormat::RGB16U, format, orientation));
+
+                std::vector<uint8_t> decoded;
+                int32_t width, height;
+                ASSERT_TRUE(decodeTiff(fileData, format, decoded, width, height));
+
+                bool swapsAxes = orientation >= 5;
+                ASSERT_EQ(swapsAxes ? TEST_IMAGE_HEIGHT : TEST_IMAGE_WIDTH, width);
+                ASSERT_EQ(swapsAxes ? TEST_IMAGE_WIDTH : TEST_IMAGE_HEIGHT, height);
+                ASSERT_TRUE(decoded == expected) << "orientation " << orientation << ", separate " << separate << ", format " << format;
+            }
+
+            ASSERT_TRUE(compareDecodeRegion(fileData, 3, 5, 17, 19, AImgFormat::INVALID_FORMAT)) << "orientation " << orientation;
+            ASSERT_TRUE(compareDecodeBottomUp(fileData, 3, 5, 17, 19, AImgFormat::RGBA32F)) << "orientation " << orientation;
+            ASSERT_TRUE(compareReadRows(fileData, 5, AImgFormat::INVALID_FORMAT)) << "orientation " << orientation;
+            ASSERT_TRUE(compareProbe(fileData, AImgFileFormat::TIFF_IMAGE_FORMAT)) << "orientation " << orientation;
+        }
+    }
+}
+
 TEST(TIFF, TestSupportedFormat)
 {
     ASSERT_TRUE(AImgIsFormatSupported(AImgFileFormat::TIFF_IMAGE_FORMAT, AImgFormat::_8BITS));
@@ -8,8 +8,17 @@
 #include <setjmp.h>
 #define STBI_ONLY_TGA
 #define STBI_ONLY_HDR
+// stb records failure reasons in a (non thread local) global, which would make concurrent decodes race. We never read it anyway.
+#define STBI_NO_FAILURE_STRINGS
+// send stb's allocations (including the decoded images it hands back) through AImgSetAllocator
+#define STBI_MALLOC(sz) AImg::aimgMalloc(sz)
+#define STBI_REALLOC_SIZED(p, oldsz, newsz) AImg::aimgReallocSized(p, oldsz, newsz)
+#define STBI_FREE(p) AImg::aimgFree(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "extern/stb_image.h"
+#define STBIW_MALLOC(sz) AImg::aimgMalloc(sz)
+#define STBIW_REALLOC_SIZED(p, oldsz, newsz) AImg::aimgReallocSized(p, oldsz, newsz)
+#define STBIW_FREE(p) AImg::aimgFree(p)
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "extern/stb_image_write.h"
 
@@ -19,20 +28,28 @@ namespace AImg
     {
         int readCallback(void * user, char * data, int size)
         {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-            return callbackFunctions->readCallback(callbackFunctions->callbackData, (uint8_t *)data, size);
+            InputStream * stream = (InputStream *)user;
+            return (int)stream->read((uint8_t *)data, size);
         }
 
-        void seekCallback(void * user, int num_bytes)
+        void skipCallback(void * user, int num_bytes)
         {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-            callbackFunctions->seekCallback(callbackFunctions->callbackData, num_bytes);
+            InputStream * stream = (InputStream *)user;
+            stream->seek(stream->tell() + num_bytes);
+        }
+
+        int eofCallback(void * user)
+        {
+            InputStream * stream = (InputStream *)user;
+
+            uint8_t tmp;
+            return stream->peek(&tmp, 1) == 0 ? 1 : 0;
         }
 
         void writeFunc(void * user, void * data, int size)
         {
-            CallbackData * callbackFunctions = (CallbackData *)user;
-            callbackFunctions->writeCallback(callbackFunctions->callbackData, (uint8_t *)data, size);
+            OutputStream* stream = (OutputStream*)user;
+            stream->write((uint8_t *)data, size);
         }
     }
 
@@ -67,21 +84,17 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool TGAImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    // TGA has no magic number, so this is only a heuristic on the header fields. AImgOpen tries it after every other format.
+    bool TGAImageLoader::canLoadImage(const uint8_t* header, size_t headerSize)
     {
-        uint8_t header[18];
-
-        int startingPosition = tellCallback(callbackData);
-
-        readCallback(callbackData, header, 18);
-
-        seekCallback(callbackData, startingPosition);
+        if (headerSize < 18)
+            return false;
 
         bool hasCorrectColourMapType = (header[1] == 0 || header[1] == 1);
         bool hasCorrectImageType = (header[2] == 0 || header[2] == 1 || header[2] == 2 || header[2] == 3 || header[2] == 9 || header[2] == 10 || header[2] == 11);
-        uint16_t paletteLength = *(uint16_t *)(header + 5);
-        uint16_t width = *(uint16_t *)(header + 12);
-        uint16_t height = *(uint16_t *)(header + 14);
+        uint16_t paletteLength = (uint16_t)(header[5] | (header[6] << 8));
+        uint16_t width = (uint16_t)(header[12] | (header[13] << 8));
+        uint16_t height = (uint16_t)(header[14] | (header[15] << 8));
 
         bool correctDimensions = (width > 0 && height > 0);
         bool realBitDepth = (header[16] == 8 || header[16] == 16 || header[16] == 24 || header[16] == 32);
@@ -113,7 +126,8 @@ namespace AImg
     class TGAFile : public AImgBase
     {
     public:
-        CallbackData data;
+        InputStream* stream = nullptr;
+        int64_t startPos = 0;
         int32_t numChannels, width, height;
 
         int32_t getDecodeFormat()
@@ -164,17 +178,27 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
+        virtual int32_t decodeRegion(int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, void *realDestBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat)
         {
-            stbi_io_callbacks callbacks;
-            callbacks.read = STBICallbacks::readCallback;
-            callbacks.skip = STBICallbacks::seekCallback;
+            uint8_t* loadedData = NULL;
 
-            uint8_t* loadedData = stbi_load_from_callbacks(&callbacks, &data, &width, &height, &numChannels, numChannels);
+            if (stream->getMemory())
+            {
+                loadedData = stbi_load_from_memory(stream->getMemory() + startPos, (int)(stream->getMemorySize() - startPos), &width, &height, &numChannels, numChannels);
+            }
+            else
+            {
+                stbi_io_callbacks callbacks;
+                callbacks.read = STBICallbacks::readCallback;
+                callbacks.skip = STBICallbacks::skipCallback;
+                callbacks.eof = STBICallbacks::eofCallback;
+
+                loadedData = stbi_load_from_callbacks(&callbacks, stream, &width, &height, &numChannels, numChannels);
+            }
 
             if (!loadedData)
             {
-                mErrorDetails = "[AImg::TGAImageLoader::TGAFile::decodeImage] stbi_load_from_callbacks failed!";
+                mErrorDetails = "[AImg::TGAImageLoader::TGAFile::decodeImage] stbi_load failed!";
                 return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
             }
 
@@ -182,78 +206,87 @@ namespace AImg
             int32_t numChannels, bytesPerChannel, floatOrInt;
             AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-            void* destBuffer = realDestBuffer;
+            // stb always decodes the whole image into a tightly packed buffer, so convert (or just copy) the region straight out of it
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = decodeFormat;
 
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-            {
-                convertTmpBuffer.resize(width * height * bytesPerChannel * numChannels);
-                destBuffer = &convertTmpBuffer[0];
-            }
+            size_t pixelSize = (size_t)bytesPerChannel * numChannels;
+            size_t loadedRowSize = pixelSize * width;
+            const uint8_t* regionStart = (const uint8_t*)loadedData + y * loadedRowSize + x * pixelSize;
 
-            memcpy(destBuffer, loadedData, width * height * bytesPerChannel * numChannels);
+            int32_t err = convertFormatStrided(regionStart, loadedRowSize, realDestBuffer, rowPitchBytes, regionWidth, regionHeight, decodeFormat, forceImageFormat);
             stbi_image_free(loadedData);
 
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+            return err;
+        }
+
+        virtual int32_t openImage(InputStream* stream)
+        {
+            this->stream = stream;
+            startPos = stream->tell();
+
+            int ok;
+            if (stream->getMemory())
             {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
-                if (err != AImgErrorCode::AIMG_SUCCESS)
-                    return err;
+                ok = stbi_info_from_memory(stream->getMemory() + startPos, (int)(stream->getMemorySize() - startPos), &width, &height, &numChannels);
             }
+            else
+            {
+                stbi_io_callbacks callbacks;
+                callbacks.read = STBICallbacks::readCallback;
+                callbacks.skip = STBICallbacks::skipCallback;
+                callbacks.eof = STBICallbacks::eofCallback;
 
-            return AImgErrorCode::AIMG_SUCCESS;
-        }
+                ok = stbi_info_from_callbacks(&callbacks, stream, &width, &height, &numChannels);
+                stream->seek(startPos);
+            }
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
-        {
-            data.readCallback = readCallback;
-            data.tellCallback = tellCallback;
-            data.seekCallback = seekCallback;
-            data.callbackData = callbackData;
-            stbi_io_callbacks callbacks;
-            callbacks.read = STBICallbacks::readCallback;
-            callbacks.skip = STBICallbacks::seekCallback;
-
-            int startingPosition = tellCallback(callbackData);
-            stbi_info_from_callbacks(&callbacks, &data, &width, &height, &numChannels);
-            seekCallback(callbackData, startingPosition);
+            if (!ok)
+            {
+                mErrorDetails = "[AImg::TGAImageLoader::TGAFile::openImage] stbi_info failed!";
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            }
 
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void* encodingOptions)
+        virtual int32_t writeImage(const AImgWriteSource& source, int32_t width, int32_t height, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+            OutputStream* stream, void* encodingOptions)
         {
             AIL_UNUSED_PARAM(profileName);
             AIL_UNUSED_PARAM(colourProfile);
             AIL_UNUSED_PARAM(colourProfileLen);
             AIL_UNUSED_PARAM(encodingOptions);
 
-            int32_t writeFormat = getWhatFormatWillBeWrittenForDataTGA(inputFormat, outputFormat);
-
-            std::vector<uint8_t> convertBuffer(0);
+            int32_t writeFormat = getWhatFormatWillBeWrittenForDataTGA(source.format, outputFormat);
 
             int32_t numChannels, bytesPerChannel, floatOrInt;
             AIGetFormatDetails(writeFormat, &numChannels, &bytesPerChannel, &floatOrInt);
 
-            if (writeFormat != inputFormat)
+            size_t rowSize = (size_t)width * numChannels * bytesPerChannel;
+            const void* data = source.data;
+
+            // stb can only write a whole, tightly packed image, so anything else has to be packed first
+            ScratchBuffer convertBuffer;
+            WriteSourceRows rows(source, width, writeFormat);
+            if (!rows.inPlace() || source.rowPitchBytes != rowSize)
             {
-                convertBuffer.resize(width * height * numChannels * bytesPerChannel);
+                convertBuffer.resize(rowSize * height);
 
-                int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, writeFormat);
+                for (int32_t y = 0; y < height; y++)
+                {
+                    const uint8_t* row;
+                    int32_t convertError = rows.getRow(y, &row);
+                    if (convertError != AImgErrorCode::AIMG_SUCCESS)
+                        return convertError;
 
-                if (convertError != AImgErrorCode::AIMG_SUCCESS)
-                    return convertError;
-                data = &convertBuffer[0];
-            }
+                    memcpy(convertBuffer.data() + y * rowSize, row, rowSize);
+                }
 
-            CallbackData callbackFunctions;
-            callbackFunctions.tellCallback = tellCallback;
-            callbackFunctions.writeCallback = writeCallback;
-            callbackFunctions.seekCallback = seekCallback;
-            callbackFunctions.callbackData = callbackData;
+                data = convertBuffer.data();
+            }
 
-            int err = stbi_write_tga_to_func(&STBICallbacks::writeFunc, &callbackFunctions, width, height, numChannels, data);
+            int err = stbi_write_tga_to_func(&STBICallbacks::writeFunc, stream, width, height, numChannels, data);
             if (err != 0)
             {
                 return AImgErrorCode::AIMG_SUCCESS;
@@ -286,6 +319,18 @@ namespace AImg
         return new TGAFile();
     }
 
+    // Opening a TGA file only runs stbi_info on the header, so probing is just an open on the stack
+    int32_t TGAImageLoader::probeImage(InputStream* stream, AImgProbeInfo* info)
+    {
+        TGAFile file;
+
+        int32_t err = file.openImage(stream);
+        if (err != AImgErrorCode::AIMG_SUCCESS)
+            return err;
+
+        return file.getImageInfo(&info->width, &info->height, &info->numChannels, &info->bytesPerChannel, &info->floatOrInt, &info->decodedImgFormat, &info->colourProfileLen);
+    }
+
     AImgFormat TGAImageLoader::getWhatFormatWillBeWrittenForData(int32_t inputFormat, int32_t outputFormat)
     {
         return getWhatFormatWillBeWrittenForDataTGA(inputFormat, outputFormat);
@@ -30,7 +30,8 @@ namespace AImg
 
         virtual AImgBase * getAImg();
         virtual int32_t initialise();
-        virtual bool canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void* callbackData);
+        virtual bool canLoadImage(const uint8_t* header, size_t headerSize);
+        virtual int32_t probeImage(InputStream* stream, AImgProbeInfo* info);
         virtual std::string getFileExtension();
         virtual int32_t getAImgFileFormatValue();
 
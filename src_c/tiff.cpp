@@ -34,50 +34,105 @@ namespace AImg
 
     struct tiffCallbackData
     {
-        ReadCallback mReadCallback = nullptr;
-        WriteCallback mWriteCallback = nullptr;
-        TellCallback mTellCallback = nullptr;
-        SeekCallback mSeekCallback = nullptr;
-        void *callbackData = nullptr;
-
-        int32_t startPos = 0;
-        int32_t furthestPositionWritten = 0;
+        OutputStream *stream = nullptr;
+
+        int64_t startPos = 0;
+        int64_t furthestPositionWritten = 0;
+    };
+
+    struct tiffReadData
+    {
+        InputStream *stream = nullptr;
+        int64_t startPos = 0;
     };
 
     tsize_t tiffRead(thandle_t st, tdata_t buffer, tsize_t size)
     {
-        tiffCallbackData *callbacks = (tiffCallbackData *)st;
+        tiffReadData *readData = (tiffReadData *)st;
 
-        return callbacks->mReadCallback(callbacks->callbackData, (uint8_t *)buffer, (int32_t)size);
+        return (tsize_t)readData->stream->read((uint8_t *)buffer, (int64_t)size);
+    }
+
+    tsize_t tiffNoWrite(thandle_t, tdata_t, tsize_t)
+    {
+        return 0;
     }
 
     tsize_t tiff_Write(thandle_t st, tdata_t buffer, tsize_t size)
     {
         tiffCallbackData *callbacks = (tiffCallbackData *)st;
 
-        int32_t start = callbacks->mTellCallback(callbacks->callbackData);
-        callbacks->mWriteCallback(callbacks->callbackData, (uint8_t *)buffer, (int32_t)size);
-        int32_t end = callbacks->mTellCallback(callbacks->callbackData);
+        int64_t start = callbacks->stream->tell();
+        callbacks->stream->write((uint8_t *)buffer, (int64_t)size);
+        int64_t end = callbacks->stream->tell();
 
         if (end > callbacks->furthestPositionWritten)
             callbacks->furthestPositionWritten = end;
 
-        return end - start;
+        return (tsize_t)(end - start);
     }
 
-    // This should never be called
-    // We don't implement it because AImg is designed not to have the file size
-    // available to it, we just receive streams. I had a look at the libtiff source,
-    // and it seems to only be used for a deprecated version of embedded jpeg tiffs,
-    // and tiff directories. We just cancel decode if we detect an old-style jpeg
-    // embedded tiff, and never use the directory crap in the first place, so it
-    // should be safe to just return 0 here.
-    toff_t tiff_Size(thandle_t st)
+    tsize_t tiffNoRead(thandle_t, tdata_t, tsize_t)
     {
-        AIL_UNUSED_PARAM(st);
         return 0;
     }
 
+    // While writing, the size is however much we've written so far
+    toff_t tiff_Size(thandle_t st)
+    {
+        tiffCallbackData *callbacks = (tiffCallbackData *)st;
+        return (toff_t)(callbacks->furthestPositionWritten - callbacks->startPos);
+    }
+
+    // libtiff uses this to sanity check offsets and strip sizes against the end of the file.
+    // If the stream can't tell us its size (old style callbacks with no size query) we return 0, which
+    // libtiff treats as unknown. It's only really needed for old-style jpeg embedded tiffs, which we refuse anyway.
+    toff_t tiff_ReadSize(thandle_t st)
+    {
+        tiffReadData *readData = (tiffReadData *)st;
+
+        int64_t size = readData->stream->size();
+        if (size < readData->startPos)
+            return 0;
+
+        return (toff_t)(size - readData->startPos);
+    }
+
+    toff_t tiff_ReadSeek(thandle_t st, toff_t pos, int whence)
+    {
+        tiffReadData *readData = (tiffReadData *)st;
+
+        if (pos == 0xFFFFFFFF)
+            return 0xFFFFFFFF;
+
+        int64_t finalPos = (int64_t)pos;
+
+        switch (whence)
+        {
+        case SEEK_SET:
+        {
+            finalPos += readData->startPos;
+            break;
+        }
+
+        case SEEK_CUR:
+        {
+            finalPos += readData->stream->tell();
+            break;
+        }
+
+        case SEEK_END:
+        {
+            finalPos += readData->startPos + (int64_t)tiff_ReadSize(st);
+            break;
+        }
+        }
+
+        readData->stream->seek(finalPos);
+
+        return (toff_t)(readData->stream->tell() - readData->startPos);
+    }
+
     toff_t tiff_Seek(thandle_t st, toff_t pos, int whence)
     {
         tiffCallbackData *callbacks = (tiffCallbackData *)st;
@@ -85,7 +140,7 @@ namespace AImg
         if (pos == 0xFFFFFFFF)
             return 0xFFFFFFFF;
 
-        toff_t finalPos = pos;
+        int64_t finalPos = (int64_t)pos;
 
         switch (whence)
         {
@@ -97,7 +152,7 @@ namespace AImg
 
         case SEEK_CUR:
         {
-            finalPos += callbacks->mTellCallback(callbacks->callbackData);
+            finalPos += callbacks->stream->tell();
             break;
         }
 
@@ -107,21 +162,36 @@ namespace AImg
         // unlike tiff_Size above.
         case SEEK_END:
         {
-            finalPos = callbacks->furthestPositionWritten + pos;
+            finalPos = callbacks->furthestPositionWritten + (int64_t)pos;
             break;
         }
         }
 
-        callbacks->mSeekCallback(callbacks->callbackData, (int32_t)finalPos);
+        callbacks->stream->seek(finalPos);
 
-        return callbacks->mTellCallback(callbacks->callbackData);
+        return (toff_t)(callbacks->stream->tell() - callbacks->startPos);
     }
 
-    int tiff_Map(thandle_t, tdata_t *, toff_t *)
+    // If the file is in memory, we can let libtiff read strips directly out of it instead of through tiffRead
+    int tiff_Map(thandle_t st, tdata_t *base, toff_t *size)
+    {
+        tiffReadData *readData = (tiffReadData *)st;
+
+        if (readData->stream->getMemory() == NULL)
+            return 0;
+
+        *base = (tdata_t)(readData->stream->getMemory() + readData->startPos);
+        *size = (toff_t)(readData->stream->getMemorySize() - readData->startPos);
+
+        return 1;
+    }
+
+    int tiff_NoMap(thandle_t, tdata_t *, toff_t *)
     {
         return 0;
     }
 
+    // The memory is owned by the InputStream (or the caller of AImgOpenMemory), so there's nothing to release here
     void tiff_Unmap(thandle_t, tdata_t, toff_t)
     {
         return;
@@ -177,10 +247,67 @@ namespace AImg
         return final;
     }
 
+    // Copies count samples out of a decoded strip, widening 24-bit floats to 32 bits. destStep is the distance between
+    // samples in the destination, which is more than one sample when interleaving channels from separate planes.
+    void copyTiffSamples(const uint8_t *src, uint8_t *dest, size_t count, int32_t bytesPerChannel, size_t destStep)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (bytesPerChannel == 4)
+            {
+                *((float *)dest) = *(float *)src;
+            }
+            else if (bytesPerChannel == 3)
+            {
+                // this will always be 24-bit float, as we return an error in openImage if BITSPERSAMPLE == 3 and SAMPLEFORMAT is not IEEEFP
+                *((float *)dest) = convertFloat24(src);
+            }
+            else if (bytesPerChannel == 2)
+            {
+                // doesn't matter if we have 16-bit int or float, we can just copy the data over all the same
+                *((uint16_t *)dest) = *((uint16_t *)src);
+            }
+            else if (bytesPerChannel == 1)
+            {
+                *dest = *src;
+            }
+
+            src += bytesPerChannel;
+            dest += destStep;
+        }
+    }
+
+    int32_t getDecodeFormatTiff(uint16_t channels, uint16_t bitsPerChannel, uint16_t sampleFormat)
+    {
+        if (channels > 0 && channels <= 4)
+        {
+            // handle 24-bit float
+            if (bitsPerChannel == 24 && sampleFormat == SAMPLEFORMAT_IEEEFP)
+                return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
+
+            if (sampleFormat == SAMPLEFORMAT_IEEEFP)
+            {
+                if (bitsPerChannel == 16)
+                    return AImgFormat::_16BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
+                else if (bitsPerChannel == 32)
+                    return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
+            }
+            else if (sampleFormat == SAMPLEFORMAT_UINT || sampleFormat == SAMPLEFORMAT_INT)
+            {
+                if (bitsPerChannel == 8)
+                    return AImgFormat::_8BITS | (AImgFormat::R << (channels - 1));
+                else if (bitsPerChannel == 16)
+                    return AImgFormat::_16BITS | (AImgFormat::R << (channels - 1));
+            }
+        }
+
+        return AImgFormat::INVALID_FORMAT;
+    }
+
     class TiffFile : public AImgBase
     {
         TIFF *tiff = nullptr;
-        tiffCallbackData callbacks;
+        tiffReadData readData;
 
         uint16_t bitsPerChannel = 0;
         uint16_t channels = 0;
@@ -189,47 +316,54 @@ namespace AImg
         uint16_t compression = 0;
         uint32_t rowsPerStrip = 0;
         uint16_t planarConfig = 0;
+        uint16_t orientation = ORIENTATION_TOPLEFT;
         uint8_t * compressedProfile = NULL;
         uint32_t compressedProfileLen = 0;
 
+        // The last strip decoded (of every plane, for PLANARCONFIG_SEPARATE), and how many of its rows
+        ScratchBuffer stripCache;
+        int64_t cachedStrip = -1;
+        uint32_t cachedStripRows = 0;
+
+        // The encoder, between startWriteRows and finishWriteRows/abortWriteRows
+        TIFF *wTiff = nullptr;
+        tiffCallbackData wCallbacks;
+        int32_t wFormat = AImgFormat::INVALID_FORMAT;
+        int32_t wWidth = 0;
+        uint32_t wNextRow = 0;
+
     public:
         virtual ~TiffFile()
         {
+            closeWriteTiff();
+
             if (tiff != NULL)
                 TIFFClose(tiff);
         }
 
         int32_t getDecodeFormat()
         {
-            if (channels > 0 && channels <= 4)
-            {
-                // handle 24-bit float
-                if (bitsPerChannel == 24 && sampleFormat == SAMPLEFORMAT_IEEEFP)
-                    return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
+            return getDecodeFormatTiff(channels, bitsPerChannel, sampleFormat);
+        }
 
-                if (sampleFormat == SAMPLEFORMAT_IEEEFP)
-                {
-                    if (bitsPerChannel == 16)
-                        return AImgFormat::_16BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
-                    else if (bitsPerChannel == 32)
-                        return AImgFormat::_32BITS | AImgFormat::FLOAT_FORMAT | (AImgFormat::R << (channels - 1));
-                }
-                else if (sampleFormat == SAMPLEFORMAT_UINT || sampleFormat == SAMPLEFORMAT_INT)
-                {
-                    if (bitsPerChannel == 8)
-                        return AImgFormat::_8BITS | (AImgFormat::R << (channels - 1));
-                    else if (bitsPerChannel == 16)
-                        return AImgFormat::_16BITS | (AImgFormat::R << (channels - 1));
-                }
-            }
+        // TIFFTAG_ORIENTATION uses the same flags as EXIF
+        bool reorients()
+        {
+            return orientation > ORIENTATION_TOPLEFT && orientation <= ORIENTATION_LEFTBOT;
+        }
 
-            return AImgFormat::INVALID_FORMAT;
+        bool swapsAxes()
+        {
+            return orientation >= ORIENTATION_LEFTTOP && orientation <= ORIENTATION_LEFTBOT;
         }
 
         virtual int32_t getImageInfo(int32_t *width, int32_t *height, int32_t *numChannels, int32_t *bytesPerChannel, int32_t *floatOrInt, int32_t *decodedImgFormat, uint32_t *colourProfileLen)
         {
-            *width = this->width;
-            *height = this->height;
+            // landscape <=> portrait
+            bool rotate = swapsAxes();
+
+            *width = rotate ? this->height : this->width;
+            *height = rotate ? this->width : this->height;
             *numChannels = this->channels;
             if (colourProfileLen != NULL)
             {
@@ -271,171 +405,111 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t decodeImage(void *realDestBuffer, int32_t forceImageFormat)
+        // For clarity, interleaved (PLANARCONFIG_CONTIG) for a 2x1 image would be: R1,G1,B1,R2,G2,B2, where as SEPARATE would be R1,R2,G1,G2,B1,B2
+        // We don't actually support decoding separated channel buffers like that, so we manually interleave the channels to fix it up.
+        // Each plane has its own run of strips, one after the other.
+        int32_t getNumPlanes()
         {
-            uint8_t *destBuffer = (uint8_t *)realDestBuffer;
+            return planarConfig == PLANARCONFIG_SEPARATE ? channels : 1;
+        }
 
-            int32_t decodeFormat = getDecodeFormat();
+        uint32_t getStripRows()
+        {
+            return std::min(rowsPerStrip, height);
+        }
 
-            std::vector<uint8_t> convertTmpBuffer(0);
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
-            {
-                int32_t numChannels, bytesPerChannelF, floatOrInt;
-                AIGetFormatDetails(decodeFormat, &numChannels, &bytesPerChannelF, &floatOrInt);
+        // Decodes the first rowsNeeded rows of a strip into stripCache, unless they're there already
+        int32_t loadStrip(uint32_t strip, uint32_t rowsNeeded)
+        {
+            if ((int64_t)strip == cachedStrip && rowsNeeded <= cachedStripRows)
+                return AImgErrorCode::AIMG_SUCCESS;
+
+            int32_t planes = getNumPlanes();
+            size_t stripSize = (size_t)TIFFStripSize(tiff);
+            tstrip_t stripsPerPlane = TIFFNumberOfStrips(tiff) / planes;
+            tmsize_t readSize = (tmsize_t)(rowsNeeded * (size_t)TIFFScanlineSize(tiff));
+
+            cachedStrip = -1;
+            stripCache.resize(stripSize * planes);
 
-                convertTmpBuffer.resize(width * height * bytesPerChannelF * numChannels);
-                destBuffer = &convertTmpBuffer[0];
+            for (int32_t plane = 0; plane < planes; plane++)
+            {
+                if (TIFFReadEncodedStrip(tiff, plane * stripsPerPlane + strip, stripCache.data() + plane * stripSize, readSize) == ((tmsize_t)-1)) // this function returns -1 on failure. As an unsigned int. yaaaaaaaaaaay
+                {
+                    mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::loadStrip] Tiff read failure, TIFFReadEncodedStrip failed";
+                    return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+                }
             }
 
-            uint32 stripsize = (uint32)TIFFStripSize(tiff);
-            int32_t bytesPerChannel = bitsPerChannel / 8;
+            cachedStrip = strip;
+            cachedStripRows = rowsNeeded;
 
-            std::vector<char> stripBuffer(stripsize);
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
 
+        // Copies regionWidth pixels from column x of a row in the cached strip to dest, in the decode format
+        void copyStripRow(uint32_t row, int32_t x, int32_t regionWidth, uint8_t *dest)
+        {
             int32_t _;
             int32_t decodeFormatBytesPerChannel;
-            AIGetFormatDetails(decodeFormat, &_, &decodeFormatBytesPerChannel, &_);
+            AIGetFormatDetails(getDecodeFormat(), &_, &decodeFormatBytesPerChannel, &_);
 
-            if (planarConfig == PLANARCONFIG_CONTIG)
-            {
-                unsigned char *bufferPtr = destBuffer;
+            int32_t bytesPerChannel = bitsPerChannel / 8;
+            bool separate = planarConfig == PLANARCONFIG_SEPARATE;
+            int32_t samplesPerPixel = separate ? 1 : channels;
+            size_t destStep = separate ? (size_t)decodeFormatBytesPerChannel * channels : decodeFormatBytesPerChannel;
 
-                size_t row = 0;
-                for (tstrip_t strip = 0; strip < TIFFNumberOfStrips(tiff); strip++)
-                {
-                    if (TIFFReadEncodedStrip(tiff, strip, &stripBuffer[0], -1) == ((tmsize_t)-1)) // this function returns -1 on failure. As an unsigned int. yaaaaaaaaaaay
-                    {
-                        mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::openImage] Tiff read failure, TIFFReadEncodedStrip failed";
-                        return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
-                    }
+            size_t stripSize = (size_t)TIFFStripSize(tiff);
+            size_t rowOffset = (row - (uint32_t)cachedStrip * getStripRows()) * (size_t)TIFFScanlineSize(tiff) + (size_t)x * samplesPerPixel * bytesPerChannel;
 
-                    char *stripPtr = &stripBuffer[0];
+            for (int32_t plane = 0; plane < getNumPlanes(); plane++)
+                copyTiffSamples(stripCache.data() + plane * stripSize + rowOffset, dest + plane * decodeFormatBytesPerChannel, (size_t)regionWidth * samplesPerPixel, bytesPerChannel, destStep);
 
-                    for (size_t rowStrip = 0; rowStrip < rowsPerStrip; rowStrip++)
-                    {
-                        if (row >= height)
-                            break;
+            // convert from YCbCr to RGB (jpeg tiffs always have bytesPerChannel == 1 and PLANARCONFIG_CONTIG, and always have three channels)
+            if (compression == COMPRESSION_JPEG)
+            {
+                for (int32_t i = 0; i < regionWidth; i++, dest += 3)
+                {
+                    float Y = dest[0];
+                    float Cb = dest[1];
+                    float Cr = dest[2];
 
-                        for (size_t x = 0; x < width; x++)
-                        {
-                            for (size_t channelIndex = 0; channelIndex < channels; channelIndex++)
-                            {
-                                if (bytesPerChannel == 4)
-                                {
-                                    *((float *)bufferPtr) = *(float *)stripPtr;
-                                    stripPtr += 4;
-                                    bufferPtr += 4;
-                                }
-                                else if (bytesPerChannel == 3)
-                                {
-                                    // this will always be 24-bit float, as we return an error in openImage if BITSPERSAMPLE == 3 and SAMPLEFORMAT is not IEEEFP
-                                    *((float *)bufferPtr) = convertFloat24((unsigned char *)stripPtr);
-                                    stripPtr += 3;
-                                    bufferPtr += 4;
-                                }
-                                else if (bytesPerChannel == 2)
-                                {
-                                    // doesn't matter if we have 16-bit int or float, we can just copy the data over all the same
-                                    *((uint16_t *)bufferPtr) = *((uint16_t *)stripPtr);
-
-                                    stripPtr += 2;
-                                    bufferPtr += 2;
-                                }
-                                else if (bytesPerChannel == 1)
-                                {
-                                    *bufferPtr = *stripPtr;
-                                    stripPtr += 1;
-                                    bufferPtr += 1;
-                                }
-                            }
-
-                            // convert from YCbCr to RGB (jpeg tiffs always have bytesPerChannel == 1 and PLANARCONFIG_CONTIG, and always have three channels)
-                            if (compression == COMPRESSION_JPEG)
-                            {
-                                float Y = bufferPtr[-3];
-                                float Cb = bufferPtr[-2];
-                                float Cr = bufferPtr[-1];
-
-                                bufferPtr[-3] = (char)std::max(std::min(Y + 1.40200 * (Cr - 127.0), 255.0), 0.0);
-                                bufferPtr[-2] = (char)std::max(std::min(Y - 0.34414 * (Cb - 127.0) - 0.71414 * (Cr - 127.0), 255.0), 0.0);
-                                bufferPtr[-1] = (char)std::max(std::min(Y + 1.77200 * (Cb - 127.0), 255.0), 0.0);
-                            }
-                        }
-                        row++;
-                    }
+                    dest[0] = (char)std::max(std::min(Y + 1.40200 * (Cr - 127.0), 255.0), 0.0);
+                    dest[1] = (char)std::max(std::min(Y - 0.34414 * (Cb - 127.0) - 0.71414 * (Cr - 127.0), 255.0), 0.0);
+                    dest[2] = (char)std::max(std::min(Y + 1.77200 * (Cb - 127.0), 255.0), 0.0);
                 }
             }
+        }
 
-            // This is just a copy of the above block, fixed up to work for channels being stored sequentially not interleaved.
-            // for clarity, interleaved for a 2x1 image would be: R1,G1,B1,R2,G2,B2, where as SEPARATE would be R1,R2,G1,G2,B1,B2
-            // We don't actually support decoding separated channel buffers like that, so we manually interleave the channels to fix it up.
-            else if (planarConfig == PLANARCONFIG_SEPARATE)
-            {
-                int32_t channelIndex = -1;
-                unsigned char *bufferPtr = NULL;
-
-                while (true)
-                {
-                    size_t row = 0;
-                    for (tstrip_t strip = 0; strip < TIFFNumberOfStrips(tiff); strip++)
-                    {
-                        if (TIFFReadEncodedStrip(tiff, strip, &stripBuffer[0], -1) == ((tmsize_t)-1))
-                        {
-                            mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::openImage] Tiff read failure, TIFFReadEncodedStrip failed";
-                            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
-                        }
+        // Only the strips overlapping the region are decoded. With wholeStrips false, each is only decoded as far down as the
+        // last row needed, otherwise the whole strip is, so the next rows can come out of the cache. The region is in stored
+        // coordinates, and is written to realDestBuffer reoriented by orientationFlag.
+        int32_t readRegion(int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, void *realDestBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat,
+            bool wholeStrips, int32_t orientationFlag)
+        {
+            int32_t decodeFormat = getDecodeFormat();
+            if (forceImageFormat == AImgFormat::INVALID_FORMAT)
+                forceImageFormat = decodeFormat;
 
-                        char *stripPtr = (char *)&stripBuffer[0];
+            // Rows are copied out of the strip already cropped, so the band only has to convert and reorient them
+            ConvertBand band;
+            band.init(regionWidth, 0, regionWidth, regionHeight, decodeFormat, forceImageFormat, realDestBuffer, rowPitchBytes, orientationFlag);
 
-                        for (size_t rowStrip = 0; rowStrip < rowsPerStrip; rowStrip++)
-                        {
-                            if (row % height == 0)
-                            {
-                                channelIndex++;
-                                if (channelIndex >= channels)
-                                    goto done;
-
-                                bufferPtr = destBuffer + channelIndex * decodeFormatBytesPerChannel;
-                            }
-
-                            for (size_t x = 0; x < width; x++)
-                            {
-                                if (bytesPerChannel == 4)
-                                {
-                                    *((float *)bufferPtr) = *(float *)stripPtr;
-                                    stripPtr += 4;
-                                    bufferPtr += 4 * channels;
-                                }
-                                else if (bytesPerChannel == 3)
-                                {
-                                    *((float *)bufferPtr) = convertFloat24((unsigned char *)stripPtr);
-                                    stripPtr += 3;
-                                    bufferPtr += 4 * channels;
-                                }
-                                else if (bytesPerChannel == 2)
-                                {
-                                    *((uint16_t *)bufferPtr) = *((uint16 *)stripPtr);
-
-                                    stripPtr += 2;
-                                    bufferPtr += 2 * channels;
-                                }
-                                else if (bytesPerChannel == 1)
-                                {
-                                    *bufferPtr = *stripPtr;
-                                    stripPtr += 1;
-                                    bufferPtr += 1 * channels;
-                                }
-                            }
-                            row++;
-                        }
-                    }
-                }
-            done:;
-            }
+            uint32_t stripRows = getStripRows();
+            uint32_t regionEnd = y + regionHeight;
 
-            if (forceImageFormat != AImgFormat::INVALID_FORMAT && forceImageFormat != decodeFormat)
+            for (uint32_t row = y; row < regionEnd; row++)
             {
-                int32_t err = AImgConvertFormat(destBuffer, realDestBuffer, width, height, decodeFormat, forceImageFormat);
+                uint32_t stripFirstRow = (row / stripRows) * stripRows;
+                uint32_t rowsNeeded = std::min(wholeStrips ? height : regionEnd, stripFirstRow + stripRows) - stripFirstRow;
+
+                int32_t err = loadStrip(row / stripRows, rowsNeeded);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
+
+                copyStripRow(row, x, regionWidth, band.nextRow());
+
+                err = band.rowsDecoded(1);
                 if (err != AImgErrorCode::AIMG_SUCCESS)
                     return err;
             }
@@ -443,15 +517,33 @@ namespace AImg
             return AImgErrorCode::AIMG_SUCCESS;
         }
 
-        virtual int32_t openImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+        virtual int32_t decodeRegion(int32_t x, int32_t y, int32_t regionWidth, int32_t regionHeight, void *realDestBuffer, ptrdiff_t rowPitchBytes, int32_t forceImageFormat)
+        {
+            // The region is in reoriented coordinates, so find where it comes from in the image as stored
+            int32_t storedX, storedY, storedWidth, storedHeight;
+            orientedRegionToStored(orientation, width, height, x, y, regionWidth, regionHeight,
+                &storedX, &storedY, &storedWidth, &storedHeight);
+
+            return readRegion(storedX, storedY, storedWidth, storedHeight, realDestBuffer, rowPitchBytes, forceImageFormat, false, orientation);
+        }
+
+        virtual bool canDecodeRows()
+        {
+            // reorienting needs the whole image
+            return !reorients();
+        }
+
+        virtual int32_t decodeRows(int32_t firstRow, int32_t rowCount, void *destBuffer, size_t rowPitchBytes, int32_t forceImageFormat)
         {
-            callbacks.mReadCallback = readCallback;
-            callbacks.mSeekCallback = seekCallback;
-            callbacks.mTellCallback = tellCallback;
-            callbacks.callbackData = callbackData;
-            callbacks.startPos = tellCallback(callbackData);
+            return readRegion(0, firstRow, width, rowCount, destBuffer, rowPitchBytes, forceImageFormat, true, ORIENTATION_TOPLEFT);
+        }
+
+        virtual int32_t openImage(InputStream* stream)
+        {
+            readData.stream = stream;
+            readData.startPos = stream->tell();
 
-            tiff = TIFFClientOpen("", "r", (thandle_t)&callbacks, tiffRead, tiff_Write, tiff_Seek, tiff_Close, tiff_Size, tiff_Map, tiff_Unmap);
+            tiff = TIFFClientOpen("", "r", (thandle_t)&readData, tiffRead, tiffNoWrite, tiff_ReadSeek, tiff_Close, tiff_ReadSize, tiff_Map, tiff_Unmap);
 
             if (tiff == nullptr)
             {
@@ -515,6 +607,9 @@ namespace AImg
             if (!TIFFGetField(tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat))
                 sampleFormat = SAMPLEFORMAT_UINT; // default to uint format if no SAMPLEFORMAT tifftag is present
 
+            if (!TIFFGetField(tiff, TIFFTAG_ORIENTATION, &orientation))
+                orientation = ORIENTATION_TOPLEFT;
+
             if (!TIFFGetField(tiff, TIFFTAG_ICCPROFILE, &compressedProfileLen, &compressedProfile))
             {
                 compressedProfile = NULL;
@@ -555,91 +650,125 @@ namespace AImg
             return retval;
         }
 
-        int32_t writeImage(void *data, int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat, const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
-            WriteCallback writeCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData, void *encodingOptions)
+        void closeWriteTiff()
+        {
+            if (wTiff == nullptr)
+                return;
+
+            TIFFClose(wTiff);
+            wTiff = nullptr;
+
+            // Leave the pointer at the end of the file, because libtiff doesn't... because it's a fantastic piece of software
+            wCallbacks.stream->seek(wCallbacks.furthestPositionWritten);
+        }
+
+        virtual bool canWriteRows()
+        {
+            return true;
+        }
+
+        virtual int32_t startWriteRows(int32_t width, int32_t height, int32_t inputFormat, int32_t outputFormat,
+            const char *profileName, uint8_t *colourProfile, uint32_t colourProfileLen,
+            OutputStream* stream, void* encodingOptions)
         {
             // Suppress unused warning
             (void)profileName;
 
             AIL_UNUSED_PARAM(encodingOptions);
 
-            tiffCallbackData wCallbacks;
-            wCallbacks.mWriteCallback = writeCallback;
-            wCallbacks.mSeekCallback = seekCallback;
-            wCallbacks.mTellCallback = tellCallback;
-            wCallbacks.callbackData = callbackData;
-            wCallbacks.startPos = tellCallback(callbackData);
-            TIFF *wTiff = TIFFClientOpen("", "w", (thandle_t)&wCallbacks, tiffRead, tiff_Write, tiff_Seek, tiff_Close, tiff_Size, tiff_Map, tiff_Unmap);
-
-            int32_t retval = AIMG_SUCCESS;
+            wFormat = getWriteFormatTiff(inputFormat, outputFormat);
 
-            int32_t wFormat = getWriteFormatTiff(inputFormat, outputFormat);
             if (wFormat == AImgFormat::INVALID_FORMAT)
             {
-                mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::writeImage] Cannot write this format to tiff."; // developers: see comment in getWriteFormatTiff
-                retval = AImgErrorCode::AIMG_WRITE_FAILED_INTERNAL;
+                mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::startWriteRows] Cannot write this format to tiff."; // developers: see comment in getWriteFormatTiff
+                return AImgErrorCode::AIMG_WRITE_FAILED_INTERNAL;
             }
-            else
+
+            wCallbacks.stream = stream;
+            wCallbacks.startPos = stream->tell();
+            wCallbacks.furthestPositionWritten = wCallbacks.startPos;
+
+            int32_t numChannels, bytesPerChannel, floatOrInt;
+            AIGetFormatDetails(wFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+
+            // Classic tiff uses 32 bit offsets, so anything that might not fit has to be written as BigTIFF
+            const char* writeMode = "w";
+            if ((uint64_t)width * height * numChannels * bytesPerChannel + colourProfileLen >= 0xF0000000ull)
+                writeMode = "w8";
+
+            wTiff = TIFFClientOpen("", writeMode, (thandle_t)&wCallbacks, tiffNoRead, tiff_Write, tiff_Seek, tiff_Close, tiff_Size, tiff_NoMap, tiff_Unmap);
+
+            if (wTiff == nullptr)
             {
-                int32_t numChannels, bytesPerChannel, floatOrInt;
-                AIGetFormatDetails(wFormat, &numChannels, &bytesPerChannel, &floatOrInt);
+                mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::startWriteRows] TIFFClientOpen failed.";
+                return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
+            }
 
-                // Convert
-                std::vector<uint8_t> convertBuffer(0);
-                if (wFormat != inputFormat)
-                {
-                    convertBuffer.resize(width * height * numChannels * bytesPerChannel);
+            wWidth = width;
+            wNextRow = 0;
 
-                    int32_t convertError = AImgConvertFormat(data, &convertBuffer[0], width, height, inputFormat, wFormat);
+            TIFFSetField(wTiff, TIFFTAG_IMAGEWIDTH, width);
+            TIFFSetField(wTiff, TIFFTAG_IMAGELENGTH, height);
+            TIFFSetField(wTiff, TIFFTAG_SAMPLESPERPIXEL, numChannels);
+            TIFFSetField(wTiff, TIFFTAG_BITSPERSAMPLE, bytesPerChannel * 8);
+            TIFFSetField(wTiff, TIFFTAG_SAMPLEFORMAT, floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
+            TIFFSetField(wTiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+            TIFFSetField(wTiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 
-                    if (convertError != AImgErrorCode::AIMG_SUCCESS)
-                        return convertError;
-                    data = &convertBuffer[0];
-                }
+            if (numChannels == 1)
+            {
+                TIFFSetField(wTiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+            }
+            else
+            {
+                TIFFSetField(wTiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+            }
 
-                TIFFSetField(wTiff, TIFFTAG_IMAGEWIDTH, width);
-                TIFFSetField(wTiff, TIFFTAG_IMAGELENGTH, height);
-                TIFFSetField(wTiff, TIFFTAG_SAMPLESPERPIXEL, numChannels);
-                TIFFSetField(wTiff, TIFFTAG_BITSPERSAMPLE, bytesPerChannel * 8);
-                TIFFSetField(wTiff, TIFFTAG_SAMPLEFORMAT, floatOrInt == AImgFloatOrIntType::FITYPE_FLOAT ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT);
-                TIFFSetField(wTiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-                TIFFSetField(wTiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+            tsize_t stripRows = TIFFDefaultStripSize(wTiff, 0);
 
-                if (numChannels == 1)
-                {
-                    TIFFSetField(wTiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-                }
-                else
-                {
-                    TIFFSetField(wTiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
-                }
+            TIFFSetField(wTiff, TIFFTAG_ROWSPERSTRIP, stripRows);
 
-                tsize_t stripRows = TIFFDefaultStripSize(wTiff, 0);
+            int proflength = colourProfileLen;
+            const void* profdata = colourProfile;
+            if (profdata)
+                TIFFSetField(wTiff, TIFFTAG_ICCPROFILE, proflength, profdata);
 
-                TIFFSetField(wTiff, TIFFTAG_ROWSPERSTRIP, stripRows);
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
+
+        virtual int32_t writeRowBand(const AImgWriteSource& source, int32_t rowCount)
+        {
+            // Rows are converted (or gathered from a strided/planar source) one at a time, as they're written
+            WriteSourceRows rows(source, wWidth, wFormat);
 
-                int proflength = colourProfileLen;
-                const void* profdata = colourProfile;
-                if (profdata)
-                    TIFFSetField(wTiff, TIFFTAG_ICCPROFILE, proflength, profdata);
+            for (int32_t y = 0; y < rowCount; y++)
+            {
+                const uint8_t* row;
+                int32_t err = rows.getRow(y, &row);
+                if (err != AImgErrorCode::AIMG_SUCCESS)
+                    return err;
 
-                for (int32_t y = 0; y < height; y++)
+                if (TIFFWriteScanline(wTiff, (tdata_t)row, wNextRow, 0) < 0)
                 {
-                    if (TIFFWriteScanline(wTiff, &((uint8_t *)data)[numChannels * bytesPerChannel * width * y], y, 0) < 0)
-                    {
-                        mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::writeImage] TIFFWriteScanline failed.";
-                        retval = AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
-                        break;
-                    }
+                    mErrorDetails = "[AImg::TIFFImageLoader::TiffFile::writeRowBand] TIFFWriteScanline failed.";
+                    return AImgErrorCode::AIMG_WRITE_FAILED_EXTERNAL;
                 }
+
+                wNextRow++;
             }
 
-            TIFFClose(wTiff);
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
 
-            // Leave the pointer at the end of the file, because libtiff doesn't... because it's a fantastic piece of software
-            wCallbacks.mSeekCallback(wCallbacks.callbackData, wCallbacks.furthestPositionWritten);
+        virtual int32_t finishWriteRows()
+        {
+            closeWriteTiff();
+            return AImgErrorCode::AIMG_SUCCESS;
+        }
 
-            return retval;
+        virtual void abortWriteRows()
+        {
+            closeWriteTiff();
         }
 
         // False for now
@@ -664,6 +793,181 @@ namespace AImg
         return new TiffFile();
     }
 
+    namespace
+    {
+        // Reads the first value of an IFD entry, which is stored in the entry itself if it fits, or at an offset otherwise
+        bool readTiffTagValue(InputStream* stream, int64_t startPos, const uint8_t* entry, bool littleEndian, bool bigTiff, uint64_t* value)
+        {
+            uint16_t type = readUInt16(entry + 2, littleEndian);
+            uint64_t count = bigTiff ? readUInt64(entry + 4, littleEndian) : readUInt32(entry + 4, littleEndian);
+            const uint8_t* valueField = entry + (bigTiff ? 12 : 8);
+            size_t valueFieldSize = bigTiff ? 8 : 4;
+
+            size_t typeSize;
+            switch (type)
+            {
+            case TIFF_BYTE: typeSize = 1; break;
+            case TIFF_SHORT: typeSize = 2; break;
+            case TIFF_LONG: typeSize = 4; break;
+            case TIFF_LONG8: typeSize = 8; break;
+            default: return false;
+            }
+
+            if (count == 0)
+                return false;
+
+            uint8_t buf[8];
+            const uint8_t* valuePtr = valueField;
+
+            if (count > valueFieldSize / typeSize)
+            {
+                uint64_t offset = bigTiff ? readUInt64(valueField, littleEndian) : readUInt32(valueField, littleEndian);
+
+                int64_t pos = stream->tell();
+                stream->seek(startPos + (int64_t)offset);
+                int64_t got = stream->read(buf, typeSize);
+                stream->seek(pos);
+
+                if (got != (int64_t)typeSize)
+                    return false;
+
+                valuePtr = buf;
+            }
+
+            switch (typeSize)
+            {
+            case 1: *value = valuePtr[0]; break;
+            case 2: *value = readUInt16(valuePtr, littleEndian); break;
+            case 4: *value = readUInt32(valuePtr, littleEndian); break;
+            default: *value = readUInt64(valuePtr, littleEndian); break;
+            }
+
+            return true;
+        }
+    }
+
+    // Reads the tags TiffFile::openImage needs straight out of the first IFD, instead of going through TIFFClientOpen,
+    // which reads and allocates the whole directory (including the strip tables and the ICC profile).
+    int32_t TIFFImageLoader::probeImage(InputStream* stream, AImgProbeInfo* info)
+    {
+        int64_t startPos = stream->tell();
+
+        uint8_t header[16];
+        if (stream->read(header, 8) != 8)
+            return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+        bool littleEndian = header[0] == 0x49;
+        bool bigTiff = readUInt16(header + 2, littleEndian) == 0x2b;
+
+        uint64_t ifdOffset;
+        if (bigTiff)
+        {
+            if (stream->read(header + 8, 8) != 8)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            ifdOffset = readUInt64(header + 8, littleEndian);
+        }
+        else
+        {
+            ifdOffset = readUInt32(header + 4, littleEndian);
+        }
+
+        stream->seek(startPos + (int64_t)ifdOffset);
+
+        uint8_t countBuf[8];
+        uint64_t entryCount;
+        if (bigTiff)
+        {
+            if (stream->read(countBuf, 8) != 8)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            entryCount = readUInt64(countBuf, littleEndian);
+        }
+        else
+        {
+            if (stream->read(countBuf, 2) != 2)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+            entryCount = readUInt16(countBuf, littleEndian);
+        }
+
+        size_t entrySize = bigTiff ? 20 : 12;
+
+        uint64_t width = 0, height = 0;
+        uint64_t bitsPerChannel = 1, channels = 1, sampleFormat = SAMPLEFORMAT_UINT, compression = COMPRESSION_NONE;
+        uint64_t orientation = ORIENTATION_TOPLEFT;
+        uint64_t profileLen = 0;
+        bool hasWidth = false, hasHeight = false, hasBitsPerSample = false;
+
+        for (uint64_t i = 0; i < entryCount; i++)
+        {
+            uint8_t entry[20];
+            if (stream->read(entry, entrySize) != (int64_t)entrySize)
+                return AImgErrorCode::AIMG_LOAD_FAILED_EXTERNAL;
+
+            uint16_t tag = readUInt16(entry, littleEndian);
+            switch (tag)
+            {
+            case TIFFTAG_IMAGEWIDTH:
+                hasWidth = readTiffTagValue(stream, startPos, entry, littleEndian, bigTiff, &width);
+                break;
+            case TIFFTAG_IMAGELENGTH:
+                hasHeight = readTiffTagValue(stream, startPos, entry, littleEndian, bigTiff, &height);
+                break;
+            case TIFFTAG_BITSPERSAMPLE:
+                hasBitsPerSample = readTiffTagValue(stream, startPos, entry, littleEndian, bigTiff, &bitsPerChannel);
+                break;
+            case TIFFTAG_SAMPLESPERPIXEL:
+                readTiffTagValue(stream, startPos, entry, littleEndian, bigTiff, &channels);
+                break;
+            case TIFFTAG_SAMPLEFORMAT:
+                readTiffTagValue(stream, startPos, entry, littleEndian, bigTiff, &sampleFormat);
+                break;
+            case TIFFTAG_COMPRESSION:
+                readTiffTagValue(stream, startPos, entry, littleEndian, bigTiff, &compression);
+                break;
+            case TIFFTAG_ORIENTATION:
+                readTiffTagValue(stream, startPos, entry, littleEndian, bigTiff, &orientation);
+                break;
+            case TIFFTAG_ICCPROFILE:
+                // the profile is an UNDEFINED blob, its length is just the entry's count
+                profileLen = bigTiff ? readUInt64(entry + 4, littleEndian) : readUInt32(entry + 4, littleEndian);
+                break;
+            default:
+                break;
+            }
+        }
+
+        // the same checks as TiffFile::openImage
+        if (channels == 0 || channels > 4)
+            return AImgErrorCode::AIMG_LOAD_FAILED_UNSUPPORTED_TIFF;
+
+        if (!hasWidth || !hasHeight || !hasBitsPerSample)
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+        if (compression == COMPRESSION_JPEG)
+            return AImgErrorCode::AIMG_LOAD_FAILED_INTERNAL;
+
+        int32_t decodeFormat = getDecodeFormatTiff((uint16_t)channels, (uint16_t)bitsPerChannel, (uint16_t)sampleFormat);
+
+        if (compression == COMPRESSION_OJPEG || bitsPerChannel % 8 != 0 || decodeFormat == AImgFormat::INVALID_FORMAT)
+            return AImgErrorCode::AIMG_LOAD_FAILED_UNSUPPORTED_TIFF;
+
+        // landscape <=> portrait
+        bool rotate = orientation >= ORIENTATION_LEFTTOP && orientation <= ORIENTATION_LEFTBOT;
+
+        info->width = (int32_t)(rotate ? height : width);
+        info->height = (int32_t)(rotate ? width : height);
+        info->numChannels = (int32_t)channels;
+        info->bytesPerChannel = (int32_t)bitsPerChannel / 8;
+        info->colourProfileLen = (uint32_t)profileLen;
+        info->decodedImgFormat = decodeFormat;
+
+        if (sampleFormat == SAMPLEFORMAT_IEEEFP)
+            info->floatOrInt = AImgFloatOrIntType::FITYPE_FLOAT;
+        else
+            info->floatOrInt = AImgFloatOrIntType::FITYPE_INT;
+
+        return AImgErrorCode::AIMG_SUCCESS;
+    }
+
     int32_t TIFFImageLoader::initialise()
     {
         // silence libtiff's crap output.
@@ -675,17 +979,14 @@ namespace AImg
         return AImgErrorCode::AIMG_SUCCESS;
     }
 
-    bool TIFFImageLoader::canLoadImage(ReadCallback readCallback, TellCallback tellCallback, SeekCallback seekCallback, void *callbackData)
+    bool TIFFImageLoader::canLoadImage(const uint8_t* header, size_t headerSize)
     {
-        int32_t startingPos = tellCallback(callbackData);
-
-        std::vector<uint8_t> header(4);
-        readCallback(callbackData, &header[0], 4);
-
-        seekCallback(callbackData, startingPos);
+        if (headerSize < 4)
+            return false;
 
-        return (header[0] == 0x49 && header[1] == 0x49 && header[2] == 0x2a && header[3] == 0x00) ||
-            (header[0] == 0x4d && header[1] == 0x4d && header[2] == 0x00 && header[3] == 0x2a);
+        // 0x2a is classic tiff, 0x2b is BigTIFF
+        return (header[0] == 0x49 && header[1] == 0x49 && (header[2] == 0x2a || header[2] == 0x2b) && header[3] == 0x00) ||
+            (header[0] == 0x4d && header[1] == 0x4d && header[2] == 0x00 && (header[3] == 0x2a || header[3] == 0x2b));
     }
 
     std::string TIFFImageLoader::getFileExtension()